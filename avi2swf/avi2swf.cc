@@ -50,6 +50,7 @@ static int mp3_bitrate = 32;
 static int samplerate = 11025;
 static int numframes = 0;
 static char* skipframes = 0;
+static int threads = 1;
 
 static struct options_t options[] = {
 {"h", "help"},
@@ -65,6 +66,7 @@ static struct options_t options[] = {
 {"k", "keyframe"},
 {"x", "extragood"},
 {"T", "flashversion"},
+{"j", "threads"},
 {"V", "version"},
 {0,0}
 };
@@ -119,6 +121,12 @@ int args_callback_option(char*name,char*val)
 	expensive = 1;
 	return 0;
     }
+    else if(!strcmp(name, "j")) {
+	threads = atoi(val);
+	if(threads<1)
+	    threads = 1;
+	return 1;
+    }
     else if(!strcmp(name, "m")) {
 	mp3_bitrate = atoi(val);
 	return 1;
@@ -179,6 +187,7 @@ void args_callback_usage(char *name)
     printf("-k , --keyframe                Set the number of intermediate frames between keyframes.\n");
     printf("-x , --extragood               Enable some *very* expensive compression strategies.\n");
     printf("-T , --flashversion <n>        Set output flash version to <n>.\n");
+    printf("-j , --threads <n>             Decode and encode on <n> threads.\n");
     printf("-V , --version                 Print program version and exit\n");
     printf("\n");
 }
@@ -292,6 +301,8 @@ int main (int argc,char ** argv)
 	v2swf_setparameter(&v2swf, "skipframes", skipframes);
     if(expensive)
 	v2swf_setparameter(&v2swf, "motioncompensation", "1");
+    if(threads>1)
+	v2swf_setparameter(&v2swf, "threads", itoa(threads));
     if(flip)
 	video.setparameter(&video, "flip", "1");
     if(verbose)
@@ -23,6 +23,12 @@
 #include "v2swf.h"
 #include "../lib/rfxswf.h"
 #include "../lib/q.h"
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/* number of decoded frames the decoder thread may be ahead of the encoder */
+#define FRAMEQUEUE_SIZE 4
 
 typedef struct _v2swf_internal_t
 {
@@ -95,8 +101,27 @@ typedef struct _v2swf_internal_t
 
     int version;
 
+    int threads;
+
     VIDEOSTREAM stream;
 
+#ifdef HAVE_PTHREAD_H
+    /* decoding and scaling of video frames happens on a separate thread
+       if threads>1. The scaled frames are passed to the encoder through
+       a ring of FRAMEQUEUE_SIZE buffers. */
+    int pipeline;
+    pthread_t decoder;
+    pthread_mutex_t videolock; // protects video
+    pthread_mutex_t queuelock;
+    pthread_cond_t queuecond;
+    unsigned char* queue[FRAMEQUEUE_SIZE];
+    int queuepos;
+    int queuefill;
+    int queuebusy; // the first queue entry is being encoded
+    int queueeof;
+    int queuestop;
+#endif
+
 } v2swf_internal_t;
 
 static int verbose = 0;
@@ -286,7 +311,15 @@ static void writeAudioForOneFrame(v2swf_internal_t* i)
 
     /* write num frames, max 1 block */
     for(pos=0;pos<num;pos++) {
-        if(!getSamples(i->video, block1, blocksize * (double)swf_mp3_in_samplerate/swf_mp3_out_samplerate, speedup)) {
+	int ok;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&i->videolock);
+#endif
+	ok = getSamples(i->video, block1, blocksize * (double)swf_mp3_in_samplerate/swf_mp3_out_samplerate, speedup);
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&i->videolock);
+#endif
+        if(!ok) {
 	    i->audio_eof = 1; i->video->samplerate = i->video->channels = 0; //end of soundtrack
 	    /* fall through, this probably was a partial read. (We did, after all,
 	       come to this point, so i->audio_eof must have been false so far) */
@@ -390,6 +423,13 @@ static void writehead(v2swf_internal_t*i)
 	i->width = 1;
     if(!i->height)
 	i->height = 1;
+#ifdef HAVE_PTHREAD_H
+    if(i->threads>1) {
+	int t;
+	for(t=0;t<FRAMEQUEUE_SIZE;t++)
+	    i->queue[t] = (unsigned char*)malloc(i->width*i->height*4);
+    } else
+#endif
     i->buffer = (unsigned char*)malloc(i->width*i->height*4);
     i->vrbuffer = (unsigned char*)malloc(i->video->width*i->video->height*4);
 
@@ -415,12 +455,38 @@ static void writehead(v2swf_internal_t*i)
     i->filesize += swf_WriteTag2(&i->out, i->tag);
 }
 
+#ifdef HAVE_PTHREAD_H
+static void stopdecoder(v2swf_internal_t*i)
+{
+    int t;
+    if(i->pipeline) {
+	pthread_mutex_lock(&i->queuelock);
+	i->queuestop = 1;
+	pthread_cond_broadcast(&i->queuecond);
+	pthread_mutex_unlock(&i->queuelock);
+	pthread_join(i->decoder, 0);
+	i->pipeline = 0;
+    }
+    for(t=0;t<FRAMEQUEUE_SIZE;t++) {
+	if(i->queue[t]) {
+	    if(i->buffer == i->queue[t])
+		i->buffer = 0;
+	    free(i->queue[t]);i->queue[t] = 0;
+	}
+    }
+}
+#endif
+
 static void finish(v2swf_internal_t*i)
 {
     msg("finish(): i->finished=%d\n", i->finished);
     if(!i->finished) {
 	msg("write endtag\n", i->finished);
 
+#ifdef HAVE_PTHREAD_H
+	stopdecoder(i);
+#endif
+
 	if(i->add_cut) {
 	    swf_ResetTag(i->tag, ST_SHOWFRAME);
 	    i->filesize += swf_WriteTag2(&i->out, i->tag);
@@ -570,6 +636,10 @@ static int blockdiff_exact(U8*d1,U8*d2,int yadd, int xl, int yl)
 		if(g) 
 		    goto differ;*/
 
+#ifdef HAVE_PTHREAD_H
+static void* decodeframes(void*_i);
+#endif
+
 static void checkInit(v2swf_internal_t*i)
 {
     if(!i->head_done) {
@@ -582,12 +652,23 @@ static void checkInit(v2swf_internal_t*i)
 	    if(i->domotion) {
 		i->stream.do_motion = 1;
 	    }
+	    i->stream.threads = i->threads;
 	}
+#ifdef HAVE_PTHREAD_H
+	if(i->threads>1) {
+	    if(!pthread_create(&i->decoder, 0, decodeframes, i)) {
+		i->pipeline = 1;
+	    } else {
+		msg("couldn't start decoder thread\n");
+		i->buffer = i->queue[0];
+	    }
+	}
+#endif
 	i->head_done = 1;
     }
 }
 
-static void scaleimage(v2swf_internal_t*i)
+static void scaleimage(v2swf_internal_t*i, unsigned char*buffer)
 {
     int x,y;
     int xv,yv;
@@ -598,10 +679,10 @@ static void scaleimage(v2swf_internal_t*i)
 	    i->width, i->height
 	    );
 
-    memset(i->buffer, 255, i->width*i->height*4);
+    memset(buffer, 255, i->width*i->height*4);
     for(y=0,yv=0;y<i->height;y++,yv+=ym) {
 	int*src = &((int*)i->vrbuffer)[(yv>>16)*i->video->width];
-	int*dest = &((int*)i->buffer)[y*i->width];
+	int*dest = &((int*)buffer)[y*i->width];
 	for(x=0,xv=0;x<i->width;x++,xv+=xm) {
 	    dest[x] = src[xv>>16];
 	}
@@ -623,14 +704,27 @@ static int writeAudioOnly(v2swf_internal_t*i)
     return 1;
 }
 
+static int getimage(v2swf_internal_t*i)
+{
+    int ret;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&i->videolock);
+#endif
+    ret = videoreader_getimage(i->video, i->vrbuffer);
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&i->videolock);
+#endif
+    return ret;
+}
+
 static int getframe(v2swf_internal_t*i)
 {
     if(!i->skipframes)
-        return videoreader_getimage(i->video, i->vrbuffer);
+        return getimage(i);
     else {
         int t;
         for(t=0;t<i->skipframes;t++) {
-            int ret = videoreader_getimage(i->video, i->vrbuffer);
+            int ret = getimage(i);
             if(!ret)
                 return 0;
         }
@@ -638,6 +732,72 @@ static int getframe(v2swf_internal_t*i)
     }
 }
 
+#ifdef HAVE_PTHREAD_H
+static void* decodeframes(void*_i)
+{
+    v2swf_internal_t*i = (v2swf_internal_t*)_i;
+    while(1) {
+	int pos, ok;
+	pthread_mutex_lock(&i->queuelock);
+	while(i->queuefill == FRAMEQUEUE_SIZE && !i->queuestop)
+	    pthread_cond_wait(&i->queuecond, &i->queuelock);
+	if(i->queuestop) {
+	    pthread_mutex_unlock(&i->queuelock);
+	    break;
+	}
+	pos = (i->queuepos + i->queuefill) % FRAMEQUEUE_SIZE;
+	pthread_mutex_unlock(&i->queuelock);
+
+	ok = getframe(i);
+	if(ok)
+	    scaleimage(i, i->queue[pos]);
+
+	pthread_mutex_lock(&i->queuelock);
+	if(ok)
+	    i->queuefill++;
+	else
+	    i->queueeof = 1;
+	pthread_cond_broadcast(&i->queuecond);
+	pthread_mutex_unlock(&i->queuelock);
+	if(!ok)
+	    break;
+    }
+    return 0;
+}
+
+/* get the next decoded and scaled frame from the decoder thread, and
+   hand the previous one back to it */
+static int popframe(v2swf_internal_t*i)
+{
+    int ok;
+    pthread_mutex_lock(&i->queuelock);
+    if(i->queuebusy) {
+	i->queuepos = (i->queuepos + 1) % FRAMEQUEUE_SIZE;
+	i->queuefill--;
+	i->queuebusy = 0;
+	pthread_cond_broadcast(&i->queuecond);
+    }
+    while(!i->queuefill && !i->queueeof)
+	pthread_cond_wait(&i->queuecond, &i->queuelock);
+    ok = i->queuefill>0;
+    if(ok) {
+	i->buffer = i->queue[i->queuepos];
+	i->queuebusy = 1;
+    }
+    pthread_mutex_unlock(&i->queuelock);
+    return ok;
+}
+#endif
+
+static int nextframe(v2swf_internal_t*i)
+{
+#ifdef HAVE_PTHREAD_H
+    if(i->pipeline)
+	return popframe(i);
+#endif
+    return getframe(i);
+}
+
 static int encodeoneframe(v2swf_internal_t*i)
 {
     videoreader_t*video = i->video;
@@ -655,7 +815,7 @@ static int encodeoneframe(v2swf_internal_t*i)
 	return writeAudioOnly(i);
     }
 
-    if(!getframe(i) || (i->numframes && i->frames==i->numframes)) 
+    if(!nextframe(i) || (i->numframes && i->frames==i->numframes)) 
     {
 	i->video_eof = 1;
 	msg("videoreader returned eof\n");
@@ -677,7 +837,10 @@ static int encodeoneframe(v2swf_internal_t*i)
 	writeShowFrame(i);
     }
     
-    scaleimage(i);
+#ifdef HAVE_PTHREAD_H
+    if(!i->pipeline)
+#endif
+    scaleimage(i, i->buffer);
 
     msg("version is %d\n", i->version);
 
@@ -905,9 +1068,17 @@ int v2swf_init(v2swf_t*v2swf, videoreader_t * video)
     i->keyframe = 1;
     i->showframe = 0;
 
+    i->threads = 1;
+
     memset(&i->out, 0, sizeof(writer_t));
     memset(&i->out2, 0, sizeof(writer_t));
 
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_init(&i->videolock, 0);
+    pthread_mutex_init(&i->queuelock, 0);
+    pthread_cond_init(&i->queuecond, 0);
+#endif
+
     return 0;
 }
 int v2swf_read(v2swf_t*v2swf, void*buffer, int len)
@@ -935,6 +1106,12 @@ void v2swf_close(v2swf_t*v2swf)
     /* needed only if aborting: */
     finish(i);
 
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_destroy(&i->videolock);
+    pthread_mutex_destroy(&i->queuelock);
+    pthread_cond_destroy(&i->queuecond);
+#endif
+
     msg("freeing memory\n");
     free(v2swf->internal);
     memset(v2swf, 0, sizeof(v2swf_t));
@@ -981,6 +1158,10 @@ void v2swf_setparameter(v2swf_t*v2swf, char*name, char*value)
 	i->numframes = atoi(value);
     } else if(!strcmp(name, "motioncompensation")) {
 	i->domotion = atoi(value);
+    } else if(!strcmp(name, "threads")) {
+	i->threads = atoi(value);
+	if(i->threads<1)
+	    i->threads = 1;
     } else if(!strcmp(name, "prescale")) {
 	i->prescale = atoi(value);
     } else if(!strcmp(name, "blockdiff")) {
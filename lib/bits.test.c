@@ -0,0 +1,326 @@
+/* bits.test.c
+
+   Round-trip tests and a speed comparison for swf_GetBits()/swf_SetBits(),
+   against the old bit-at-a-time implementation, and for swf_ShapeSetEdges()
+   against the single edge functions.
+
+   Part of the swftools package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "rfxswf.h"
+
+static U32 old_GetBits(TAG * t,int nbits)
+{ U32 res = 0;
+  if (!nbits) return 0;
+  if (!t->readBit) t->readBit = 0x80;
+  while (nbits)
+  { res<<=1;
+    if (t->data[t->pos]&t->readBit) res|=1;
+    t->readBit>>=1;
+    nbits--;
+    if (!t->readBit)
+    { if (nbits) t->readBit = 0x80;
+      t->pos++;
+    }
+  }
+  return res;
+}
+
+static int old_SetBits(TAG * t,U32 v,int nbits)
+{ U32 bm = 1<<(nbits-1);
+
+  while (nbits)
+  { if (!t->writeBit)
+    { if (FAILED(swf_SetU8(t,0))) return -1;
+      t->writeBit = 0x80;
+    }
+    if (v&bm) t->data[t->len-1] |= t->writeBit;
+    bm>>=1;
+    t->writeBit>>=1;
+    nbits--;
+  }
+  return 0;
+}
+
+static unsigned int seed = 0x5eed;
+static U32 myrand()
+{
+    seed = seed*1103515245+12345;
+    return seed>>8 ^ seed<<24;
+}
+
+#define OPS 1000
+
+typedef struct _op {
+    char type; // 0 = bits, 1 = byte, 2 = reset
+    int nbits;
+    U32 value;
+} op_t;
+
+static void random_ops(op_t*ops, int num)
+{
+    int t;
+    for(t=0;t<num;t++) {
+	int r = myrand()%16;
+	ops[t].type = r==0?1:(r==1?2:0);
+	ops[t].nbits = myrand()%33;
+	ops[t].value = myrand();
+    }
+}
+
+static void write_ops(TAG*tag, op_t*ops, int num, int old)
+{
+    int t;
+    for(t=0;t<num;t++) {
+	if(ops[t].type==0) {
+	    if(old) old_SetBits(tag, ops[t].value, ops[t].nbits);
+	    else    swf_SetBits(tag, ops[t].value, ops[t].nbits);
+	} else if(ops[t].type==1) {
+	    swf_SetU8(tag, ops[t].value);
+	} else {
+	    swf_ResetWriteBits(tag);
+	}
+    }
+}
+
+static void test_roundtrip()
+{
+    op_t ops[OPS];
+    int run;
+    for(run=0;run<2000;run++) {
+	int num = myrand()%OPS;
+	int t;
+	random_ops(ops, num);
+	TAG*tag1 = swf_InsertTag(0, ST_DEFINESHAPE);
+	TAG*tag2 = swf_InsertTag(0, ST_DEFINESHAPE);
+	swf_SetU8(tag1, 0);swf_SetU8(tag2, 0);
+	write_ops(tag1, ops, num, 1);
+	write_ops(tag2, ops, num, 0);
+	assert(tag1->len == tag2->len);
+	assert(tag1->writeBit == tag2->writeBit);
+	assert(!memcmp(tag1->data, tag2->data, tag1->len));
+
+	/* read everything back, with both implementations */
+	tag1->pos = tag2->pos = 1;
+	for(t=0;t<num;t++) {
+	    if(ops[t].type==0) {
+		U32 mask = ops[t].nbits==32?0xffffffff:(1u<<ops[t].nbits)-1;
+		U32 v1 = old_GetBits(tag1, ops[t].nbits);
+		U32 v2 = swf_GetBits(tag2, ops[t].nbits);
+		assert(v1 == v2);
+		assert(v1 == (ops[t].value&mask));
+	    } else if(ops[t].type==1) {
+		assert(swf_GetU8(tag1) == (U8)ops[t].value);
+		assert(swf_GetU8(tag2) == (U8)ops[t].value);
+	    } else {
+		swf_ResetReadBits(tag1);
+		swf_ResetReadBits(tag2);
+	    }
+	    assert(tag1->pos == tag2->pos);
+	    assert(tag1->readBit == tag2->readBit);
+	}
+
+	/* read from a buffer without any slack after the data */
+	TAG tag3;
+	memset(&tag3, 0, sizeof(tag3));
+	tag3.len = tag3.memsize = tag2->len;
+	tag3.data = (U8*)malloc(tag3.len);
+	memcpy(tag3.data, tag2->data, tag3.len);
+	tag3.pos = 1;
+	for(t=0;t<num;t++) {
+	    if(ops[t].type==0) {
+		U32 mask = ops[t].nbits==32?0xffffffff:(1u<<ops[t].nbits)-1;
+		assert(swf_GetBits(&tag3, ops[t].nbits) == (ops[t].value&mask));
+	    } else if(ops[t].type==1) {
+		assert(swf_GetU8(&tag3) == (U8)ops[t].value);
+	    } else {
+		TAG*t3 = &tag3;
+		swf_ResetReadBits(t3);
+	    }
+	}
+	free(tag3.data);
+	swf_DeleteTag(0, tag1);
+	swf_DeleteTag(0, tag2);
+    }
+    printf("round trip: ok\n");
+}
+
+/* mostly short edges, with the occasional one that needs to be split */
+static void random_edges(SHAPEEDGE*edges, int num)
+{
+    int t;
+    for(t=0;t<num;t++) {
+	int r = myrand()%64;
+	int range = r==0?(1<<22):(r<8?(1<<17):(r<32?2000:20));
+	edges[t].curve = myrand()&1;
+	edges[t].x = (int)(myrand()%range) - range/2;
+	edges[t].y = (int)(myrand()%range) - range/2;
+	edges[t].ax = edges[t].curve?(int)(myrand()%range) - range/2:0;
+	edges[t].ay = edges[t].curve?(int)(myrand()%range) - range/2:0;
+	if(r==63) edges[t].x = 0;
+	if(r==62) edges[t].y = 0;
+    }
+}
+
+static void write_edges(TAG*tag, SHAPEEDGE*edges, int num)
+{
+    int t;
+    for(t=0;t<num;t++) {
+	if(edges[t].curve)
+	    swf_ShapeSetCurve(tag, 0, edges[t].x, edges[t].y, edges[t].ax, edges[t].ay);
+	else
+	    swf_ShapeSetLine(tag, 0, edges[t].x, edges[t].y);
+    }
+}
+
+static void test_edges()
+{
+    SHAPEEDGE edges[OPS];
+    int run;
+    /* hide the "line too long" warnings */
+    int olderr = dup(2), devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, 2);
+    for(run=0;run<2000;run++) {
+	int num = myrand()%OPS;
+	int lead = myrand()%20;
+	random_edges(edges, num);
+	TAG*tag1 = swf_InsertTag(0, ST_DEFINESHAPE);
+	TAG*tag2 = swf_InsertTag(0, ST_DEFINESHAPE);
+	swf_SetBits(tag1, 0x5555, lead);
+	swf_SetBits(tag2, 0x5555, lead);
+	write_edges(tag1, edges, num);
+	swf_ShapeSetEdges(tag2, 0, edges, num);
+	swf_SetBits(tag1, 0x2a, 6);
+	swf_SetBits(tag2, 0x2a, 6);
+	assert(tag1->len == tag2->len);
+	assert(tag1->writeBit == tag2->writeBit);
+	assert(!memcmp(tag1->data, tag2->data, tag1->len));
+	swf_DeleteTag(0, tag1);
+	swf_DeleteTag(0, tag2);
+    }
+    dup2(olderr, 2);
+    close(devnull);
+    close(olderr);
+
+    /* the longest edge which isn't split (a curve with 17 bit values),
+       after 7 pending bits, needs 11 bytes. In a tag with room for only
+       10, the tag has to grow- or else the byte after memsize is gone. */
+    SHAPEEDGE e = {65535, -65536, 65535, -65536, 1};
+    TAG tag;
+    memset(&tag, 0, sizeof(tag));
+    tag.id = ST_DEFINESHAPE;
+    tag.memsize = 10;
+    tag.data = (U8*)malloc(tag.memsize+1);
+    tag.data[tag.memsize] = 0x5a;
+    swf_SetBits(&tag, 0x55, 7);
+    swf_ShapeSetEdges(&tag, 0, &e, 1);
+    assert(tag.memsize > 10 || tag.data[10] == 0x5a);
+    assert(tag.len == 11);
+    free(tag.data);
+    printf("shape edges: ok\n");
+}
+
+static double gettime()
+{
+    struct timeval t;
+    gettimeofday(&t, 0);
+    return t.tv_sec + t.tv_usec/1000000.0;
+}
+
+/* bit widths like the ones in shape records */
+#define BENCH_OPS 4096
+static void benchmark()
+{
+    op_t ops[BENCH_OPS];
+    int t, run, runs = 2000;
+    double t1, t2, t3;
+    for(t=0;t<BENCH_OPS;t++) {
+	ops[t].type = 0;
+	ops[t].nbits = 1 + myrand()%16;
+	ops[t].value = myrand();
+    }
+    TAG*tag = swf_InsertTag(0, ST_DEFINESHAPE);
+
+    t1 = gettime();
+    for(run=0;run<runs;run++) {
+	swf_ResetTag(tag, ST_DEFINESHAPE);
+	write_ops(tag, ops, BENCH_OPS, 1);
+    }
+    t2 = gettime();
+    for(run=0;run<runs;run++) {
+	swf_ResetTag(tag, ST_DEFINESHAPE);
+	write_ops(tag, ops, BENCH_OPS, 0);
+    }
+    t3 = gettime();
+    printf("SetBits: %6.1f Mbits/s (old: %6.1f Mbits/s)\n",
+	    tag->len*8.0*runs/(t3-t2)/1000000, tag->len*8.0*runs/(t2-t1)/1000000);
+
+    U32 sum1 = 0, sum2 = 0;
+    t1 = gettime();
+    for(run=0;run<runs;run++) {
+	tag->pos = 0; tag->readBit = 0;
+	for(t=0;t<BENCH_OPS;t++)
+	    sum1 += old_GetBits(tag, ops[t].nbits);
+    }
+    t2 = gettime();
+    for(run=0;run<runs;run++) {
+	tag->pos = 0; tag->readBit = 0;
+	for(t=0;t<BENCH_OPS;t++)
+	    sum2 += swf_GetBits(tag, ops[t].nbits);
+    }
+    t3 = gettime();
+    assert(sum1 == sum2);
+    printf("GetBits: %6.1f Mbits/s (old: %6.1f Mbits/s)\n",
+	    tag->len*8.0*runs/(t3-t2)/1000000, tag->len*8.0*runs/(t2-t1)/1000000);
+
+    SHAPEEDGE edges[BENCH_OPS];
+    for(t=0;t<BENCH_OPS;t++) {
+	edges[t].curve = myrand()&1;
+	edges[t].x = (int)(myrand()%2000) - 1000;
+	edges[t].y = (int)(myrand()%2000) - 1000;
+	edges[t].ax = edges[t].curve?(int)(myrand()%2000) - 1000:0;
+	edges[t].ay = edges[t].curve?(int)(myrand()%2000) - 1000:0;
+    }
+    t1 = gettime();
+    for(run=0;run<runs;run++) {
+	swf_ResetTag(tag, ST_DEFINESHAPE);
+	write_edges(tag, edges, BENCH_OPS);
+    }
+    t2 = gettime();
+    for(run=0;run<runs;run++) {
+	swf_ResetTag(tag, ST_DEFINESHAPE);
+	swf_ShapeSetEdges(tag, 0, edges, BENCH_OPS);
+    }
+    t3 = gettime();
+    printf("ShapeSetEdges: %6.1f Medges/s (single edges: %6.1f Medges/s)\n",
+	    BENCH_OPS*(double)runs/(t3-t2)/1000000, BENCH_OPS*(double)runs/(t2-t1)/1000000);
+    swf_DeleteTag(0, tag);
+}
+
+int main()
+{
+    test_roundtrip();
+    test_edges();
+    benchmark();
+    return 0;
+}
@@ -0,0 +1,207 @@
+/* stats.c
+
+   Part of the swftools package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <memory.h>
+#include <string.h>
+#include "../../config.h"
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+#include "../types.h"
+#include "../mem.h"
+#include "../gfxdevice.h"
+#include "../timer.h"
+#include "stats.h"
+
+const char*gfxdevice_stats_callnames[NUM_STATS_CALLS] = 
+    {"startpage", "startclip", "endclip", "stroke", "fill", "fillbitmap", "fillgradient", "addfont", "drawchar", "drawlink", "endpage"};
+
+typedef struct _internal {
+    gfxdevice_t*out;
+    gfxpagestats_t*pages;
+    int num_pages;
+    int size;
+
+    /* the page currently being rendered */
+    gfxpagestats_t current;
+    double last_end;
+    double start;
+    double timers[NUM_TIMERS];
+} internal_t;
+
+#define CALL(i, nr, call) {double _t = timer_now(); \
+                           call; \
+                           (i)->current.calls[nr]++; \
+                           (i)->current.calltime[nr] += timer_now() - _t;}
+
+/* anything the device does between two pages (e.g. addfont() calls
+   from gfxdocument_t.prepare()) counts towards the next page */
+static void start_interval(internal_t*i, double now)
+{
+    int t;
+    memset(&i->current, 0, sizeof(i->current));
+    i->last_end = now;
+    for(t=0;t<NUM_TIMERS;t++)
+	i->timers[t] = timer_get((timerid_t)t);
+}
+
+static long max_rss()
+{
+#ifdef HAVE_SYS_RESOURCE_H
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == 0)
+	return usage.ru_maxrss;
+#endif
+    return 0;
+}
+
+int stats_setparameter(struct _gfxdevice*dev, const char*key, const char*value)
+{
+    internal_t*i = (internal_t*)dev->internal;
+    return i->out->setparameter(i->out,key,value);
+}
+
+void stats_startpage(struct _gfxdevice*dev, int width, int height)
+{
+    internal_t*i = (internal_t*)dev->internal;
+    i->start = timer_now();
+    CALL(i, STATS_STARTPAGE, i->out->startpage(i->out,width,height));
+}
+
+void stats_startclip(struct _gfxdevice*dev, gfxline_t*line)
+{
+    internal_t*i = (internal_t*)dev->internal;
+    CALL(i, STATS_STARTCLIP, i->out->startclip(i->out,line));
+}
+
+void stats_endclip(struct _gfxdevice*dev)
+{
+    internal_t*i = (internal_t*)dev->internal;
+    CALL(i, STATS_ENDCLIP, i->out->endclip(i->out));
+}
+
+void stats_stroke(struct _gfxdevice*dev, gfxline_t*line, gfxcoord_t width, gfxcolor_t*color, gfx_capType cap_style, gfx_joinType joint_style, gfxcoord_t miterLimit)
+{
+    internal_t*i = (internal_t*)dev->internal;
+    CALL(i, STATS_STROKE, i->out->stroke(i->out, line, width, color, cap_style, joint_style, miterLimit));
+}
+
+void stats_fill(struct _gfxdevice*dev, gfxline_t*line, gfxcolor_t*color)
+{
+    internal_t*i = (internal_t*)dev->internal;
+    CALL(i, STATS_FILL, i->out->fill(i->out, line, color));
+}
+
+void stats_fillbitmap(struct _gfxdevice*dev, gfxline_t*line, gfximage_t*img, gfxmatrix_t*matrix, gfxcxform_t*cxform)
+{
+    internal_t*i = (internal_t*)dev->internal;
+    CALL(i, STATS_FILLBITMAP, i->out->fillbitmap(i->out, line, img, matrix, cxform));
+}
+
+void stats_fillgradient(struct _gfxdevice*dev, gfxline_t*line, gfxgradient_t*gradient, gfxgradienttype_t type, gfxmatrix_t*matrix)
+{
+    internal_t*i = (internal_t*)dev->internal;
+    CALL(i, STATS_FILLGRADIENT, i->out->fillgradient(i->out, line, gradient, type, matrix));
+}
+
+void stats_addfont(struct _gfxdevice*dev, gfxfont_t*font)
+{
+    internal_t*i = (internal_t*)dev->internal;
+    CALL(i, STATS_ADDFONT, i->out->addfont(i->out, font));
+}
+
+void stats_drawchar(struct _gfxdevice*dev, gfxfont_t*font, int glyphnr, gfxcolor_t*color, gfxmatrix_t*matrix)
+{
+    internal_t*i = (internal_t*)dev->internal;
+    CALL(i, STATS_DRAWCHAR, i->out->drawchar(i->out, font, glyphnr, color, matrix));
+}
+
+void stats_drawlink(struct _gfxdevice*dev, gfxline_t*line, const char*action, const char*text)
+{
+    internal_t*i = (internal_t*)dev->internal;
+    CALL(i, STATS_DRAWLINK, i->out->drawlink(i->out, line, action, text));
+}
+
+void stats_endpage(struct _gfxdevice*dev)
+{
+    internal_t*i = (internal_t*)dev->internal;
+    CALL(i, STATS_ENDPAGE, i->out->endpage(i->out));
+
+    double now = timer_now();
+    int t;
+    i->current.time = now - i->last_end;
+    i->current.render = now - i->start;
+    for(t=0;t<NUM_TIMERS;t++)
+	i->current.timers[t] = timer_get((timerid_t)t) - i->timers[t];
+    i->current.maxrss = max_rss();
+
+    if(i->num_pages == i->size) {
+	i->size = i->size?i->size*2:16;
+	i->pages = (gfxpagestats_t*)rfx_realloc(i->pages, i->size*sizeof(gfxpagestats_t));
+    }
+    i->pages[i->num_pages++] = i->current;
+    start_interval(i, now);
+}
+
+gfxresult_t* stats_finish(struct _gfxdevice*dev)
+{
+    internal_t*i = (internal_t*)dev->internal;
+    gfxdevice_t*out = i->out;
+    if(i->pages)
+	rfx_free(i->pages);
+    rfx_free(dev->internal);dev->internal = 0;i=0;
+    return out->finish(out);
+}
+
+gfxpagestats_t* gfxdevice_stats_getpages(gfxdevice_t*dev, int*num_pages)
+{
+    internal_t*i = (internal_t*)dev->internal;
+    *num_pages = i->num_pages;
+    return i->pages;
+}
+
+void gfxdevice_stats_init(gfxdevice_t*dev, gfxdevice_t*out)
+{
+    internal_t*i = (internal_t*)rfx_calloc(sizeof(internal_t));
+    memset(dev, 0, sizeof(gfxdevice_t));
+
+    dev->name = "stats";
+
+    dev->internal = i;
+
+    dev->setparameter = stats_setparameter;
+    dev->startpage = stats_startpage;
+    dev->startclip = stats_startclip;
+    dev->endclip = stats_endclip;
+    dev->stroke = stats_stroke;
+    dev->fill = stats_fill;
+    dev->fillbitmap = stats_fillbitmap;
+    dev->fillgradient = stats_fillgradient;
+    dev->addfont = stats_addfont;
+    dev->drawchar = stats_drawchar;
+    dev->drawlink = stats_drawlink;
+    dev->endpage = stats_endpage;
+    dev->finish = stats_finish;
+
+    i->out = out;
+    timers_enable(1);
+    start_interval(i, timer_now());
+}
@@ -0,0 +1,67 @@
+/* stats.h
+
+   Part of the swftools package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef __gfxdevice_stats_h__
+#define __gfxdevice_stats_h__
+
+#include "../gfxdevice.h"
+#include "../timer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    STATS_STARTPAGE,
+    STATS_STARTCLIP,
+    STATS_ENDCLIP,
+    STATS_STROKE,
+    STATS_FILL,
+    STATS_FILLBITMAP,
+    STATS_FILLGRADIENT,
+    STATS_ADDFONT,
+    STATS_DRAWCHAR,
+    STATS_DRAWLINK,
+    STATS_ENDPAGE,
+    NUM_STATS_CALLS
+} statscall_t;
+
+extern const char*gfxdevice_stats_callnames[NUM_STATS_CALLS];
+
+typedef struct _gfxpagestats {
+    double time;                   /* since the end of the previous page */
+    double render;                 /* between startpage() and endpage() */
+    int calls[NUM_STATS_CALLS];
+    double calltime[NUM_STATS_CALLS]; /* inside the output device */
+    double timers[NUM_TIMERS];     /* see timer.h */
+    long maxrss;                   /* peak resident set size so far, in kB */
+} gfxpagestats_t;
+
+/* a device which passes everything on to out, and records for every page
+   how much time was spent in the callbacks of out. Enables the timers
+   from timer.h. */
+void gfxdevice_stats_init(gfxdevice_t*self, gfxdevice_t*out);
+
+/* the pages finished so far (valid until finish()) */
+gfxpagestats_t* gfxdevice_stats_getpages(gfxdevice_t*self, int*num_pages);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__gfxdevice_stats_h__
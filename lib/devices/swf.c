@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include "../../config.h"
 #include <fcntl.h>
 #ifdef HAVE_UNISTD_H
@@ -35,6 +36,9 @@
 #define assert(a)
 #endif
 #include <math.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 #include "../mem.h"
 #include "../log.h"
 #include "../rfxswf.h"
@@ -73,6 +77,7 @@ typedef struct _charbuffer {
 typedef struct _fontlist
 {
     SWFFONT *swffont;
+    char defined; // DEFINEFONT tag was already written to the output stream
     struct _fontlist*next;
 } fontlist_t;
 
@@ -107,6 +112,7 @@ typedef struct _swfoutput_internal
     int config_noclips;
     int config_flashversion;
     int config_reordertags;
+    int config_optimize;
     int config_showclipshapes;
     int config_splinemaxerror;
     int config_fontsplinemaxerror;
@@ -129,9 +135,14 @@ typedef struct _swfoutput_internal
     char*config_externallinkfunction;
     char config_animate;
     double config_framerate;
+    char* config_stream;
 
     SWF* swf;
 
+    struct _swfstream* stream;
+    char stream_error; // the output file couldn't be created or written
+    char keepfonts; // finalize without reducing the fonts (for gfxdevice_swf_fragment)
+
     fontlist_t* fontlist;
 
     char storefont;
@@ -157,6 +168,10 @@ typedef struct _swfoutput_internal
     int swflasty;
     int lastwasfill;
     int shapeisempty;
+    SHAPEEDGE*edges; // edges collected by drawgfxline, written with swf_ShapeSetEdges
+    int numedges;
+    int edgessize;
+    char batchedges;
     char fill;
     int min_x,max_x;
     int min_y,max_y;
@@ -232,6 +247,7 @@ static void swfoutput_linktopage(gfxdevice_t*dev, int page, gfxline_t*points);
 static void swfoutput_linktourl(gfxdevice_t*dev, const char*url, gfxline_t*points);
 
 static gfxresult_t* swf_finish(gfxdevice_t*driver);
+static void swfstream_flushframe(gfxdevice_t*dev);
 
 static swfoutput_internal* init_internal_struct()
 {
@@ -434,6 +450,32 @@ static void addPointToBBox(gfxdevice_t*dev, int px, int py)
     addPointToBBox(dev, x+width ,y+width);
 }*/
 
+static void flushedges(gfxdevice_t*dev, TAG*tag)
+{
+    swfoutput_internal*i = (swfoutput_internal*)dev->internal;
+    if(i->numedges) {
+	swf_ShapeSetEdges(tag, i->shape, i->edges, i->numedges);
+	i->numedges = 0;
+    }
+}
+static void addedge(gfxdevice_t*dev, TAG*tag, int x, int y, int ax, int ay, char curve)
+{
+    swfoutput_internal*i = (swfoutput_internal*)dev->internal;
+    if(!i->batchedges) {
+	if(curve) swf_ShapeSetCurve(tag, i->shape, x,y,ax,ay);
+	else      swf_ShapeSetLine(tag, i->shape, x,y);
+	return;
+    }
+    if(i->numedges == i->edgessize) {
+	i->edgessize = i->edgessize?i->edgessize*2:256;
+	i->edges = (SHAPEEDGE*)rfx_realloc(i->edges, i->edgessize*sizeof(SHAPEEDGE));
+    }
+    SHAPEEDGE*e = &i->edges[i->numedges++];
+    e->x = x;e->y = y;
+    e->ax = ax;e->ay = ay;
+    e->curve = curve;
+}
+
 // write a line-to command into the swf
 static void linetoxy(gfxdevice_t*dev, TAG*tag, plotxy_t p0)
 {
@@ -443,7 +485,7 @@ static void linetoxy(gfxdevice_t*dev, TAG*tag, plotxy_t p0)
     int rx = (px-i->swflastx);
     int ry = (py-i->swflasty);
     if(rx|ry) {
-	swf_ShapeSetLine (tag, i->shape, rx,ry);
+	addedge(dev, tag, rx,ry, 0,0, 0);
 	addPointToBBox(dev, i->swflastx,i->swflasty);
 	addPointToBBox(dev, px,py);
     } /* this is a nice idea, but doesn't work with current flash
@@ -487,12 +529,12 @@ static void splineto(gfxdevice_t*dev, TAG*tag, plotxy_t control,plotxy_t end)
     i->swflasty += ey;
     
     if((cx || cy) && (ex || ey)) {
-        swf_ShapeSetCurve(tag, i->shape, cx,cy,ex,ey);
+        addedge(dev, tag, cx,cy,ex,ey, 1);
         addPointToBBox(dev, lastlastx   ,lastlasty   );
         addPointToBBox(dev, lastlastx+cx,lastlasty+cy);
         addPointToBBox(dev, lastlastx+cx+ex,lastlasty+cy+ey);
     } else if(cx || cy || ex || ey) {
-        swf_ShapeSetLine(tag, i->shape, cx+ex,cy+ey);
+        addedge(dev, tag, cx+ex,cy+ey, 0,0, 0);
         addPointToBBox(dev, lastlastx   ,lastlasty   );
         addPointToBBox(dev, lastlastx+cx,lastlasty+cy);
         addPointToBBox(dev, lastlastx+cx+ex,lastlasty+cy+ey);
@@ -1141,6 +1183,9 @@ void swf_endframe(gfxdevice_t*dev)
 	}
 	i->currentswfid = i->startids;
     }
+
+    if(i->config_stream)
+	swfstream_flushframe(dev);
 }
 
 static void setBackground(gfxdevice_t*dev, int x1, int y1, int x2, int y2)
@@ -1175,6 +1220,30 @@ static void setBackground(gfxdevice_t*dev, int x1, int y1, int x2, int y2)
     swf_ObjectPlaceClip(i->tag,shapeid,getNewDepth(dev),0,0,0,65535);
 }
 
+static void swfoutput_newswf(swfoutput_internal*i)
+{
+    i->swf = (SWF*)rfx_calloc(sizeof(SWF));
+    i->swf->fileVersion    = 0;
+    i->swf->frameRate      = 0x80;
+    i->swf->movieSize.xmin = 0;
+    i->swf->movieSize.ymin = 0;
+    i->swf->movieSize.xmax = 0;
+    i->swf->movieSize.ymax = 0;
+
+    if(i->config_local_with_filesystem) {
+        i->swf->fileAttributes = 8; // as3, local-with-filesystem
+    } else {
+        i->swf->fileAttributes = 9; // as3, local-with-network
+    }
+
+    i->swf->firstTag = swf_InsertTag(NULL,ST_SETBACKGROUNDCOLOR);
+    i->tag = i->swf->firstTag;
+    RGBA rgb;
+    rgb.a = rgb.r = rgb.g = rgb.b = 0xff;
+    //rgb.r = 0;
+    swf_SetRGB(i->tag,&rgb);
+}
+
 /* initialize the swf writer */
 void gfxdevice_swf_init(gfxdevice_t* dev)
 {
@@ -1205,26 +1274,7 @@ void gfxdevice_swf_init(gfxdevice_t* dev)
 
     i->swffont = 0;
    
-    i->swf = (SWF*)rfx_calloc(sizeof(SWF));
-    i->swf->fileVersion    = 0;
-    i->swf->frameRate      = 0x80;
-    i->swf->movieSize.xmin = 0;
-    i->swf->movieSize.ymin = 0;
-    i->swf->movieSize.xmax = 0;
-    i->swf->movieSize.ymax = 0;
-
-    if(i->config_local_with_filesystem) {
-        i->swf->fileAttributes = 8; // as3, local-with-filesystem
-    } else {
-        i->swf->fileAttributes = 9; // as3, local-with-network
-    }
-
-    i->swf->firstTag = swf_InsertTag(NULL,ST_SETBACKGROUNDCOLOR);
-    i->tag = i->swf->firstTag;
-    RGBA rgb;
-    rgb.a = rgb.r = rgb.g = rgb.b = 0xff;
-    //rgb.r = 0;
-    swf_SetRGB(i->tag,&rgb);
+    swfoutput_newswf(i);
 
     i->startdepth = i->depth = 0;
     i->startids = i->currentswfid = 0;
@@ -1429,6 +1479,273 @@ static void endshape(gfxdevice_t*dev)
     i->shapeposy=0;
 }
 
+/* ------------------------- streaming output ------------------------- */
+
+/* With "stream=<filename>", the tags of every finished page are written
+   to the output file (and freed) in swf_endframe(), instead of keeping the
+   whole movie in memory until swfresult_save().
+   Things we only know at the end (file size, movie size and frame count)
+   are written as placeholders and backpatched in swfstream_close(). The
+   movie size rectangle is therefore always stored with 31 bit fields.
+   For compressed files, the header is put into an uncompressed ("stored")
+   deflate block in front of the deflated tags, so that it can be patched,
+   too. The adler32 checksum of the zlib stream is combined from the
+   checksums of both parts. */
+
+#define STREAM_HEADER_LEN 21 // 17 byte rectangle, frame rate, frame count
+
+typedef struct _swfstream
+{
+    int fi;
+    char compressed;
+    int headerpos; // file position of the movie header (rectangle, rate, frames)
+    U32 size; // uncompressed file size
+    int frames;
+    char error; // a write failed
+    writer_t writer;
+#ifdef HAVE_ZLIB
+    z_stream zs;
+    uLong adler;
+    unsigned char buffer[16384];
+#endif
+} swfstream_t;
+
+static void swfstream_header(SWF*swf, int frames, U8*data)
+{
+    TAG tag, *t = &tag;
+    memset(t, 0, sizeof(TAG));
+    t->data = data;
+    t->memsize = 64;
+    swf_ResetWriteBits(t);
+    swf_SetBits(t, 31, 5);
+    swf_SetBits(t, swf->movieSize.xmin, 31);
+    swf_SetBits(t, swf->movieSize.xmax, 31);
+    swf_SetBits(t, swf->movieSize.ymin, 31);
+    swf_SetBits(t, swf->movieSize.ymax, 31);
+    swf_SetU16(t, swf->frameRate);
+    swf_SetU16(t, frames);
+    assert(t->len == STREAM_HEADER_LEN);
+}
+
+/* write to the file, and remember if that failed. After the first
+   error, nothing is written anymore. */
+static void swfstream_out(swfstream_t*s, const void*data, int len)
+{
+    if(s->error || !len)
+	return;
+    if(write(s->fi, data, len) != len) {
+	msg("<error> Couldn't write to the output file: %s", strerror(errno));
+	s->error = 1;
+    }
+}
+
+static int swfstream_write(writer_t*w, void*data, int len)
+{
+    swfstream_t*s = (swfstream_t*)w->internal;
+    if(s->error)
+	return -1;
+    s->size += len;
+    w->pos += len;
+#ifdef HAVE_ZLIB
+    if(s->compressed) {
+	s->adler = adler32(s->adler, (Bytef*)data, len);
+	s->zs.next_in = (Bytef*)data;
+	s->zs.avail_in = len;
+	while(s->zs.avail_in) {
+	    s->zs.next_out = s->buffer;
+	    s->zs.avail_out = sizeof(s->buffer);
+	    deflate(&s->zs, Z_NO_FLUSH);
+	    swfstream_out(s, s->buffer, s->zs.next_out - s->buffer);
+	}
+    } else
+#endif
+    swfstream_out(s, data, len);
+    return s->error?-1:len;
+}
+
+static swfstream_t* swfstream_open(const char*filename, SWF*swf)
+{
+    U8 head[16];
+    U8 header[64];
+    int pos = 8;
+    int fi = open(filename, O_BINARY|O_CREAT|O_TRUNC|O_WRONLY, 0777);
+    if(fi<0) {
+	msg("<error> Could not create \"%s\": %s", FIXNULL(filename), strerror(errno));
+	return 0;
+    }
+    swfstream_t*s = (swfstream_t*)rfx_calloc(sizeof(swfstream_t));
+    s->fi = fi;
+#ifdef HAVE_ZLIB
+    s->compressed = swf->compressed;
+#else
+    if(swf->compressed)
+	msg("<warning> No zlib support- writing uncompressed SWF");
+#endif
+    memcpy(head, s->compressed?"CWS":"FWS", 3);
+    head[3] = swf->fileVersion;
+    memset(&head[4], 0, 4); // file size
+    if(s->compressed) {
+	head[pos++] = 0x78; // zlib header: deflate, 32k window
+	head[pos++] = 0x01;
+	head[pos++] = 0x00; // stored block
+	head[pos++] = STREAM_HEADER_LEN;
+	head[pos++] = 0;
+	head[pos++] = ~STREAM_HEADER_LEN;
+	head[pos++] = 0xff;
+    }
+    s->headerpos = pos;
+    swfstream_out(s, head, pos);
+    swfstream_header(swf, 0, header);
+    swfstream_out(s, header, STREAM_HEADER_LEN);
+    s->size = 8 + STREAM_HEADER_LEN;
+
+#ifdef HAVE_ZLIB
+    if(s->compressed) {
+	memset(&s->zs, 0, sizeof(z_stream));
+	deflateInit2(&s->zs, 9, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+	s->adler = adler32(0L, Z_NULL, 0);
+    }
+#endif
+    memset(&s->writer, 0, sizeof(writer_t));
+    s->writer.write = swfstream_write;
+    s->writer.internal = s;
+    s->writer.type = s->compressed?WRITER_TYPE_ZLIB:WRITER_TYPE_FILE;
+
+    if(swf->fileVersion >= 9) {
+	TAG*fileattrib = swf_InsertTag(0, ST_FILEATTRIBUTES);
+	swf_SetU32(fileattrib, swf->fileAttributes|FILEATTRIBUTE_AS3);
+	swf_WriteTag2(&s->writer, fileattrib);
+	swf_DeleteTag(0, fileattrib);
+    }
+    return s;
+}
+
+/* returns -1 if anything couldn't be written */
+static int swfstream_close(swfstream_t*s, SWF*swf)
+{
+    U8 header[64];
+    U8 b[4];
+    swfstream_header(swf, s->frames, header);
+#ifdef HAVE_ZLIB
+    if(s->compressed) {
+	int ret;
+	s->zs.next_in = 0;
+	s->zs.avail_in = 0;
+	do {
+	    s->zs.next_out = s->buffer;
+	    s->zs.avail_out = sizeof(s->buffer);
+	    ret = deflate(&s->zs, Z_FINISH);
+	    swfstream_out(s, s->buffer, s->zs.next_out - s->buffer);
+	} while(ret == Z_OK);
+	deflateEnd(&s->zs);
+
+	uLong adler = adler32(0L, Z_NULL, 0);
+	adler = adler32(adler, header, STREAM_HEADER_LEN);
+	adler = adler32_combine(adler, s->adler, s->size - 8 - STREAM_HEADER_LEN);
+	b[0] = adler>>24; b[1] = adler>>16; b[2] = adler>>8; b[3] = adler;
+	swfstream_out(s, b, 4);
+    }
+#endif
+    swf->fileSize = s->size;
+    swf->frameCount = s->frames;
+    b[0] = s->size; b[1] = s->size>>8; b[2] = s->size>>16; b[3] = s->size>>24;
+    lseek(s->fi, 4, SEEK_SET);
+    swfstream_out(s, b, 4);
+    lseek(s->fi, s->headerpos, SEEK_SET);
+    swfstream_out(s, header, STREAM_HEADER_LEN);
+    if(close(s->fi) < 0 && !s->error) {
+	msg("<error> Couldn't write to the output file: %s", strerror(errno));
+	s->error = 1;
+    }
+    int ret = s->error?-1:0;
+    free(s);
+    return ret;
+}
+
+/* write out all tags up to (and excluding) "end", and free them. If the
+   output file couldn't be opened or written, the tags are only freed. */
+static void swfstream_writetags(gfxdevice_t*dev, TAG*end)
+{
+    swfoutput_internal*i = (swfoutput_internal*)dev->internal;
+    swfstream_t*s = i->stream;
+    if(!s || s->error) {
+	TAG*tag = i->swf->firstTag;
+	while(tag != end)
+	    tag = swf_DeleteTag(i->swf, tag);
+	return;
+    }
+    char use_font3 = i->config_flashversion>=8 && !NO_FONT3;
+    TAG*tag = i->swf->firstTag;
+    while(tag != end) {
+	if(tag->id != ST_SETBACKGROUNDCOLOR) {
+	    /* fonts need to be defined before the first page that uses them.
+	       We don't know which characters later pages will need, so they
+	       are stored completely (as with storeallcharacters) */
+	    fontlist_t*l = i->fontlist;
+	    for(;l;l=l->next) {
+		if(!l->defined && l->swffont->use && l->swffont->use->used_glyphs) {
+		    TAG*ftag = swf_InsertTag(0, use_font3?ST_DEFINEFONT3:ST_DEFINEFONT2);
+		    swf_FontSetDefine2(ftag, l->swffont);
+		    swf_WriteTag2(&s->writer, ftag);
+		    swf_DeleteTag(0, ftag);
+		    l->defined = 1;
+		}
+	    }
+	}
+	if(tag->id == ST_SHOWFRAME)
+	    s->frames++;
+	swf_WriteTag2(&s->writer, tag);
+	tag = swf_DeleteTag(i->swf, tag);
+    }
+}
+
+static void swfstream_start(gfxdevice_t*dev)
+{
+    swfoutput_internal*i = (swfoutput_internal*)dev->internal;
+    i->swf->fileVersion = i->config_flashversion;
+    i->swf->frameRate = i->config_framerate*0x100;
+    i->swf->compressed = i->config_enablezlib || i->config_flashversion>=6;
+    if(i->config_bboxvars)
+	msg("<warning> bboxvars is not supported in streaming mode");
+    i->stream = swfstream_open(i->config_stream, i->swf);
+    if(!i->stream)
+	i->stream_error = 1;
+}
+
+/* called at the end of every page. Everything before the last ST_SHOWFRAME
+   is written; the SHOWFRAME itself and the following REMOVEOBJECT2 tags 
+   stay, so that swfoutput_finalize() can still remove the latter. */
+static void swfstream_flushframe(gfxdevice_t*dev)
+{
+    swfoutput_internal*i = (swfoutput_internal*)dev->internal;
+    TAG*last = i->tag;
+    while(last && last->id != ST_SHOWFRAME)
+	last = last->prev;
+    if(!last)
+	return;
+    if(!i->stream && !i->stream_error)
+	swfstream_start(dev);
+    swfstream_writetags(dev, last);
+}
+
+static void swfstream_finish(gfxdevice_t*dev)
+{
+    swfoutput_internal*i = (swfoutput_internal*)dev->internal;
+    if(!i->stream && !i->stream_error)
+	swfstream_start(dev);
+    if(i->config_flashversion>=9 && i->hasbuttons && !i->config_linknameurl)
+	msg("<warning> Links are not supported in streaming mode with flash version 9 and above");
+    /* the END tag stays in the tag list, as a marker that we're done */
+    swfstream_writetags(dev, i->tag);
+    if(!i->stream)
+	return;
+    if(!i->stream->error)
+	swf_WriteTag2(&i->stream->writer, i->tag);
+    if(swfstream_close(i->stream, i->swf) < 0)
+	i->stream_error = 1;
+    i->stream = 0;
+}
+
 void wipeSWF(SWF*swf)
 {
     TAG*tag = swf->firstTag;
@@ -1444,6 +1761,24 @@ void wipeSWF(SWF*swf)
     }
 }
 
+/* a shallow copy of the font, without the shapes of the glyphs that
+   weren't used. Unlike swf_FontReduce(), this leaves the font intact. */
+static SWFFONT* font_reducedcopy(SWFFONT*font)
+{
+    SWFFONT*f = (SWFFONT*)rfx_alloc(sizeof(SWFFONT));
+    int t;
+    memcpy(f, font, sizeof(SWFFONT));
+    f->glyph = (SWFGLYPH*)rfx_calloc(sizeof(SWFGLYPH)*font->numchars);
+    f->numchars = 0;
+    for(t=0;t<font->numchars;t++) {
+	if(font->use->chars[t]) {
+	    f->glyph[t] = font->glyph[t];
+	    f->numchars = t+1;
+	}
+    }
+    return f;
+}
+
 void swfoutput_finalize(gfxdevice_t*dev)
 {
     swfoutput_internal*i = (swfoutput_internal*)dev->internal;
@@ -1454,7 +1789,7 @@ void swfoutput_finalize(gfxdevice_t*dev)
     i->swf->fileVersion = i->config_flashversion;
     i->swf->frameRate = i->config_framerate*0x100;
 
-    if(i->config_bboxvars) {
+    if(i->config_bboxvars && !i->config_stream) {
 	TAG* tag = swf_InsertTag(i->swf->firstTag, ST_DOACTION);
 	ActionTAG*a = 0;
 	a = action_PushString(a, "xmin");
@@ -1488,23 +1823,34 @@ void swfoutput_finalize(gfxdevice_t*dev)
     fontlist_t *iterator = i->fontlist;
     char use_font3 = i->config_flashversion>=8 && !NO_FONT3;
 
-    while(iterator) {
+    while(iterator && !i->config_stream) {
 	TAG*mtag = i->swf->firstTag;
 	if(iterator->swffont) {
-	    if(!i->config_storeallcharacters) {
-		msg("<debug> Reducing font %s", iterator->swffont->name);
-		swf_FontReduce(iterator->swffont);
+	    SWFFONT*font = iterator->swffont;
+	    int used = font->use && font->use->used_glyphs;
+	    if(i->keepfonts) {
+		/* the following fragments still need the complete font */
+		if(used && !i->config_storeallcharacters)
+		    font = font_reducedcopy(font);
+	    } else if(!i->config_storeallcharacters) {
+		msg("<debug> Reducing font %s", font->name);
+		swf_FontReduce(font);
 	    }
-	    int used = iterator->swffont->use && iterator->swffont->use->used_glyphs;
 	    if(used) {
 		if(!use_font3) {
 		    mtag = swf_InsertTag(mtag, ST_DEFINEFONT2);
-		    swf_FontSetDefine2(mtag, iterator->swffont);
+		    swf_FontSetDefine2(mtag, font);
 		} else {
 		    mtag = swf_InsertTag(mtag, ST_DEFINEFONT3);
-		    swf_FontSetDefine2(mtag, iterator->swffont);
+		    swf_FontSetDefine2(mtag, font);
 		}
 	    }
+	    if(font != iterator->swffont) {
+		rfx_free(font->glyph);
+		rfx_free(font);
+	    }
+	    if(i->keepfonts)
+		swf_FontClearUsage(iterator->swffont);
 	}
 
         iterator = iterator->next;
@@ -1524,6 +1870,11 @@ void swfoutput_finalize(gfxdevice_t*dev)
         swf_DeleteTag(i->swf, tag);
         tag = prev;
     }
+
+    if(i->config_stream) {
+	swfstream_finish(dev);
+	return;
+    }
     
     if(i->overflow) {
 	wipeSWF(i->swf);
@@ -1540,6 +1891,10 @@ void swfoutput_finalize(gfxdevice_t*dev)
     }
 //    if(i->config_reordertags)
 //	swf_Optimize(i->swf);
+    if(i->config_optimize && !i->config_stream) {
+	int saved = swf_Optimize(i->swf);
+	msg("<notice> Merging duplicate shapes and bitmaps saved %d bytes", saved);
+    }
 }
 
 int swfresult_save(gfxresult_t*gfx, const char*filename)
@@ -1563,6 +1918,15 @@ int swfresult_save(gfxresult_t*gfx, const char*filename)
      close(fi);
     return 0;
 }
+/* in streaming mode, the file was already written by swfstream_close() */
+static int swfresult_save_streamed(gfxresult_t*gfx, const char*filename)
+{
+    return 0;
+}
+static int swfresult_save_streamfailed(gfxresult_t*gfx, const char*filename)
+{
+    return -1;
+}
 void* swfresult_get(gfxresult_t*gfx, const char*name)
 {
     SWF*swf = (SWF*)gfx->internal;
@@ -1594,6 +1958,17 @@ void swfresult_destroy(gfxresult_t*gfx)
     free(gfx);
 }
 
+static gfxresult_t* swfresult_new(SWF*swf)
+{
+    gfxresult_t*result = (gfxresult_t*)rfx_calloc(sizeof(gfxresult_t));
+    result->internal = swf;
+    result->save = swfresult_save;
+    result->write = 0;
+    result->get = swfresult_get;
+    result->destroy = swfresult_destroy;
+    return result;
+}
+
 static void swfoutput_destroy(gfxdevice_t* dev);
 
 gfxresult_t* swf_finish(gfxdevice_t* dev)
@@ -1608,17 +1983,67 @@ gfxresult_t* swf_finish(gfxdevice_t* dev)
 
     swfoutput_finalize(dev);
     SWF* swf = i->swf;i->swf = 0;
+    char streamed = i->config_stream!=0;
+    char stream_error = i->stream_error;
+    if(i->config_stream) {
+	free(i->config_stream);
+	i->config_stream = 0;
+    }
     swfoutput_destroy(dev);
 
-    result = (gfxresult_t*)rfx_calloc(sizeof(gfxresult_t));
-    result->internal = swf;
-    result->save = swfresult_save;
-    result->write = 0;
-    result->get = swfresult_get;
-    result->destroy = swfresult_destroy;
+    result = swfresult_new(swf);
+    if(streamed)
+	result->save = stream_error?swfresult_save_streamfailed:swfresult_save_streamed;
     return result;
 }
 
+/* finishes the pages drawn so far into a SWF of their own, and starts
+   over with an empty one. Unlike finish(), this keeps the device alive,
+   together with the fonts, which are expensive to convert. */
+gfxresult_t* gfxdevice_swf_fragment(gfxdevice_t* dev)
+{
+    swfoutput_internal*i = (swfoutput_internal*)dev->internal;
+    fontlist_t*l;
+    int maxid = i->startids;
+
+    if(i->config_stream) {
+	msg("<error> Can't split the SWF into fragments in streaming mode");
+	return 0;
+    }
+
+    i->keepfonts = 1;
+    swfoutput_finalize(dev);
+    i->keepfonts = 0;
+    SWF* swf = i->swf;
+
+    swfoutput_newswf(i);
+    /* we keep the ids of the fonts, everything else is new */
+    for(l=i->fontlist;l;l=l->next) {
+	if(l->swffont->id > maxid)
+	    maxid = l->swffont->id;
+    }
+    i->currentswfid = maxid;
+    i->depth = i->startdepth;
+    i->frameno = i->lastframeno = 0;
+    i->firstpage = 1;
+    i->hasbuttons = 0;
+    i->overflow = 0;
+    /* the drawing state starts over, too, like in a new device, so that
+       a page's fragment doesn't depend on the pages before it */
+    i->swffont = 0;
+    i->lastfontm11 = i->lastfontm12 = i->lastfontm21 = i->lastfontm22 = 0;
+    i->current_font_size = 0;
+    i->linewidth = 0;
+    memset(&i->strokergb, 0, sizeof(RGBA));
+    memset(&i->fillrgb, 0, sizeof(RGBA));
+    i->swflastx = i->swflasty = 0;
+    i->lastwasfill = 0;
+    i->fill = 0;
+    i->fillstylechanged = 0;
+
+    return swfresult_new(swf);
+}
+
 /* Perform cleaning up */
 static void swfoutput_destroy(gfxdevice_t* dev) 
 {
@@ -1638,6 +2063,7 @@ static void swfoutput_destroy(gfxdevice_t* dev)
         free(tmp);
     }
     if(i->swf) {swf_FreeTags(i->swf);free(i->swf);i->swf = 0;}
+    if(i->edges) {rfx_free(i->edges);i->edges = 0;}
 
     free(i);i=0;
     memset(dev, 0, sizeof(gfxdevice_t));
@@ -1837,12 +2263,14 @@ static void drawgfxline(gfxdevice_t*dev, gfxline_t*line, int fill)
     int lines= 0, splines=0;
 
     i->fill = fill;
+    i->batchedges = 1;
 
     while(1) {
 	if(!line)
 	    break;
 	/* check whether the next segment is zero */
 	if(line->type == gfx_moveTo) {
+	    flushedges(dev, i->tag);
 	    moveto(dev, i->tag, line->x, line->y);
 	    px = lastx = line->x;
 	    py = lasty = line->y;
@@ -1865,6 +2293,8 @@ static void drawgfxline(gfxdevice_t*dev, gfxline_t*line, int fill)
 	}
 	line = line->next;
     }
+    flushedges(dev, i->tag);
+    i->batchedges = 0;
     msg("<trace> drawgfxline, %d lines, %d splines", lines, splines);
 }
 
@@ -2100,6 +2530,8 @@ int swf_setparameter(gfxdevice_t*dev, const char*name, const char*value)
 	i->config_showclipshapes = atoi(value);
     } else if(!strcmp(name, "reordertags")) {
 	i->config_reordertags = atoi(value);
+    } else if(!strcmp(name, "optimize")) {
+	i->config_optimize = atoi(value);
     } else if(!strcmp(name, "internallinkfunction")) {
 	i->config_internallinkfunction = strdup(value);
     } else if(!strcmp(name, "externallinkfunction")) {
@@ -2138,6 +2570,10 @@ int swf_setparameter(gfxdevice_t*dev, const char*name, const char*value)
 	i->config_caplinewidth = atof(value);
     } else if(!strcmp(name, "linktarget")) {
 	i->config_linktarget = strdup(value);
+    } else if(!strcmp(name, "stream")) {
+	if(i->config_stream)
+	    free(i->config_stream);
+	i->config_stream = strdup(value);
     } else if(!strcmp(name, "invisibletexttofront")) {
 	i->config_invisibletexttofront = atoi(value);
     } else if(!strcmp(name, "noclips")) {
@@ -2200,6 +2636,7 @@ int swf_setparameter(gfxdevice_t*dev, const char*name, const char*value)
         printf("bboxvars                    store the bounding box of the SWF file in actionscript variables\n");
         printf("dots                        Take care to handle dots correctly\n");
         printf("reordertags=0/1             (default: 1) perform some tag optimizations\n");
+        printf("optimize=0/1                (default: 0) merge shapes which only differ by position, and identical bitmaps\n");
         printf("internallinkfunction=<name> when the user clicks a internal link (to a different page) in the converted file, this actionscript function is called\n");
         printf("externallinkfunction=<name> when the user clicks an external link (e.g. http://www.foo.bar/) on the converted file, this actionscript function is called\n");
         printf("disable_polygon_conversion  never convert strokes to polygons (will remove capstyles and joint styles)\n");
@@ -2212,6 +2649,8 @@ int swf_setparameter(gfxdevice_t*dev, const char*name, const char*value)
         printf("simpleviewer                Add next/previous buttons to the SWF\n");
         printf("animate                     insert a showframe tag after each placeobject (animate draw order of PDF files)\n");
         printf("jpegquality=<quality>       set compression quality of jpeg images\n");
+        printf("stream=<filename>           write each page to <filename> as soon as it's finished, instead of keeping\n");
+        printf("                            the whole SWF in memory (fonts are stored completely)\n");
 	printf("splinequality=<value>       Set the quality of spline convertion to value (0-100, default: 100).\n");
 	printf("disablelinks                Disable links.\n");
     } else {
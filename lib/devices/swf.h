@@ -30,6 +30,10 @@ extern "C" {
 
 void gfxdevice_swf_init(gfxdevice_t*);
 
+/* returns the pages drawn since the last call as a standalone SWF. The
+   device stays usable for more pages. */
+gfxresult_t* gfxdevice_swf_fragment(gfxdevice_t*);
+
 #ifdef __cplusplus
 }
 #endif
@@ -5,6 +5,7 @@
 #include <time.h>
 #include "../mem.h"
 #include "../types.h"
+#include "../timer.h"
 #include "poly.h"
 #include "active.h"
 #include "xrow.h"
@@ -1503,6 +1504,7 @@ static void check_status(status_t*status)
 
 gfxpoly_t* gfxpoly_process(gfxpoly_t*poly1, gfxpoly_t*poly2, windrule_t*windrule, windcontext_t*context, moments_t*moments)
 {
+    TIMER_START(starttime);
     current_polygon = poly1;
 
     status_t status;
@@ -1603,6 +1605,7 @@ gfxpoly_t* gfxpoly_process(gfxpoly_t*poly1, gfxpoly_t*poly2, windrule_t*windrule
 	stroke = stroke->next;
     }
 #endif
+    TIMER_STOP(TIMER_GFXPOLY, starttime);
     return p;
 }
 
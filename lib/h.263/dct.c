@@ -19,6 +19,9 @@
    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
 
 #include <memory.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 int zigzagtable[64] = {
     0, 1, 5, 6, 14, 15, 27, 28,
@@ -42,7 +45,10 @@ static double table[8][8] =
 {0.195090322016128,-0.555570233019602,0.831469612302545,-0.980785280403231,0.980785280403230,-0.831469612302545,0.555570233019602,-0.195090322016129}
 };
 
-void dct(int*src)
+/* reference implementations. The SSE2 versions further below must produce
+   exactly the same output (see test_dct() in swfvideo.c) */
+
+void dct_c(int*src)
 {
     double tmp[64];
     int x,y,u,v,t;
@@ -69,7 +75,7 @@ void dct(int*src)
     }
 }
 
-void idct(int*src)
+void idct_c(int*src)
 {
     double tmp[64];
     int x,y,u,v;
@@ -158,7 +164,7 @@ inline static void innerdct(const double*a,double*b, const double*c)
     b[7*8] = b0*c[7] - b1*c[5] + b2*c[3] - b3*c[1];
 }
 
-void dct2(int*src, int*dest)
+void dct2_c(int*src, int*dest)
 {
     double tmp[64], tmp2[64];
     double*p;
@@ -185,6 +191,151 @@ void dct2(int*src, int*dest)
     }
 }
 
+#ifdef __SSE2__
+
+/* The SSE2 transforms compute two coefficients at once, but perform the
+   double precision additions and multiplications in the same order as the
+   scalar code, so the results are bit-identical. */
+
+void dct(int*src)
+{
+    __m128d tmp[8][4];
+    __m128d quarter = _mm_set1_pd(0.25);
+    __m128d half = _mm_set1_pd(0.5);
+    int x,y,u,v;
+
+    for(u=0;u<4;u++)
+    {
+	__m128d t[8];
+	for(x=0;x<8;x++)
+	    t[x] = _mm_set_pd(table[u*2+1][x], table[u*2][x]);
+	for(v=0;v<8;v++)
+	{
+	    __m128d c = _mm_setzero_pd();
+	    for(x=0;x<8;x++)
+		c = _mm_add_pd(c, _mm_mul_pd(t[x], _mm_set1_pd(src[v*8+x])));
+	    tmp[v][u] = c;
+	}
+    }
+    for(v=0;v<8;v++)
+    for(u=0;u<4;u++)
+    {
+	__m128d c = _mm_setzero_pd();
+	for(y=0;y<8;y++)
+	    c = _mm_add_pd(c, _mm_mul_pd(_mm_set1_pd(table[v][y]), tmp[y][u]));
+	c = _mm_add_pd(_mm_mul_pd(c, quarter), half);
+	_mm_storel_epi64((__m128i*)&src[v*8+u*2], _mm_cvttpd_epi32(c));
+    }
+}
+
+void idct(int*src)
+{
+    __m128d tmp[8][4];
+    __m128d quarter = _mm_set1_pd(0.25);
+    __m128d half = _mm_set1_pd(0.5);
+    int x,y,u,v;
+
+    for(y=0;y<8;y++)
+    for(x=0;x<4;x++)
+    {
+	__m128d c = _mm_setzero_pd();
+	for(u=0;u<8;u++)
+	    c = _mm_add_pd(c, _mm_mul_pd(_mm_loadu_pd(&table[u][x*2]), _mm_set1_pd(src[y*8+u])));
+	tmp[y][x] = c;
+    }
+    for(y=0;y<8;y++)
+    for(x=0;x<4;x++)
+    {
+	__m128d c = _mm_setzero_pd();
+	for(v=0;v<8;v++)
+	    c = _mm_add_pd(c, _mm_mul_pd(_mm_set1_pd(table[v][y]), tmp[v][x]));
+	c = _mm_add_pd(_mm_mul_pd(c, quarter), half);
+	_mm_storel_epi64((__m128i*)&src[y*8+x*2], _mm_cvttpd_epi32(c));
+    }
+}
+
+/* same as innerdct(), but processes two rows at once. a[] and b[] are
+   the transposed input and output rows */
+inline static void innerdct_sse2(const __m128d*a, __m128d*b, const double*c)
+{
+    __m128d c1 = _mm_set1_pd(c[1]), c2 = _mm_set1_pd(c[2]);
+    __m128d c3 = _mm_set1_pd(c[3]), c4 = _mm_set1_pd(c[4]);
+    __m128d c5 = _mm_set1_pd(c[5]), c6 = _mm_set1_pd(c[6]);
+    __m128d c7 = _mm_set1_pd(c[7]);
+    __m128d b0,b1,b2,b3,b4,b5;
+
+    b2 = _mm_add_pd(a[0*4],a[7*4]);
+    b3 = _mm_add_pd(a[1*4],a[6*4]);
+    b4 = _mm_add_pd(a[2*4],a[5*4]);
+    b5 = _mm_add_pd(a[3*4],a[4*4]);
+
+    b0 = _mm_mul_pd(_mm_add_pd(b2,b5),c4);
+    b1 = _mm_mul_pd(_mm_add_pd(b3,b4),c4);
+    b[0*4] = _mm_add_pd(b0,b1);
+    b[4*4] = _mm_sub_pd(b0,b1);
+    b[2*4] = _mm_add_pd(_mm_mul_pd(_mm_sub_pd(b2,b5),c2), _mm_mul_pd(_mm_sub_pd(b3,b4),c6));
+    b[6*4] = _mm_add_pd(_mm_mul_pd(_mm_sub_pd(b2,b5),c6), _mm_mul_pd(_mm_sub_pd(b4,b3),c2));
+
+    b0 = _mm_sub_pd(a[0*4],a[7*4]);
+    b1 = _mm_sub_pd(a[1*4],a[6*4]);
+    b2 = _mm_sub_pd(a[2*4],a[5*4]);
+    b3 = _mm_sub_pd(a[3*4],a[4*4]);
+
+    b[1*4] = _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(b0,c1), _mm_mul_pd(b1,c3)), _mm_mul_pd(b2,c5)), _mm_mul_pd(b3,c7));
+    b[3*4] = _mm_sub_pd(_mm_sub_pd(_mm_sub_pd(_mm_mul_pd(b0,c3), _mm_mul_pd(b1,c7)), _mm_mul_pd(b2,c1)), _mm_mul_pd(b3,c5));
+    b[5*4] = _mm_add_pd(_mm_add_pd(_mm_sub_pd(_mm_mul_pd(b0,c5), _mm_mul_pd(b1,c1)), _mm_mul_pd(b2,c7)), _mm_mul_pd(b3,c3));
+    b[7*4] = _mm_sub_pd(_mm_add_pd(_mm_sub_pd(_mm_mul_pd(b0,c7), _mm_mul_pd(b1,c5)), _mm_mul_pd(b2,c3)), _mm_mul_pd(b3,c1));
+}
+
+void dct2(int*src, int*dest)
+{
+    __m128d tmp[8][4], tmp2[8][4];
+    double out[64];
+    int t,v;
+
+    /* rows are stored as four pairs of doubles, tmp2 holds the transposed input */
+    for(t=0;t<8;t++)
+    for(v=0;v<4;v++)
+	tmp2[t][v] = _mm_set_pd(src[(v*2+1)*8+t], src[v*2*8+t]);
+
+    for(v=0;v<4;v++)
+	innerdct_sse2(&tmp2[0][v], &tmp[0][v], c);
+
+    /* transpose */
+    for(t=0;t<8;t+=2)
+    for(v=0;v<4;v++) {
+	__m128d r0 = tmp[v*2][t/2];
+	__m128d r1 = tmp[v*2+1][t/2];
+	tmp2[t][v] = _mm_unpacklo_pd(r0, r1);
+	tmp2[t+1][v] = _mm_unpackhi_pd(r0, r1);
+    }
+
+    for(v=0;v<4;v++)
+	innerdct_sse2(&tmp2[0][v], &tmp[0][v], cc);
+
+    for(t=0;t<8;t++)
+    for(v=0;v<4;v++)
+	_mm_storeu_pd(&out[t*8+v*2], tmp[t][v]);
+    for(t=0;t<64;t++)
+	dest[zigzagtable[t]] = (int)out[t];
+}
+
+#else
+
+void dct(int*src)
+{
+    dct_c(src);
+}
+void idct(int*src)
+{
+    idct_c(src);
+}
+void dct2(int*src, int*dest)
+{
+    dct2_c(src, dest);
+}
+
+#endif
 
 void zigzag(int*src)
 {
@@ -195,5 +346,3 @@ void zigzag(int*src)
     }
     memcpy(src, tmp, sizeof(int)*64);
 }
-
-
@@ -25,6 +25,12 @@ void idct(int*src);
 void preparequant(int quant);
 void dct2(int*src, int*dest);
 
+/* plain C versions of the above, which the (SSE2) versions are
+   checked against */
+void dct_c(int*src);
+void idct_c(int*src);
+void dct2_c(int*src, int*dest);
+
 extern int zigzagtable[64];
 void zigzag(int*src);
 
@@ -0,0 +1,197 @@
+/* speedtest.c
+
+   Throughput and quality benchmark for the h.263 encoder.
+   Encodes a couple of synthetic clips at different quantizers and reports
+   frames per second, bits per frame and PSNR.
+
+   Part of the swftools package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+#include "../rfxswf.h"
+
+#define WIDTH 320
+#define HEIGHT 240
+
+static int frames = 50;
+static int keyframe_interval = 10;
+static int do_motion = 0;
+static int threads = 1;
+
+static int quantizers[] = {2, 7, 15, 31, 0};
+
+typedef void (*clipfunc_t)(RGBA*pic, int frame);
+
+static void set(RGBA*p, int r, int g, int b)
+{
+    p->a = 255;
+    p->r = r;
+    p->g = g;
+    p->b = b;
+}
+
+/* a diagonal color gradient, moving three pixels to the left per frame */
+static void clip_pan(RGBA*pic, int frame)
+{
+    int x,y;
+    for(y=0;y<HEIGHT;y++)
+    for(x=0;x<WIDTH;x++) {
+	int xx = x + frame*3;
+	set(&pic[y*WIDTH+x], (xx+y)&255, (xx*2)&255, (255-y)&255);
+    }
+}
+
+/* black "text" on white paper, scrolling up two pixels per frame.
+   Glyphs are 5x7 dot patterns derived from a hash of their position. */
+static void clip_text(RGBA*pic, int frame)
+{
+    int x,y;
+    for(y=0;y<HEIGHT;y++) {
+	int yy = y + frame*2;
+	int line = yy/12, gy = yy%12;
+	for(x=0;x<WIDTH;x++) {
+	    int column = x/7, gx = x%7;
+	    int ink = 0;
+	    if(gy<7 && gx<5 && x>=14 && x<WIDTH-14) {
+		unsigned int h = (line*7919+column*104729)^0x5bd1e995;
+		h ^= h>>13; h *= 0x5bd1e995; h ^= h>>15;
+		/* space between words */
+		if((h&7) != 0)
+		    ink = (h >> (8 + (gy*5+gx)%24)) & 1;
+	    }
+	    if(ink)
+		set(&pic[y*WIDTH+x], 0, 0, 0);
+	    else
+		set(&pic[y*WIDTH+x], 255, 255, 250);
+	}
+    }
+}
+
+/* white noise- the worst case for the encoder */
+static void clip_noise(RGBA*pic, int frame)
+{
+    unsigned int seed = 0x263 + frame*12345;
+    int t;
+    for(t=0;t<WIDTH*HEIGHT;t++) {
+	seed = seed*1103515245+12345;
+	set(&pic[t], seed>>24, seed>>16, seed>>8);
+    }
+}
+
+static struct {
+    char*name;
+    clipfunc_t func;
+} clips[] = {
+    {"pan", clip_pan},
+    {"text", clip_text},
+    {"noise", clip_noise},
+    {0,0}
+};
+
+static double gettime()
+{
+    struct timeval t;
+    gettimeofday(&t, 0);
+    return t.tv_sec + t.tv_usec/1000000.0;
+}
+
+/* PSNR of the luminance of the encoder's reconstruction against the
+   source picture (using the same color conversion as the encoder) */
+static double psnr(VIDEOSTREAM*s, RGBA*pic)
+{
+    double error = 0;
+    int x,y;
+    for(y=0;y<HEIGHT;y++)
+    for(x=0;x<WIDTH;x++) {
+	RGBA*p = &pic[y*WIDTH+x];
+	int luma = (p->r*((int)(0.299*256)) + p->g*((int)(0.587*256)) + p->b*((int)(0.114*256)))>>8;
+	int d = luma - s->current[y*s->linex+x].y;
+	error += d*d;
+    }
+    error /= WIDTH*HEIGHT;
+    if(error == 0)
+	return 99.0;
+    return 10*log10(255.0*255.0/error);
+}
+
+static void encode_clip(char*name, clipfunc_t func, int quant)
+{
+    RGBA*pic = (RGBA*)rfx_alloc(WIDTH*HEIGHT*sizeof(RGBA));
+    VIDEOSTREAM stream;
+    TAG*tag;
+    double time = 0, quality = 0;
+    int bits = 0;
+    int t;
+
+    tag = swf_InsertTag(0, ST_DEFINEVIDEOSTREAM);
+    swf_SetU16(tag, 1);
+    swf_SetVideoStreamDefine(tag, &stream, frames, WIDTH, HEIGHT);
+    stream.do_motion = do_motion;
+    stream.threads = threads;
+
+    for(t=0;t<frames;t++) {
+	double t1;
+	func(pic, t);
+	swf_ResetTag(tag, ST_VIDEOFRAME);
+	swf_SetU16(tag, 1);
+	t1 = gettime();
+	if(t%keyframe_interval == 0)
+	    swf_SetVideoStreamIFrame(tag, &stream, pic, quant);
+	else
+	    swf_SetVideoStreamPFrame(tag, &stream, pic, quant);
+	time += gettime() - t1;
+	bits += (tag->len-2)*8;
+	quality += psnr(&stream, pic);
+    }
+    printf("%-6s %5d %10.2f %14d %9.2f\n", name, quant, frames/time, bits/frames, quality/frames);
+    fflush(stdout);
+
+    swf_VideoStreamClear(&stream);
+    swf_DeleteTag(0, tag);
+    rfx_free(pic);
+}
+
+int main(int argn, char*argv[])
+{
+    int t,c,q;
+    for(t=1;t<argn;t++) {
+	if(!strcmp(argv[t], "-m")) {
+	    do_motion = 1;
+	} else if(!strcmp(argv[t], "-j") && t+1<argn) {
+	    threads = atoi(argv[++t]);
+	} else if(!strcmp(argv[t], "-n") && t+1<argn) {
+	    frames = atoi(argv[++t]);
+	} else {
+	    fprintf(stderr, "Usage: %s [-m] [-j threads] [-n frames]\n", argv[0]);
+	    fprintf(stderr, "    -m    enable motion compensation\n");
+	    return 1;
+	}
+    }
+    if(frames<1)
+	frames = 1;
+
+    printf("%dx%d, %d frames, keyframe interval %d, motion compensation %s, %d thread(s)\n",
+	    WIDTH, HEIGHT, frames, keyframe_interval, do_motion?"on":"off", threads);
+    printf("%-6s %5s %10s %14s %9s\n", "clip", "quant", "frames/s", "bits/frame", "PSNR(dB)");
+    for(c=0;clips[c].name;c++)
+    for(q=0;quantizers[q];q++)
+	encode_clip(clips[c].name, clips[c].func, quantizers[q]);
+    return 0;
+}
@@ -26,6 +26,12 @@
 #include "../rfxswf.h"
 #include "h263tables.h"
 #include "dct.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 /* TODO:
    - use prepare* / write* in encode_IFrame_block
@@ -239,7 +245,7 @@ static void getmvdregion(block_t* bb, YUV*pic, int posx, int posy, int mvdx, int
     }
 }
 
-static void rgb2yuv(YUV*dest, RGBA*src, int dlinex, int slinex, int width, int height)
+static void rgb2yuv_c(YUV*dest, RGBA*src, int dlinex, int slinex, int width, int height)
 {
     int x,y;
     for(y=0;y<height;y++) {
@@ -261,6 +267,59 @@ static void rgb2yuv(YUV*dest, RGBA*src, int dlinex, int slinex, int width, int h
     }
 }
 
+#ifdef __SSE2__
+/* sums up the two 32 bit products _mm_madd_epi16 produced for each of
+   the four pixels in lo/hi */
+static inline __m128i rgb2yuv_sum(__m128i lo, __m128i hi, __m128i coeff)
+{
+    lo = _mm_madd_epi16(lo, coeff);
+    hi = _mm_madd_epi16(hi, coeff);
+    lo = _mm_add_epi32(lo, _mm_srli_epi64(lo, 32));
+    hi = _mm_add_epi32(hi, _mm_srli_epi64(hi, 32));
+    lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3,1,2,0));
+    hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3,1,2,0));
+    return _mm_unpacklo_epi64(lo, hi);
+}
+#endif
+
+static void rgb2yuv(YUV*dest, RGBA*src, int dlinex, int slinex, int width, int height)
+{
+#ifdef __SSE2__
+    /* the same fixed point coefficients as in rgb2yuv_c(), as a,r,g,b quadruples */
+    __m128i cy = _mm_setr_epi16(0, (int)( 0.299*256), (int)( 0.587*256), (int)( 0.114 *256),
+	                        0, (int)( 0.299*256), (int)( 0.587*256), (int)( 0.114 *256));
+    __m128i cu = _mm_setr_epi16(0, (int)(-0.169*256), (int)(-0.332*256), (int)( 0.500 *256),
+	                        0, (int)(-0.169*256), (int)(-0.332*256), (int)( 0.500 *256));
+    __m128i cv = _mm_setr_epi16(0, (int)( 0.500*256), (int)(-0.419*256), (int)(-0.0813*256),
+	                        0, (int)( 0.500*256), (int)(-0.419*256), (int)(-0.0813*256));
+    __m128i offset = _mm_set1_epi32(128*256);
+    __m128i zero = _mm_setzero_si128();
+    int x,y;
+    for(y=0;y<height;y++) {
+	RGBA*s = &src[y*slinex];
+	YUV*d = &dest[y*dlinex];
+	for(x=0;x+4<=width;x+=4) {
+	    int yy[4],uu[4],vv[4],t;
+	    __m128i p = _mm_loadu_si128((__m128i*)&s[x]);
+	    __m128i lo = _mm_unpacklo_epi8(p, zero);
+	    __m128i hi = _mm_unpackhi_epi8(p, zero);
+	    _mm_storeu_si128((__m128i*)yy, _mm_srai_epi32(rgb2yuv_sum(lo, hi, cy), 8));
+	    _mm_storeu_si128((__m128i*)uu, _mm_srai_epi32(_mm_add_epi32(rgb2yuv_sum(lo, hi, cu), offset), 8));
+	    _mm_storeu_si128((__m128i*)vv, _mm_srai_epi32(_mm_add_epi32(rgb2yuv_sum(lo, hi, cv), offset), 8));
+	    for(t=0;t<4;t++) {
+		d[x+t].y = yy[t];
+		d[x+t].u = uu[t];
+		d[x+t].v = vv[t];
+	    }
+	}
+	if(x<width)
+	    rgb2yuv_c(&d[x], &s[x], dlinex, slinex, width-x, 1);
+    }
+#else
+    rgb2yuv_c(dest, src, dlinex, slinex, width, height);
+#endif
+}
+
 static void copyregion(VIDEOSTREAM*s, YUV*dest, YUV*src, int bx, int by)
 {
     YUV*p1 = &dest[by*s->linex*16+bx*16];
@@ -272,7 +331,7 @@ static void copyregion(VIDEOSTREAM*s, YUV*dest, YUV*src, int bx, int by)
     }
 }
 
-static void yuv2rgb(RGBA*dest, YUV*src, int linex, int width, int height)
+static void yuv2rgb_c(RGBA*dest, YUV*src, int linex, int width, int height)
 {
     int x,y;
     for(y=0;y<height;y++) {
@@ -287,6 +346,42 @@ static void yuv2rgb(RGBA*dest, YUV*src, int linex, int width, int height)
 	}
     }
 }
+
+static void yuv2rgb(RGBA*dest, YUV*src, int linex, int width, int height)
+{
+#ifdef __SSE2__
+    /* (u-128,v-128) pairs are multiplied with these using _mm_madd_epi16 */
+    __m128i cr = _mm_setr_epi16(0, 360, 0, 360, 0, 360, 0, 360);
+    __m128i cg = _mm_setr_epi16(88, 183, 88, 183, 88, 183, 88, 183);
+    __m128i cb = _mm_setr_epi16(455, 0, 455, 0, 455, 0, 455, 0);
+    int x,y;
+    for(y=0;y<height;y++) {
+	YUV*s = &src[y*linex];
+	RGBA*d = &dest[y*linex];
+	for(x=0;x+4<=width;x+=4) {
+	    U8 out[16];
+	    int t;
+	    __m128i uv = _mm_setr_epi16(s[x+0].u-128, s[x+0].v-128, s[x+1].u-128, s[x+1].v-128,
+		                        s[x+2].u-128, s[x+2].v-128, s[x+3].u-128, s[x+3].v-128);
+	    __m128i yy = _mm_setr_epi32(s[x+0].y, s[x+1].y, s[x+2].y, s[x+3].y);
+	    __m128i r = _mm_add_epi32(yy, _mm_srai_epi32(_mm_madd_epi16(uv, cr), 8));
+	    __m128i g = _mm_sub_epi32(yy, _mm_srai_epi32(_mm_madd_epi16(uv, cg), 8));
+	    __m128i b = _mm_add_epi32(yy, _mm_srai_epi32(_mm_madd_epi16(uv, cb), 8));
+	    /* saturating packs do the truncate256() */
+	    _mm_storeu_si128((__m128i*)out, _mm_packus_epi16(_mm_packs_epi32(r, g), _mm_packs_epi32(b, b)));
+	    for(t=0;t<4;t++) {
+		d[x+t].r = out[t];
+		d[x+t].g = out[t+4];
+		d[x+t].b = out[t+8];
+	    }
+	}
+	if(x<width)
+	    yuv2rgb_c(&d[x], &s[x], linex, width-x, 1);
+    }
+#else
+    yuv2rgb_c(dest, src, linex, width, height);
+#endif
+}
 static void copy_block_pic(VIDEOSTREAM*s, YUV*dest, block_t*b, int bx, int by)
 {
     YUV*p1 = &dest[(by*16)*s->linex+bx*16];
@@ -427,7 +522,7 @@ static int codehuffman(TAG*tag, struct huffcode*table, int index)
     return i;
 }
 
-static void quantize8x8(int*src, int*dest, int has_dc, int quant)
+static void quantize8x8_c(int*src, int*dest, int has_dc, int quant)
 {
     int t,pos=0;
     double q = 1.0/(quant*2);
@@ -448,7 +543,7 @@ static void quantize8x8(int*src, int*dest, int has_dc, int quant)
     }
 }
 
-static void dequantize8x8(int*b, int has_dc, int quant)
+static void dequantize8x8_c(int*b, int has_dc, int quant)
 {
     int t,pos=0;
     if(has_dc) {
@@ -479,6 +574,68 @@ static void dequantize8x8(int*b, int has_dc, int quant)
     }
 }
 
+static void quantize8x8(int*src, int*dest, int has_dc, int quant)
+{
+#ifdef __SSE2__
+    int t;
+    __m128d q = _mm_set1_pd(1.0/(quant*2));
+    __m128d min = _mm_set1_pd(-127.0);
+    __m128d max = _mm_set1_pd(127.0);
+    int dc = has_dc?valtodc((int)src[0]):0;
+    /* clamping before the truncation gives the same result as
+       clamping afterwards */
+    for(t=0;t<64;t+=2) {
+	__m128d v = _mm_cvtepi32_pd(_mm_loadl_epi64((__m128i*)&src[t]));
+	v = _mm_min_pd(_mm_max_pd(_mm_mul_pd(v, q), min), max);
+	_mm_storel_epi64((__m128i*)&dest[t], _mm_cvttpd_epi32(v));
+    }
+    if(has_dc)
+	dest[0] = dc; /*DC*/
+#else
+    quantize8x8_c(src, dest, has_dc, quant);
+#endif
+}
+
+static void dequantize8x8(int*b, int has_dc, int quant)
+{
+#ifdef __SSE2__
+    /* computed with 16 bit values: anything beyond +-16383 ends up
+       being clipped to -2048..2047 anyway */
+    __m128i q = _mm_set1_epi16(quant);
+    __m128i odd = _mm_set1_epi32((quant&1)?0:1);
+    __m128i one = _mm_set1_epi16(1);
+    __m128i lim = _mm_set1_epi16(16383);
+    __m128i nlim = _mm_set1_epi16(-16383);
+    __m128i min = _mm_set1_epi16(-2048);
+    __m128i max = _mm_set1_epi16(2047);
+    __m128i zero = _mm_setzero_si128();
+    int dc = has_dc?dctoval(b[0]):0;
+    int t;
+    for(t=0;t<64;t+=8) {
+	__m128i x = _mm_packs_epi32(_mm_loadu_si128((__m128i*)&b[t]), _mm_loadu_si128((__m128i*)&b[t+4]));
+	__m128i sign, a, lo, hi, r;
+	x = _mm_min_epi16(_mm_max_epi16(x, nlim), lim);
+	sign = _mm_srai_epi16(x, 15);
+	a = _mm_sub_epi16(_mm_xor_si128(x, sign), sign);
+	a = _mm_add_epi16(_mm_add_epi16(a, a), one);
+	lo = _mm_mullo_epi16(a, q);
+	hi = _mm_mulhi_epi16(a, q);
+	r = _mm_packs_epi32(_mm_sub_epi32(_mm_unpacklo_epi16(lo, hi), odd),
+		            _mm_sub_epi32(_mm_unpackhi_epi16(lo, hi), odd));
+	r = _mm_sub_epi16(_mm_xor_si128(r, sign), sign);
+	r = _mm_andnot_si128(_mm_cmpeq_epi16(x, zero), r);
+	/* paragraph 6.2.2, "clipping of reconstruction levels": */
+	r = _mm_min_epi16(_mm_max_epi16(r, min), max);
+	_mm_storeu_si128((__m128i*)&b[t], _mm_srai_epi32(_mm_unpacklo_epi16(r, r), 16));
+	_mm_storeu_si128((__m128i*)&b[t+4], _mm_srai_epi32(_mm_unpackhi_epi16(r, r), 16));
+    }
+    if(has_dc)
+	b[0] = dc; //DC
+#else
+    dequantize8x8_c(b, has_dc, quant);
+#endif
+}
+
 static int hascoef(int*b, int has_dc)
 {
     int t;
@@ -958,18 +1115,15 @@ int getmvdbits(VIDEOSTREAM*s,block_t*fb, int bx,int by,int hx,int hy)
     return bits;
 }
 
-void prepareMVDBlock(VIDEOSTREAM*s, mvdblockdata_t*data, int bx, int by, block_t* fb, int*bits)
-{ /* consider mvd(x,y)-block */
-
+/* the part of prepareMVDBlock() which doesn't depend on the motion vectors
+   of the neighboring blocks, and can hence be done in parallel for all blocks */
+static void searchMVDBlock(VIDEOSTREAM*s, mvdblockdata_t*data, int bx, int by, block_t* fb)
+{
     int t;
-    int y,c;
     block_t fbdiff;
-    int predictmvdx;
-    int predictmvdy;
 
     data->bx = bx;
     data->by = by;
-    predictmvd(s,bx,by,&predictmvdx,&predictmvdy);
 
     data->bits = 65535;
     data->movex=0;
@@ -1022,23 +1176,6 @@ void prepareMVDBlock(VIDEOSTREAM*s, mvdblockdata_t*data, int bx, int by, block_t
     getmvdregion(&data->fbold, s->oldpic, bx, by, data->movex, data->movey, s->linex);
     yuvdiff(&fbdiff, &data->fbold);
     dodctandquant(&fbdiff, &data->b, 0, s->quant);
-    getblockpatterns(&data->b, &y, &c, 0);
-
-    data->xindex = mvd2index(predictmvdx, predictmvdy, data->movex, data->movey, 0);
-    data->yindex = mvd2index(predictmvdx, predictmvdy, data->movex, data->movey, 1);
-
-    *bits = 1; //cod
-    *bits += mcbpc_inter[0*4+c].len;
-    *bits += cbpy[y^15].len;
-    *bits += mvd[data->xindex].len; // (0,0)
-    *bits += mvd[data->yindex].len;
-    *bits += coefbits8x8(data->b.y1, 0);
-    *bits += coefbits8x8(data->b.y2, 0);
-    *bits += coefbits8x8(data->b.y3, 0);
-    *bits += coefbits8x8(data->b.y4, 0);
-    *bits += coefbits8x8(data->b.u, 0);
-    *bits += coefbits8x8(data->b.v, 0);
-    data->bits = *bits;
 
     /* -- reconstruction -- */
     memcpy(&data->reconstruction, &data->b, sizeof(block_t));
@@ -1060,6 +1197,40 @@ void prepareMVDBlock(VIDEOSTREAM*s, mvdblockdata_t*data, int bx, int by, block_t
     }
 }
 
+/* encode the motion vector relative to the one predicted from the
+   neighboring blocks, and count the resulting bits */
+static void predictMVDBlock(VIDEOSTREAM*s, mvdblockdata_t*data, int*bits)
+{
+    int y,c;
+    int predictmvdx;
+    int predictmvdy;
+
+    predictmvd(s,data->bx,data->by,&predictmvdx,&predictmvdy);
+    getblockpatterns(&data->b, &y, &c, 0);
+
+    data->xindex = mvd2index(predictmvdx, predictmvdy, data->movex, data->movey, 0);
+    data->yindex = mvd2index(predictmvdx, predictmvdy, data->movex, data->movey, 1);
+
+    *bits = 1; //cod
+    *bits += mcbpc_inter[0*4+c].len;
+    *bits += cbpy[y^15].len;
+    *bits += mvd[data->xindex].len; // (0,0)
+    *bits += mvd[data->yindex].len;
+    *bits += coefbits8x8(data->b.y1, 0);
+    *bits += coefbits8x8(data->b.y2, 0);
+    *bits += coefbits8x8(data->b.y3, 0);
+    *bits += coefbits8x8(data->b.y4, 0);
+    *bits += coefbits8x8(data->b.u, 0);
+    *bits += coefbits8x8(data->b.v, 0);
+    data->bits = *bits;
+}
+
+void prepareMVDBlock(VIDEOSTREAM*s, mvdblockdata_t*data, int bx, int by, block_t* fb, int*bits)
+{ /* consider mvd(x,y)-block */
+    searchMVDBlock(s, data, bx, by, fb);
+    predictMVDBlock(s, data, bits);
+}
+
 int writeMVDBlock(VIDEOSTREAM*s, TAG*tag, mvdblockdata_t*data)
 {
     int c = 0, y = 0;
@@ -1098,39 +1269,129 @@ int writeMVDBlock(VIDEOSTREAM*s, TAG*tag, mvdblockdata_t*data)
     return bits;
 }
 
-static int encode_PFrame_block(TAG*tag, VIDEOSTREAM*s, int bx, int by)
+typedef struct _pblockdata_t
+{
+    iblockdata_t iblock;
+    mvdblockdata_t mvdblock;
+    int bits_i;
+    int skip;
+} pblockdata_t;
+
+/* Everything about a P-Frame block which can be computed without knowing
+   how the blocks before it were encoded. Only touches the block's own
+   region of s->current. */
+static void analyze_PFrame_block(VIDEOSTREAM*s, pblockdata_t*data, int bx, int by)
 {
     block_t fb;
     int diff1,diff2;
-    int bits_i;
-    int bits_vxy;
 
-    iblockdata_t iblock;
-    mvdblockdata_t mvdblock;
-    
     getregion(&fb, s->current, bx, by, s->linex);
-    prepareIBlock(s, &iblock, bx, by, &fb, &bits_i, 0);
+    prepareIBlock(s, &data->iblock, bx, by, &fb, &data->bits_i, 0);
 
     /* encoded last frame <=> original current block: */
     diff1 = compare_pic_pic(s, s->current, s->oldpic, bx, by);
     /* encoded current frame <=> original current block: */
-    diff2 = compare_pic_block(s, &iblock.reconstruction, s->current, bx, by);
+    diff2 = compare_pic_block(s, &data->iblock.reconstruction, s->current, bx, by);
+
+    data->skip = diff1 <= diff2;
+    if(!data->skip)
+	searchMVDBlock(s, &data->mvdblock, bx, by, &fb);
+}
 
-    if(diff1 <= diff2) {
+static int write_PFrame_block(TAG*tag, VIDEOSTREAM*s, pblockdata_t*data, int bx, int by)
+{
+    int bits_vxy;
+
+    if(data->skip) {
 	swf_SetBits(tag, 1,1); /* cod=1, block skipped */
 	/* copy the region from the last frame so that we have a complete reconstruction */
 	copyregion(s, s->current, s->oldpic, bx, by);
 	return 1;
     }
-    prepareMVDBlock(s, &mvdblock, bx, by, &fb, &bits_vxy);
+    predictMVDBlock(s, &data->mvdblock, &bits_vxy);
 
-    if(bits_i > bits_vxy) {
-	return writeMVDBlock(s, tag, &mvdblock);
+    if(data->bits_i > bits_vxy) {
+	return writeMVDBlock(s, tag, &data->mvdblock);
     } else {
-	return writeIBlock(s, tag, &iblock);
+	return writeIBlock(s, tag, &data->iblock);
     }
 }
 
+static int encode_PFrame_block(TAG*tag, VIDEOSTREAM*s, int bx, int by)
+{
+    pblockdata_t data;
+    analyze_PFrame_block(s, &data, bx, by);
+    return write_PFrame_block(tag, s, &data, bx, by);
+}
+
+#ifdef HAVE_PTHREAD_H
+typedef struct _pframejob_t
+{
+    VIDEOSTREAM*s;
+    pblockdata_t*blocks;
+    pthread_mutex_t mutex;
+    int nextrow;
+} pframejob_t;
+
+static void* analyze_PFrame_rows(void*_job)
+{
+    pframejob_t*job = (pframejob_t*)_job;
+    VIDEOSTREAM*s = job->s;
+    while(1) {
+	int bx,by;
+	pthread_mutex_lock(&job->mutex);
+	by = job->nextrow++;
+	pthread_mutex_unlock(&job->mutex);
+	if(by >= s->bby)
+	    break;
+	for(bx=0;bx<s->bbx;bx++)
+	    analyze_PFrame_block(s, &job->blocks[by*s->bbx+bx], bx, by);
+    }
+    return 0;
+}
+
+/* Analyze the macroblock rows of a P-Frame on s->threads threads, then
+   entropy-code the blocks in order. The motion vector prediction is the
+   only thing that depends on the previous blocks, and is done while writing,
+   so the result is the same as encoding the blocks one after another. */
+static void encode_PFrame_parallel(TAG*tag, VIDEOSTREAM*s)
+{
+    pframejob_t job;
+    pthread_t*threads;
+    int t, num = s->threads;
+    int bx,by;
+
+    job.s = s;
+    job.nextrow = 0;
+    job.blocks = (pblockdata_t*)rfx_alloc(s->bbx*s->bby*sizeof(pblockdata_t));
+    threads = (pthread_t*)rfx_alloc(num*sizeof(pthread_t));
+    pthread_mutex_init(&job.mutex, 0);
+
+    /* initialize the dct2() scaling table before the threads use it */
+    preparequant(s->quant);
+
+    for(t=0;t<num;t++) {
+	if(pthread_create(&threads[t], 0, analyze_PFrame_rows, &job))
+	    break;
+    }
+    if(!t) {
+	/* couldn't start any threads- do it ourselves */
+	analyze_PFrame_rows(&job);
+    }
+    num = t;
+    for(t=0;t<num;t++)
+	pthread_join(threads[t], 0);
+    pthread_mutex_destroy(&job.mutex);
+    rfx_free(threads);
+
+    for(by=0;by<s->bby;by++)
+    for(bx=0;bx<s->bbx;bx++)
+	write_PFrame_block(tag, s, &job.blocks[by*s->bbx+bx], bx, by);
+
+    rfx_free(job.blocks);
+}
+#endif
+
 /* should be called encode_IFrameBlock */
 static void encode_IFrame_block(TAG*tag, VIDEOSTREAM*s, int bx, int by)
 {
@@ -1287,6 +1548,11 @@ void swf_SetVideoStreamPFrame(TAG*tag, VIDEOSTREAM*s, RGBA*pic, int quant)
     memset(s->mvdx, 0, s->bbx*s->bby*sizeof(int));
     memset(s->mvdy, 0, s->bbx*s->bby*sizeof(int));
 
+#ifdef HAVE_PTHREAD_H
+    if(s->threads>1)
+	encode_PFrame_parallel(tag, s);
+    else
+#endif
     for(by=0;by<s->bby;by++)
     {
 	for(bx=0;bx<s->bbx;bx++)
@@ -1428,6 +1694,122 @@ void test_copy_diff()
     }
 }
 
+/* check the vectorized transforms against the C reference implementations */
+void test_dct()
+{
+    int t,i;
+    srand(0x263);
+    for(t=0;t<10000;t++) {
+	int a[64],b[64],c[64],d[64];
+	int quant = 1+rand()%31;
+	int has_dc = t&1;
+	/* pixels (I-Frames) and pixel differences (P-Frames) */
+	for(i=0;i<64;i++)
+	    a[i] = (t&1)?(rand()&255):(rand()%511-255);
+	memcpy(b, a, sizeof(a));
+	dct(a);dct_c(b);
+	assert(!memcmp(a, b, sizeof(a)));
+
+	memcpy(a, b, sizeof(a));
+	idct(a);idct_c(b);
+	assert(!memcmp(a, b, sizeof(a)));
+
+	for(i=0;i<64;i++)
+	    a[i] = rand()%511-255;
+	preparequant(quant);
+	dct2(a, c);dct2_c(a, d);
+	assert(!memcmp(c, d, sizeof(c)));
+
+	for(i=0;i<64;i++)
+	    a[i] = rand()%8192-4096;
+	if(has_dc)
+	    a[0] = rand()&2047;
+	quantize8x8(a, c, has_dc, quant);
+	quantize8x8_c(a, d, has_dc, quant);
+	assert(!memcmp(c, d, sizeof(c)));
+
+	for(i=0;i<64;i++)
+	    c[i] = rand()%4096-2048;
+	if(has_dc)
+	    c[0] = 1+rand()%127;
+	memcpy(d, c, sizeof(c));
+	dequantize8x8(c, has_dc, quant);
+	dequantize8x8_c(d, has_dc, quant);
+	assert(!memcmp(c, d, sizeof(c)));
+    }
+}
+
+void test_yuv()
+{
+    int width = 67, height = 19;
+    RGBA*pic = (RGBA*)rfx_alloc(width*height*sizeof(RGBA));
+    RGBA*pic1 = (RGBA*)rfx_calloc(width*height*sizeof(RGBA));
+    RGBA*pic2 = (RGBA*)rfx_calloc(width*height*sizeof(RGBA));
+    YUV*yuv1 = (YUV*)rfx_calloc(width*height*sizeof(YUV));
+    YUV*yuv2 = (YUV*)rfx_calloc(width*height*sizeof(YUV));
+    int t;
+    srand(0x263);
+    for(t=0;t<width*height;t++) {
+	pic[t].a = rand();
+	pic[t].r = rand();
+	pic[t].g = rand();
+	pic[t].b = rand();
+    }
+    rgb2yuv(yuv1, pic, width, width, width, height);
+    rgb2yuv_c(yuv2, pic, width, width, width, height);
+    assert(!memcmp(yuv1, yuv2, width*height*sizeof(YUV)));
+    for(t=0;t<width*height;t++) {
+	yuv1[t].y = rand();
+	yuv1[t].u = rand();
+	yuv1[t].v = rand();
+    }
+    yuv2rgb(pic1, yuv1, width, width, height);
+    yuv2rgb_c(pic2, yuv1, width, width, height);
+    assert(!memcmp(pic1, pic2, width*height*sizeof(RGBA)));
+    rfx_free(pic);rfx_free(pic1);rfx_free(pic2);
+    rfx_free(yuv1);rfx_free(yuv2);
+}
+
+#ifdef HAVE_PTHREAD_H
+/* analyzing P-Frame blocks in parallel must not change the encoding */
+void test_pframe_threads()
+{
+    int width = 160, height = 96;
+    RGBA*pic1 = (RGBA*)rfx_alloc(width*height*sizeof(RGBA));
+    RGBA*pic2 = (RGBA*)rfx_alloc(width*height*sizeof(RGBA));
+    TAG*tags[2];
+    int x,y,t;
+    for(y=0;y<height;y++)
+    for(x=0;x<width;x++) {
+	pic1[y*width+x].r = x*y;
+	pic1[y*width+x].g = x+y;
+	pic1[y*width+x].b = (x+1)%(y+1);
+	pic2[y*width+x].r = (x+3)*y;
+	pic2[y*width+x].g = x+y+(x>80?40:0);
+	pic2[y*width+x].b = (x+2)%(y+1);
+    }
+    for(t=0;t<2;t++) {
+	VIDEOSTREAM stream;
+	TAG*tag = swf_InsertTag(0, ST_DEFINEVIDEOSTREAM);
+	swf_SetVideoStreamDefine(tag, &stream, 2, width, height);
+	stream.do_motion = 1;
+	stream.threads = t?4:1;
+	swf_DeleteTag(0, tag);
+	tag = swf_InsertTag(0, ST_VIDEOFRAME);
+	swf_SetVideoStreamIFrame(tag, &stream, pic1, 7);
+	swf_ResetTag(tag, ST_VIDEOFRAME);
+	swf_SetVideoStreamPFrame(tag, &stream, pic2, 7);
+	swf_VideoStreamClear(&stream);
+	tags[t] = tag;
+    }
+    assert(tags[0]->len == tags[1]->len);
+    assert(!memcmp(tags[0]->data, tags[1]->data, tags[0]->len));
+    swf_DeleteTag(0, tags[0]);
+    swf_DeleteTag(0, tags[1]);
+    rfx_free(pic1);rfx_free(pic2);
+}
+#endif
+
 #endif
 
 #ifdef MAIN
@@ -1526,6 +1908,11 @@ int main(int argn, char*argv[])
 
 #ifdef TESTS
     test_copy_diff();
+    test_dct();
+    test_yuv();
+#ifdef HAVE_PTHREAD_H
+    test_pframe_threads();
+#endif
 #endif
 
     mkblack();
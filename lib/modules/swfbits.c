@@ -44,6 +44,7 @@ extern "C" {
 #endif // HAVE_JPEGLIB
 
 #include "../rfxswf.h"
+#include "../timer.h"
 
 #define OUTBUFFER_SIZE 0x8000
 
@@ -897,7 +898,8 @@ void swf_SetLosslessImage(TAG*tag, RGBA*data, int width, int height)
     if(num>1 && num<=256) {
 	RGBA*palette = (RGBA*)malloc(sizeof(RGBA)*num);
 	int width2 = BYTES_PER_SCANLINE(width);
-	U8*data2 = (U8*)malloc(width2*height);
+	/* zeroed, so that the padding at the end of the lines is, too */
+	U8*data2 = (U8*)rfx_calloc(width2*height);
 	int len = width*height;
 	int x,y;
 	int r;
@@ -1167,14 +1169,17 @@ TAG* swf_AddImage(TAG*tag, int bitid, RGBA*mem, int width, int height, int quali
     tag1 = swf_InsertTag(0, /*ST_DEFINEBITSLOSSLESS1/2*/0);
     tag1->len = 0x7fffffff;
 #else
+    TIMER_START(t1);
     tag1 = swf_InsertTag(0, /*ST_DEFINEBITSLOSSLESS1/2*/0);
     swf_SetU16(tag1, bitid);
     swf_SetLosslessImage(tag1, mem, width, height);
+    TIMER_STOP(TIMER_ZLIB, t1);
 #endif
 
 #if defined(HAVE_JPEGLIB)
     /* try jpeg image. Notice that if (and only if) we tried the lossless compression
        above, the data will now be premultiplied with alpha. */
+    TIMER_START(t2);
     if(has_alpha) {
 	tag2 = swf_InsertTag(0, ST_DEFINEBITSJPEG3);
 	swf_SetU16(tag2, bitid);
@@ -1184,6 +1189,7 @@ TAG* swf_AddImage(TAG*tag, int bitid, RGBA*mem, int width, int height, int quali
 	swf_SetU16(tag2, bitid);
 	swf_SetJPEGBits2(tag2, width, height, mem, quality);
     }
+    TIMER_STOP(TIMER_JPEG, t2);
 #endif
 
     if(quality>100 || !tag2 || (tag1 && tag1->len < tag2->len)) {
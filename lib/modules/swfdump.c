@@ -99,7 +99,7 @@ void swf_DumpFont(SWFFONT * font)
 
 void swf_DumpShape(SHAPE2*shape2)
 {
-    SHAPELINE*l = shape2->lines;
+    SHAPELINE*l = swf_Shape2GetLines(shape2);
     while(l) {
 	if(l->type == moveTo) {
 	    //printf("fill %d/%d line %d\n", l->fillstyle0, l->fillstyle1, l->linestyle);
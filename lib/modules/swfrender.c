@@ -36,7 +36,7 @@ typedef struct _renderpoint
     float x;
     U32 depth;
 
-    SHAPELINE*shapeline;
+    int fillstyle0, fillstyle1;
     SHAPE2*s;
     
 } renderpoint_t;
@@ -121,7 +121,7 @@ static void add_line(RENDERBUF*buf, double x1, double y1, double x2, double y2,
         int l = sqrt((x2-x1)*(x2-x1) + (y2-y1)*(y2-y1));
         printf(" l[%d - %.2f/%.2f -> %.2f/%.2f]\n", l, x1/20.0, y1/20.0, x2/20.0, y2/20.0);
     }*/
-    assert(p->shapeline);
+    assert(p->fillstyle0 || p->fillstyle1);
 
     y1=y1*i->multiply;
     y2=y2*i->multiply;
@@ -387,9 +387,7 @@ static SHAPE2* linestyle2fillstyle(SHAPE2*shape)
     int t;
     s->numfillstyles = shape->numlinestyles;
     s->fillstyles = (FILLSTYLE*)rfx_calloc(sizeof(FILLSTYLE)*shape->numlinestyles);
-    s->lines = (SHAPELINE*)rfx_calloc(sizeof(SHAPELINE)*shape->numlinestyles);
     for(t=0;t<shape->numlinestyles;t++) {
-        s->lines[t].fillstyle0 = t+1;
         s->fillstyles[t].type = FILL_SOLID;
         s->fillstyles[t].color = shape->linestyles[t].color;
     }
@@ -409,8 +407,10 @@ void swf_RenderShape(RENDERBUF*dest, SHAPE2*shape, MATRIX*m, CXFORM*c, U16 _dept
 {
     renderbuf_internal*i = (renderbuf_internal*)dest->internal;
     
-    SHAPELINE*line;
+    SHAPEREC*line;
+    int num, n;
     int x=0,y=0;
+    int fillstyle0=0, fillstyle1=0, linestyle=0;
     MATRIX mat = *m;
     SHAPE2* s2 = 0;
     SHAPE2* lshape = 0;
@@ -428,7 +428,7 @@ void swf_RenderShape(RENDERBUF*dest, SHAPE2*shape, MATRIX*m, CXFORM*c, U16 _dept
     mat.ty -= dest->posy*20;
 
     s2 = swf_Shape2Clone(shape);
-    line = s2->lines;
+    line = swf_Shape2GetRecords(s2, &num);
     if(shape->numfillstyles) {
         int t;
         p.s = s2;
@@ -454,23 +454,29 @@ void swf_RenderShape(RENDERBUF*dest, SHAPE2*shape, MATRIX*m, CXFORM*c, U16 _dept
     }
 
 
-    while(line)
+    for(n=0;n<num;n++,line++)
     {
         int x1,y1,x2,y2,x3,y3;
 
-        if(line->type == moveTo) {
+        if(line->type == styleChange) {
+            fillstyle0 = line->x;
+            fillstyle1 = line->y;
+            linestyle = line->sx;
+            continue;
+        } else if(line->type == moveTo) {
         } else if(line->type == lineTo) {
             transform_point(&mat, x, y, &x1, &y1);
             transform_point(&mat, line->x, line->y, &x3, &y3);
             
-            if(line->linestyle && ! clipdepth) {
-                lp.shapeline = &lshape->lines[line->linestyle-1];
-                add_solidline(dest, x1, y1, x3, y3, shape->linestyles[line->linestyle-1].width * widthmultiply, &lp);
+            if(linestyle && ! clipdepth) {
+                lp.fillstyle0 = linestyle;
+                add_solidline(dest, x1, y1, x3, y3, shape->linestyles[linestyle-1].width * widthmultiply, &lp);
                 lp.depth++;
             }
-            if(line->fillstyle0 || line->fillstyle1) {
+            if(fillstyle0 || fillstyle1) {
                 assert(shape->numfillstyles);
-		p.shapeline = line;
+		p.fillstyle0 = fillstyle0;
+		p.fillstyle1 = fillstyle1;
                 add_line(dest, x1, y1, x3, y3, &p);
             }
         } else if(line->type == splineTo) {
@@ -492,14 +498,15 @@ void swf_RenderShape(RENDERBUF*dest, SHAPE2*shape, MATRIX*m, CXFORM*c, U16 _dept
                 double nx = (double)(t*t*x3 + 2*t*(parts-t)*x2 + (parts-t)*(parts-t)*x1)/(double)(parts*parts);
                 double ny = (double)(t*t*y3 + 2*t*(parts-t)*y2 + (parts-t)*(parts-t)*y1)/(double)(parts*parts);
                 
-                if(line->linestyle && ! clipdepth) {
-                    lp.shapeline = &lshape->lines[line->linestyle-1];
-                    add_solidline(dest, xx, yy, nx, ny, shape->linestyles[line->linestyle-1].width * widthmultiply, &lp);
+                if(linestyle && ! clipdepth) {
+                    lp.fillstyle0 = linestyle;
+                    add_solidline(dest, xx, yy, nx, ny, shape->linestyles[linestyle-1].width * widthmultiply, &lp);
                     lp.depth++;
                 }
-                if(line->fillstyle0 || line->fillstyle1) {
+                if(fillstyle0 || fillstyle1) {
                     assert(shape->numfillstyles);
-		    p.shapeline = line;
+		    p.fillstyle0 = fillstyle0;
+		    p.fillstyle1 = fillstyle1;
                     add_line(dest, xx, yy, nx, ny, &p);
                 }
 
@@ -509,7 +516,6 @@ void swf_RenderShape(RENDERBUF*dest, SHAPE2*shape, MATRIX*m, CXFORM*c, U16 _dept
         }
         x = line->x;
         y = line->y;
-        line = line->next;
     }
     
     swf_Process(dest, clipdepth);
@@ -832,26 +838,26 @@ static void change_state(int y, state_t* state, renderpoint_t*p)
     layer_t*before=0, *self=0, *after=0;
 
     if(DEBUG&2) { 
-        printf("[(%f,%d)/%d/%d-%d]", p->x, y, p->depth, p->shapeline->fillstyle0, p->shapeline->fillstyle1);
+        printf("[(%f,%d)/%d/%d-%d]", p->x, y, p->depth, p->fillstyle0, p->fillstyle1);
     }
 
     search_layer(state, p->depth, &before, &self, &after);
 
     if(self) {
         /* shape update */
-        if(self->fillid<0/*??*/ || !p->shapeline->fillstyle0 || !p->shapeline->fillstyle1) {
+        if(self->fillid<0/*??*/ || !p->fillstyle0 || !p->fillstyle1) {
             /* filling ends */
             if(DEBUG&2) printf("<D>");
             
             delete_layer(state, self);
         } else { 
             /*both fill0 and fill1 are set- exchange the two, updating the layer */
-            if(self->fillid == p->shapeline->fillstyle0) {
-                self->fillid = p->shapeline->fillstyle1;
+            if(self->fillid == p->fillstyle0) {
+                self->fillid = p->fillstyle1;
                 self->p = p;
                 if(DEBUG&2) printf("<X>");
-            } else if(self->fillid == p->shapeline->fillstyle1) {
-                self->fillid = p->shapeline->fillstyle0;
+            } else if(self->fillid == p->fillstyle1) {
+                self->fillid = p->fillstyle0;
                 self->p = p;
                 if(DEBUG&2) printf("<X>");
             } else {
@@ -863,7 +869,7 @@ static void change_state(int y, state_t* state, renderpoint_t*p)
         return;
     } else {
         layer_t* n = 0;
-        if(p->shapeline && p->shapeline->fillstyle0 && p->shapeline->fillstyle1) {
+        if(p->fillstyle0 && p->fillstyle1) {
             /* this is a hack- a better way would be to make sure that
                we always get (0,32), (32, 33), (33, 0) in the right order if
                they happen to fall on the same pixel.
@@ -878,7 +884,7 @@ static void change_state(int y, state_t* state, renderpoint_t*p)
 
         if(DEBUG&2) printf("<+>");
 
-	n->fillid = p->shapeline->fillstyle0 ? p->shapeline->fillstyle0 : p->shapeline->fillstyle1;
+	n->fillid = p->fillstyle0 ? p->fillstyle0 : p->fillstyle1;
 	n->p = p;
 
         add_layer(state, before, n);
@@ -931,10 +937,9 @@ void swf_Process(RENDERBUF*dest, U32 clipdepth)
 	/* resort points */
 	/*if(y==884) {
 	    for(n=0;n<num;n++) {
-		printf("%f (%d/%d) %d\n", points[n].x, 
-			points[n].shapeline->fillstyle0,
-			points[n].shapeline->fillstyle1,
-			points[n].shapeline->linestyle);
+		printf("%f (%d/%d)\n", points[n].x, 
+			points[n].fillstyle0,
+			points[n].fillstyle1);
 	    }
 	}*/
 
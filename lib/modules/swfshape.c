@@ -486,6 +486,136 @@ int swf_ShapeSetCurve(TAG * t,SHAPE * s,S32 x,S32 y,S32 ax,S32 ay)
     return 0;
 }
 
+/* number of significant bits in v, i.e. 32 minus the leading zeros */
+static inline int bitlength(U32 v)
+{
+#ifdef __GNUC__
+    return v?32-__builtin_clz(v):0;
+#else
+    int n = 0;
+    while(v) {v>>=1;n++;}
+    return n;
+#endif
+}
+
+/* bits needed to store v as a signed value, same as swf_CountBits(v,0) for
+   everything but 0, which is no concern for edges (they use at least 2 bits) */
+#define SBITS(v) ((v)^((v)>>31))
+
+/* worst case for one edge which doesn't need to be split: 2+4+4*17 bits.
+   RESERVE() needs one more byte on top of that, for the partially filled
+   byte LOAD_STATE() takes back from the tag. */
+#define EDGE_MAXBYTES 10
+
+/* Appends a run of straight and curved edges to a shape. The output is
+   exactly the same as calling swf_ShapeSetLine()/swf_ShapeSetCurve() for every
+   edge, but the bit widths are computed in one go and the records are
+   packed into the tag through a 64 bit accumulator instead of one
+   swf_SetBits() call per field. */
+int swf_ShapeSetEdges(TAG * t,SHAPE * s,SHAPEEDGE * edges,int num)
+{
+    U8 bits[256];
+    U64 acc = 0;
+    int accbits = 0;
+    U8*out;
+    int len;
+    int i,start;
+
+    if(!t) return -1;
+    if(num<=0) return 0;
+
+#define LOAD_STATE() \
+    if(t->writeBit) { \
+	/* continue the partially filled last byte */ \
+	accbits = 8 - bitlength(t->writeBit); \
+	acc = t->data[--t->len] >> (8-accbits); \
+    } else { \
+	accbits = 0; acc = 0; \
+    } \
+    len = t->len;
+#define RESERVE(n) \
+    if(len + (n) > t->memsize) { \
+	t->len = len; \
+	swf_SetBlock(t, 0, (n)); \
+	t->len -= (n); \
+    } \
+    out = t->data;
+#define STORE_STATE() \
+    if(accbits) { \
+	out[len++] = (U8)(acc<<(8-accbits)); \
+	t->writeBit = 0x80>>accbits; \
+    } else { \
+	t->writeBit = 0; \
+    } \
+    t->len = len;
+#define PUT(v,n) \
+    { acc = (acc<<(n)) | ((U32)(v) & (U32)(((U64)1<<(n))-1)); \
+      accbits += (n); \
+      while(accbits>=8) { accbits -= 8; out[len++] = (U8)(acc>>accbits); } }
+
+    LOAD_STATE();
+    for(start=0;start<num;start+=256) {
+	int count = num-start<256?num-start:256;
+	SHAPEEDGE*e = &edges[start];
+
+	/* bit widths */
+	for(i=0;i<count;i++) {
+	    U32 m = SBITS(e[i].x) | SBITS(e[i].y);
+	    if(e[i].curve)
+		m |= SBITS(e[i].ax) | SBITS(e[i].ay);
+	    int b = bitlength(m)+1;
+	    bits[i] = b<2?2:b;
+	}
+
+	RESERVE(count*EDGE_MAXBYTES+1);
+	for(i=0;i<count;i++) {
+	    S32 x = e[i].x, y = e[i].y;
+	    int b = bits[i];
+	    if(b >= 18) {
+		/* too long- let the single edge functions split it (or warn) */
+		STORE_STATE();
+		if(e[i].curve) swf_ShapeSetCurve(t, s, x, y, e[i].ax, e[i].ay);
+		else           swf_ShapeSetLine(t, s, x, y);
+		LOAD_STATE();
+		RESERVE((count-i)*EDGE_MAXBYTES+1);
+		continue;
+	    }
+	    if(e[i].curve) {
+		PUT(2,2); // Curved Edge
+		PUT(b-2,4);
+		PUT(x,b);
+		PUT(y,b);
+		PUT(e[i].ax,b);
+		PUT(e[i].ay,b);
+	    } else if(x!=0 && y!=0) {
+		PUT(3,2); // Straight Edge
+		PUT(b-2,4);
+		PUT(1,1); // Diagonal
+		PUT(x,b);
+		PUT(y,b);
+	    } else if(x==0) {
+		PUT(3,2);
+		PUT(b-2,4);
+		PUT(1,2); // Vertical
+		PUT(y,b);
+	    } else {
+		PUT(3,2);
+		PUT(b-2,4);
+		PUT(0,2); // Horizontal
+		PUT(x,b);
+	    }
+	}
+    }
+    STORE_STATE();
+#undef LOAD_STATE
+#undef RESERVE
+#undef STORE_STATE
+#undef PUT
+    return 0;
+}
+#undef SBITS
+#undef EDGE_MAXBYTES
+
 int swf_ShapeSetCircle(TAG * t,SHAPE * s,S32 x,S32 y,S32 rx,S32 ry)
 { double C1 = 0.2930;    
   double C2 = 0.4140;   
@@ -646,11 +776,21 @@ char swf_ShapeIsEmpty(SHAPE*s)
     return 1;
 }
 
+static SHAPEREC* addrecord(SHAPEREC**recs, int*num, int*size)
+{
+    if(*num == *size) {
+	*size = *size?(*size)*2:64;
+	*recs = (SHAPEREC*)rfx_realloc(*recs, sizeof(SHAPEREC)*(*size));
+    }
+    return &(*recs)[(*num)++];
+}
+
 /* todo: merge this with swf_GetSimpleShape */
-static SHAPELINE* swf_ParseShapeData(U8*data, int bits, int fillbits, int linebits, int version, SHAPE2*shape2)
+static SHAPEREC* swf_ParseShapeRecords(U8*data, int bits, int fillbits, int linebits, int version, SHAPE2*shape2, int*num)
 {
-    SHAPELINE _lines;
-    SHAPELINE*lines = &_lines;
+    SHAPEREC*recs = 0;
+    SHAPEREC*r;
+    int size = 0;
 
     TAG _tag;
     TAG* tag = &_tag;
@@ -667,7 +807,11 @@ static SHAPELINE* swf_ParseShapeData(U8*data, int bits, int fillbits, int linebi
     tag->pos = 0;
     tag->id = version==1?ST_DEFINESHAPE:(version==2?ST_DEFINESHAPE2:(version==3?ST_DEFINESHAPE3:ST_DEFINESHAPE4));
 
-    lines->next = 0;
+    /* an edge needs at least 10 bits */
+    size = bits/32 + 16;
+    recs = (SHAPEREC*)rfx_alloc(sizeof(SHAPEREC)*size);
+    *num = 0;
+
     while(1) {
 	int flags;
 	flags = swf_GetBits(tag, 1);
@@ -693,23 +837,29 @@ static SHAPELINE* swf_ParseShapeData(U8*data, int bits, int fillbits, int linebi
 		} else {
 		    linestyleadd = shape2->numlinestyles;
 		    fillstyleadd = shape2->numfillstyles;
-		    if(!parseFillStyleArray(tag, shape2))
+		    if(!parseFillStyleArray(tag, shape2)) {
+			rfx_free(recs);
+			*num = 0;
 			return 0;
+		    }
 		}
 		fillbits = swf_GetBits(tag, 4);
 		linebits = swf_GetBits(tag, 4);
 	    }
+	    if(flags&(2|4|8)) {
+		r = addrecord(&recs, num, &size);
+		r->type = styleChange;
+		r->x = fill0;
+		r->y = fill1;
+		r->sx = line;
+		r->sy = 0;
+	    }
 	    if(flags&1) { //move
-		lines->next = (SHAPELINE*)rfx_alloc(sizeof(SHAPELINE));
-		lines = lines->next;
-		lines->type = moveTo;
-		lines->x = x; 
-		lines->y = y; 
-		lines->sx = lines->sy = 0;
-		lines->fillstyle0 = fill0;
-		lines->fillstyle1 = fill1;
-		lines->linestyle = line;
-		lines->next = 0;
+		r = addrecord(&recs, num, &size);
+		r->type = moveTo;
+		r->x = x; 
+		r->y = y; 
+		r->sx = r->sy = 0;
 	    }
 	} else {
 	    flags = swf_GetBits(tag, 1);
@@ -725,52 +875,167 @@ static SHAPELINE* swf_ParseShapeData(U8*data, int bits, int fillbits, int linebi
 		    if(v) y += d;
 		    else  x += d;
 		}
-		lines->next = (SHAPELINE*)rfx_alloc(sizeof(SHAPELINE));
-		lines = lines->next;
-		lines->type = lineTo;
-		lines->x = x; 
-		lines->y = y; 
-		lines->sx = lines->sy = 0;
-		lines->fillstyle0 = fill0;
-		lines->fillstyle1 = fill1;
-		lines->linestyle = line;
-		lines->next = 0;
+		r = addrecord(&recs, num, &size);
+		r->type = lineTo;
+		r->x = x; 
+		r->y = y; 
+		r->sx = r->sy = 0;
 	    } else { //curved edge
 		int n = swf_GetBits(tag, 4) + 2;
-		int x1,y1;
+		r = addrecord(&recs, num, &size);
+		r->type = splineTo;
 		x += swf_GetSBits(tag, n);
 		y += swf_GetSBits(tag, n);
-		x1 = x;
-		y1 = y;
+		r->sx = x;
+		r->sy = y;
 		x += swf_GetSBits(tag, n);
 		y += swf_GetSBits(tag, n);
-
-		lines->next = (SHAPELINE*)rfx_alloc(sizeof(SHAPELINE));
-		lines = lines->next;
-		lines->type = splineTo;
-		lines->sx = x1; 
-		lines->sy = y1; 
-		lines->x = x; 
-		lines->y = y; 
-		lines->fillstyle0 = fill0;
-		lines->fillstyle1 = fill1;
-		lines->linestyle = line;
-		lines->next = 0;
+		r->x = x; 
+		r->y = y; 
 	    }
 	}
     }
+    return recs;
+}
+
+static SHAPELINE* records2lines(SHAPEREC*r, int num)
+{
+    SHAPELINE _lines;
+    SHAPELINE*lines = &_lines;
+    int fill0 = 0, fill1 = 0, line = 0;
+    int t;
+    lines->next = 0;
+    for(t=0;t<num;t++) {
+	if(r[t].type == styleChange) {
+	    fill0 = r[t].x;
+	    fill1 = r[t].y;
+	    line = r[t].sx;
+	    continue;
+	}
+	lines->next = (SHAPELINE*)rfx_alloc(sizeof(SHAPELINE));
+	lines = lines->next;
+	lines->type = (enum SHAPELINETYPE)r[t].type;
+	lines->x = r[t].x;
+	lines->y = r[t].y;
+	lines->sx = r[t].sx;
+	lines->sy = r[t].sy;
+	lines->fillstyle0 = fill0;
+	lines->fillstyle1 = fill1;
+	lines->linestyle = line;
+	lines->next = 0;
+    }
     return _lines.next;
 }
 
+static SHAPEREC* lines2records(SHAPELINE*l, int*num)
+{
+    SHAPEREC*recs = 0;
+    SHAPEREC*r;
+    int size = 0;
+    int fill0 = 0, fill1 = 0, line = 0;
+    *num = 0;
+    while(l) {
+	if(l->fillstyle0 != fill0 || l->fillstyle1 != fill1 || l->linestyle != line) {
+	    fill0 = l->fillstyle0;
+	    fill1 = l->fillstyle1;
+	    line = l->linestyle;
+	    r = addrecord(&recs, num, &size);
+	    r->type = styleChange;
+	    r->x = fill0;
+	    r->y = fill1;
+	    r->sx = line;
+	    r->sy = 0;
+	}
+	r = addrecord(&recs, num, &size);
+	r->type = l->type;
+	r->x = l->x;
+	r->y = l->y;
+	r->sx = l->sx;
+	r->sy = l->sy;
+	l = l->next;
+    }
+    return recs;
+}
+
+static void free_lines(SHAPELINE* lines)
+{
+    while(lines) {
+	SHAPELINE*next = lines->next;
+	rfx_free(lines);
+	lines = next;
+    }
+}
+
+static SHAPELINE* swf_ParseShapeData(U8*data, int bits, int fillbits, int linebits, int version, SHAPE2*shape2)
+{
+    int num;
+    SHAPEREC*recs = swf_ParseShapeRecords(data, bits, fillbits, linebits, version, shape2, &num);
+    SHAPELINE*lines = records2lines(recs, num);
+    if(recs) rfx_free(recs);
+    return lines;
+}
+
+SHAPELINE* swf_Shape2GetLines(SHAPE2*shape)
+{
+    if(shape->records) {
+	free_lines(shape->lines);
+	shape->lines = records2lines(shape->records, shape->numrecords);
+	rfx_free(shape->records);
+	shape->records = 0;
+	shape->numrecords = 0;
+    }
+    return shape->lines;
+}
+
+SHAPEREC* swf_Shape2GetRecords(SHAPE2*shape, int*num)
+{
+    if(!shape->records && shape->lines) {
+	shape->records = lines2records(shape->lines, &shape->numrecords);
+	free_lines(shape->lines);
+	shape->lines = 0;
+    }
+    if(num) *num = shape->numrecords;
+    return shape->records;
+}
+
+static inline void bbox_add(SRECT*r, int x, int y, int t1)
+{
+    if(x - t1 < r->xmin) r->xmin = x - t1;
+    if(y - t1 < r->ymin) r->ymin = y - t1;
+    if(x + t1 > r->xmax) r->xmax = x + t1;
+    if(y + t1 > r->ymax) r->ymax = y + t1;
+}
+
 SRECT swf_GetShapeBoundingBox(SHAPE2*shape2)
 {
     SRECT r;
     SHAPELINE*l = shape2->lines;
     int lastx=0,lasty=0;
     int valid = 0;
+    int t;
     r.xmin = r.ymin = SCOORD_MAX;
     r.xmax = r.ymax = SCOORD_MIN;
 
+    if(shape2->records) {
+	int t1 = 0;
+	for(t=0;t<shape2->numrecords;t++) {
+	    SHAPEREC*rec = &shape2->records[t];
+	    if(rec->type == styleChange) {
+		t1 = rec->sx>0 ? shape2->linestyles[rec->sx - 1].width*3/2 : 0;
+		continue;
+	    }
+	    if(rec->type == lineTo || rec->type == splineTo) {
+		valid = 1;
+		bbox_add(&r, lastx, lasty, t1);
+		bbox_add(&r, rec->x, rec->y, t1);
+		if(rec->type == splineTo)
+		    bbox_add(&r, rec->sx, rec->sy, t1);
+	    }
+	    lastx = rec->x;
+	    lasty = rec->y;
+	}
+    }
+
     while(l) {
 	int t1;
 	if(l->linestyle>0) {
@@ -782,20 +1047,10 @@ SRECT swf_GetShapeBoundingBox(SHAPE2*shape2)
 	if(l->type == lineTo || l->type == splineTo)
 	{
 	    valid = 1;
-	    if(lastx - t1 < r.xmin) r.xmin = lastx - t1;
-	    if(lasty - t1 < r.ymin) r.ymin = lasty - t1;
-	    if(lastx + t1 > r.xmax) r.xmax = lastx + t1;
-	    if(lasty + t1 > r.ymax) r.ymax = lasty + t1;
-	    if(l->x - t1 < r.xmin) r.xmin = l->x - t1;
-	    if(l->y - t1 < r.ymin) r.ymin = l->y - t1;
-	    if(l->x + t1 > r.xmax) r.xmax = l->x + t1;
-	    if(l->y + t1 > r.ymax) r.ymax = l->y + t1;
-	    if(l->type == splineTo) {
-		if(l->sx - t1 < r.xmin) r.xmin = l->sx - t1;
-		if(l->sy - t1 < r.ymin) r.ymin = l->sy - t1;
-		if(l->sx + t1 > r.xmax) r.xmax = l->sx + t1;
-		if(l->sy + t1 > r.ymax) r.ymax = l->sy + t1;
-	    }
+	    bbox_add(&r, lastx, lasty, t1);
+	    bbox_add(&r, l->x, l->y, t1);
+	    if(l->type == splineTo)
+		bbox_add(&r, l->sx, l->sy, t1);
 	}
 	lastx = l->x;
 	lasty = l->y;
@@ -807,13 +1062,12 @@ SRECT swf_GetShapeBoundingBox(SHAPE2*shape2)
 
 void swf_Shape2Free(SHAPE2 * s)
 {
-    SHAPELINE*line = s->lines;
+    free_lines(s->lines);
     s->lines = 0;
-    while(line) {
-	SHAPELINE*next = line->next;
-	line->next = 0;
-	rfx_free(line);
-	line = next;
+    if(s->records) {
+	rfx_free(s->records);
+	s->records = 0;
+	s->numrecords = 0;
     }
 
     if(s->linestyles) {
@@ -852,6 +1106,10 @@ SHAPE2* swf_Shape2Clone(SHAPE2 * s)
         prev = line2;
 	line = line->next;
     }
+    if(s->records) {
+	s2->records = (SHAPEREC*)rfx_alloc(sizeof(SHAPEREC)*s->numrecords);
+	memcpy(s2->records, s->records, sizeof(SHAPEREC)*s->numrecords);
+    }
     if(s->bbox) {
         s2->bbox = (SRECT*)rfx_alloc(sizeof(SRECT));
         memcpy(s2->bbox, s->bbox, sizeof(SRECT));
@@ -973,8 +1231,10 @@ void swf_ShapeSetRectangleWithBorder(TAG*tag, U16 shapeid, int width, int height
 void swf_Shape2ToShape(SHAPE2*shape2, SHAPE*shape)
 {
     TAG*tag = swf_InsertTag(0,0);
-    SHAPELINE*l;
+    SHAPEREC*l;
+    int num, t;
     int newx=0,newy=0,lastx=0,lasty=0,oldls=0,oldfs0=0,oldfs1=0;
+    int linestyle=0,fillstyle0=0,fillstyle1=0;
 
     memset(shape, 0, sizeof(SHAPE));
 
@@ -988,15 +1248,21 @@ void swf_Shape2ToShape(SHAPE2*shape2, SHAPE*shape)
 
     swf_ShapeCountBits(shape,NULL,NULL);
 
-    l = shape2->lines;
+    l = swf_Shape2GetRecords(shape2, &num);
 
-    while(l) {
+    for(t=0;t<num;t++,l++) {
 	int ls=0,fs0=0,fs1=0;
 
+	if(l->type == styleChange) {
+	    fillstyle0 = l->x;
+	    fillstyle1 = l->y;
+	    linestyle = l->sx;
+	    continue;
+	}
 	if(l->type != moveTo) {
-	    if(oldls != l->linestyle) {oldls = ls = l->linestyle;if(!ls) ls=0x8000;}
-	    if(oldfs0 != l->fillstyle0) {oldfs0 = fs0 = l->fillstyle0;if(!fs0) fs0=0x8000;}
-	    if(oldfs1 != l->fillstyle1) {oldfs1 = fs1 = l->fillstyle1;if(!fs1) fs1=0x8000;}
+	    if(oldls != linestyle) {oldls = ls = linestyle;if(!ls) ls=0x8000;}
+	    if(oldfs0 != fillstyle0) {oldfs0 = fs0 = fillstyle0;if(!fs0) fs0=0x8000;}
+	    if(oldfs1 != fillstyle1) {oldfs1 = fs1 = fillstyle1;if(!fs1) fs1=0x8000;}
 
 	    if(ls || fs0 || fs1 || newx!=0x7fffffff || newy!=0x7fffffff) {
 		swf_ShapeSetAll(tag,shape,newx,newy,ls,fs0,fs1);
@@ -1017,7 +1283,6 @@ void swf_Shape2ToShape(SHAPE2*shape2, SHAPE*shape)
 
 	lastx = l->x;
 	lasty = l->y;
-	l = l->next;
     }
     swf_ShapeSetEnd(tag);
     shape->data = tag->data;
@@ -1042,7 +1307,6 @@ void swf_ParseDefineShape(TAG*tag, SHAPE2*shape)
 {
     int num = 0, id;
     U16 fill,line;
-    SHAPELINE*l;
     if(tag->id == ST_DEFINESHAPE)
 	num = 1;
     else if(tag->id == ST_DEFINESHAPE2)
@@ -1078,16 +1342,7 @@ void swf_ParseDefineShape(TAG*tag, SHAPE2*shape)
 	fprintf(stderr, "fill/line bits are both zero\n");
     }
 
-    shape->lines = swf_ParseShapeData(&tag->data[tag->pos], (tag->len - tag->pos)*8, fill, line, num, shape);
-
-    l = shape->lines;
-}
-
-static void free_lines(SHAPELINE* lines)
-{
-    if (lines->next)
-        free_lines(lines->next);
-    free(lines);
+    shape->records = swf_ParseShapeRecords(&tag->data[tag->pos], (tag->len - tag->pos)*8, fill, line, num, shape, &shape->numrecords);
 }
 
 void swf_RecodeShapeData(U8*data, int bitlen, int in_bits_fill, int in_bits_line, 
@@ -1095,25 +1350,26 @@ void swf_RecodeShapeData(U8*data, int bitlen, int in_bits_fill, int in_bits_line
 {
     SHAPE2 s2;
     SHAPE s;
-    SHAPELINE*line;
+    int t;
     memset(&s2, 0, sizeof(s2));
-    s2.lines = swf_ParseShapeData(data, bitlen, in_bits_fill, in_bits_line, 1, 0);
+    s2.records = swf_ParseShapeRecords(data, bitlen, in_bits_fill, in_bits_line, 1, 0, &s2.numrecords);
     s2.numfillstyles = out_bits_fill?1<<(out_bits_fill-1):0;
     s2.numlinestyles = out_bits_line?1<<(out_bits_line-1):0;
     s2.fillstyles = (FILLSTYLE*)rfx_calloc(sizeof(FILLSTYLE)*s2.numfillstyles);
     s2.linestyles = (LINESTYLE*)rfx_calloc(sizeof(LINESTYLE)*s2.numlinestyles);
 
-    line = s2.lines;
-    while(line) {
-        if(line->fillstyle0 > s2.numfillstyles) line->fillstyle0 = 0;
-        if(line->fillstyle1 > s2.numfillstyles) line->fillstyle1 = 0;
-        if(line->linestyle > s2.numlinestyles) line->linestyle = 0;
-        line = line->next;
+    for(t=0;t<s2.numrecords;t++) {
+        SHAPEREC*r = &s2.records[t];
+        if(r->type != styleChange)
+            continue;
+        if(r->x > s2.numfillstyles) r->x = 0;
+        if(r->y > s2.numfillstyles) r->y = 0;
+        if(r->sx > s2.numlinestyles) r->sx = 0;
     }
 
     swf_Shape2ToShape(&s2,&s);
 
-    free_lines(s2.lines);
+    if(s2.records) rfx_free(s2.records);
     free(s2.fillstyles);
     free(s2.linestyles);
     free(s.fillstyle.data);
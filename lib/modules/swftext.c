@@ -23,6 +23,9 @@
    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
 
 #include "../rfxswf.h"
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 U32 readUTF8char(U8 ** text)
 {
@@ -227,6 +230,19 @@ int swf_FontExtract_DefineFontInfo(int id, SWFFONT * f, TAG * t)
     return id;
 }
 
+/* like strdup(swf_GetString()), but doesn't append a zero byte
+   to the tag if the last string isn't terminated */
+static char* font_getstring(TAG * tag)
+{
+    int pos = tag->pos;
+    char*s;
+    while (tag->pos < tag->len && swf_GetU8(tag));
+    s = (char*)rfx_alloc(tag->pos - pos + 1);
+    memcpy(s, &tag->data[pos], tag->pos - pos);
+    s[tag->pos - pos] = 0;
+    return s;
+}
+
 int swf_FontExtract_GlyphNames(int id, SWFFONT * f, TAG * tag)
 {
     U16 fid;
@@ -239,7 +255,7 @@ int swf_FontExtract_GlyphNames(int id, SWFFONT * f, TAG * tag)
 	int t;
 	f->glyphnames = (char**)rfx_alloc(sizeof(char *) * num);
 	for (t = 0; t < num; t++) {
-	    f->glyphnames[t] = strdup(swf_GetString(tag));
+	    f->glyphnames[t] = font_getstring(tag);
 	}
     }
     return id;
@@ -582,6 +598,9 @@ int swf_FontExtract(SWF * swf, int id, SWFFONT * *font)
 {
     TAG *t;
     SWFFONT *f;
+    TAG **refs = 0;
+    int numrefs = 0, ref = 0;
+    char indexed = 0;
 
     if ((!swf) || (!font))
 	return -1;
@@ -589,9 +608,22 @@ int swf_FontExtract(SWF * swf, int id, SWFFONT * *font)
     f = (SWFFONT *) rfx_calloc(sizeof(SWFFONT));
 
     t = swf->firstTag;
+    if (swf->index && id > 0) {
+	/* only look at the font definition and the tags using the font */
+	indexed = 1;
+	t = swf_IndexGetDefiningTag(swf, id);
+	refs = swf_IndexGetReferences(swf, id, &numrefs);
+	if (t && !swf_isFontTag(t))
+	    t = 0;
+    }
 
     while (t) {
 	int nid = 0;
+	/* parse a copy of the tag, so that the read position of the
+	   tag itself isn't touched, and several fonts can be extracted
+	   at the same time (see swf_TextIndexSWF) */
+	TAG tag = *t;
+	t = &tag;
 	switch (swf_GetTagID(t)) {
 	case ST_DEFINEFONT:
 	    nid = swf_FontExtract_DefineFont(id, f, t);
@@ -626,7 +658,15 @@ int swf_FontExtract(SWF * swf, int id, SWFFONT * *font)
 	}
 	if (nid > 0)
 	    id = nid;
-	t = swf_NextTag(t);
+	if (indexed)
+	    t = ref < numrefs ? refs[ref++] : 0;
+	else
+	    t = swf_NextTag(t);
+    }
+    if (indexed && f->version>=3 && f->layout && !f->use && swf_IndexGetNumTexts(swf)) {
+	/* we skipped the text tags which don't use this font. Scanning
+	   them would still have initialized the usage table. */
+	swf_FontInitUsage(f);
     }
     if (f->id != id) {
 	rfx_free(f);
@@ -636,6 +676,255 @@ int swf_FontExtract(SWF * swf, int id, SWFFONT * *font)
     return 0;
 }
 
+typedef struct _textindexjob {
+    SWF*swf;
+    SWFTEXTINDEX*index;
+    TAG**tags;
+    int num;
+    int next;
+    char texts; // 0 = extract fonts, 1 = parse texts
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_t mutex;
+#endif
+} textindexjob_t;
+
+typedef struct _textruns {
+    SWFTEXTINDEX*index;
+    SWFTEXT*text;
+    int size;
+} textruns_t;
+
+static void textindex_addrun(void *self, int *chars, int *xpos, int nr,
+	                     int fontid, int fontsize, int xstart, int ystart, RGBA * color)
+{
+    textruns_t*r = (textruns_t*)self;
+    SWFTEXT*text = r->text;
+    SWFTEXTRUN*run;
+    SWFFONT*font = fontid>=0?swf_TextIndexGetFont(r->index, fontid):0;
+    int t;
+    if(text->numruns == r->size) {
+	r->size = r->size?r->size*2:4;
+	text->runs = (SWFTEXTRUN*)rfx_realloc(text->runs, r->size*sizeof(SWFTEXTRUN));
+    }
+    run = &text->runs[text->numruns++];
+    run->fontid = fontid;
+    run->font = font;
+    run->fontsize = fontsize;
+    run->color = *color;
+    run->x = xstart;
+    run->y = ystart;
+    run->num = nr;
+    /* one block for all three arrays */
+    run->glyphs = (int*)rfx_alloc(nr*(sizeof(int)*2+sizeof(U32))+1);
+    run->xpos = run->glyphs + nr;
+    run->unicode = (U32*)(run->xpos + nr);
+    memcpy(run->glyphs, chars, nr*sizeof(int));
+    memcpy(run->xpos, xpos, nr*sizeof(int));
+    for(t=0;t<nr;t++) {
+	int c = chars[t];
+	if(font && font->glyph2ascii && c>=0 && c<font->numchars && font->glyph2ascii[c])
+	    run->unicode[t] = font->glyph2ascii[c];
+	else
+	    run->unicode[t] = c;
+    }
+}
+
+static void textindex_do(textindexjob_t*job, int nr)
+{
+    SWFTEXTINDEX*index = job->index;
+    /* the other threads might be reading the same tag */
+    TAG tag = *job->tags[nr];
+    TAG*t = &tag;
+    t->pos = 0;
+    t->readBit = 0;
+    if(!job->texts) {
+	swf_FontExtract(job->swf, swf_GetDefineID(t), &index->fonts[nr]);
+    } else {
+	SWFTEXT*text = &index->texts[nr];
+	textruns_t r;
+	r.index = index;
+	r.text = text;
+	r.size = 0;
+	text->id = swf_GetU16(t);
+	swf_GetRect(t, NULL);
+	swf_ResetReadBits(t);
+	swf_GetMatrix(t, &text->matrix);
+	swf_ParseDefineText(t, textindex_addrun, &r);
+    }
+}
+
+static void* textindex_thread(void*_job)
+{
+    textindexjob_t*job = (textindexjob_t*)_job;
+    while(1) {
+	int nr;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&job->mutex);
+#endif
+	nr = job->next++;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&job->mutex);
+#endif
+	if(nr >= job->num)
+	    break;
+	textindex_do(job, nr);
+    }
+    return 0;
+}
+
+static void textindex_run(textindexjob_t*job, int threads)
+{
+    job->next = 0;
+#ifdef HAVE_PTHREAD_H
+    if(threads > job->num)
+	threads = job->num;
+    if(threads > 1) {
+	pthread_t*t = (pthread_t*)rfx_alloc(threads*sizeof(pthread_t));
+	int i, num;
+	for(i=0;i<threads;i++) {
+	    if(pthread_create(&t[i], 0, textindex_thread, job))
+		break;
+	}
+	num = i;
+	if(!num) {
+	    /* couldn't start any threads- do it ourselves */
+	    textindex_thread(job);
+	}
+	for(i=0;i<num;i++)
+	    pthread_join(t[i], 0);
+	rfx_free(t);
+	return;
+    }
+#endif
+    textindex_thread(job);
+}
+
+SWFTEXTINDEX* swf_TextIndexSWF(SWF * swf, int threads)
+{
+    SWFTEXTINDEX*index;
+    textindexjob_t job;
+    TAG**fonttags, **texttags;
+    TAG*tag;
+    char ownindex = 0;
+    int t, numfonts = 0, numtexts = 0, numruns = 0;
+
+    if(!swf)
+	return 0;
+    index = (SWFTEXTINDEX*)rfx_calloc(sizeof(SWFTEXTINDEX));
+    index->id2font = (int*)rfx_calloc(65536*sizeof(int));
+    index->id2text = (int*)rfx_calloc(65536*sizeof(int));
+
+    /* one pass over the tags, to find the font and text definitions */
+    for(tag=swf->firstTag;tag;tag=tag->next) {
+	if(swf_GetTagID(tag) == ST_DEFINEFONT ||
+	   swf_GetTagID(tag) == ST_DEFINEFONT2 ||
+	   swf_GetTagID(tag) == ST_DEFINEFONT3)
+	    numfonts++;
+	else if(swf_isTextTag(tag))
+	    numtexts++;
+    }
+    fonttags = (TAG**)rfx_alloc(numfonts*sizeof(TAG*)+1);
+    texttags = (TAG**)rfx_alloc(numtexts*sizeof(TAG*)+1);
+    numfonts = numtexts = 0;
+    for(tag=swf->firstTag;tag;tag=tag->next) {
+	if(swf_GetTagID(tag) == ST_DEFINEFONT ||
+	   swf_GetTagID(tag) == ST_DEFINEFONT2 ||
+	   swf_GetTagID(tag) == ST_DEFINEFONT3)
+	    fonttags[numfonts++] = tag;
+	else if(swf_isTextTag(tag))
+	    texttags[numtexts++] = tag;
+    }
+
+    /* swf_FontExtract only looks at the tags of a font if there's an index */
+    if(!swf->index && numfonts) {
+	swf_IndexSWF(swf);
+	ownindex = 1;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.swf = swf;
+    job.index = index;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_init(&job.mutex, 0);
+#endif
+
+    /* fonts first, as the texts need them to resolve their characters */
+    index->fonts = (SWFFONT**)rfx_calloc(numfonts*sizeof(SWFFONT*)+1);
+    job.tags = fonttags;
+    job.num = numfonts;
+    job.texts = 0;
+    textindex_run(&job, threads);
+    for(t=0;t<numfonts;t++) {
+	SWFFONT*f = index->fonts[t];
+	if(!f)
+	    continue;
+	index->fonts[index->numfonts++] = f;
+	if(!index->id2font[f->id])
+	    index->id2font[f->id] = index->numfonts;
+    }
+
+    index->texts = (SWFTEXT*)rfx_calloc(numtexts*sizeof(SWFTEXT)+1);
+    index->numtexts = numtexts;
+    job.tags = texttags;
+    job.num = numtexts;
+    job.texts = 1;
+    textindex_run(&job, threads);
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_destroy(&job.mutex);
+#endif
+
+    /* move the runs of all texts into one array */
+    for(t=0;t<numtexts;t++) {
+	numruns += index->texts[t].numruns;
+	if(!index->id2text[index->texts[t].id])
+	    index->id2text[index->texts[t].id] = t+1;
+    }
+    index->runs = (SWFTEXTRUN*)rfx_alloc(numruns*sizeof(SWFTEXTRUN)+1);
+    for(t=0;t<numtexts;t++) {
+	SWFTEXT*text = &index->texts[t];
+	if(text->numruns)
+	    memcpy(&index->runs[index->numruns], text->runs, text->numruns*sizeof(SWFTEXTRUN));
+	rfx_free(text->runs);
+	text->runs = &index->runs[index->numruns];
+	index->numruns += text->numruns;
+    }
+
+    if(ownindex)
+	swf_IndexFree(swf);
+    rfx_free(fonttags);
+    rfx_free(texttags);
+    return index;
+}
+
+SWFFONT* swf_TextIndexGetFont(SWFTEXTINDEX * index, U16 id)
+{
+    int nr = index->id2font[id];
+    return nr?index->fonts[nr-1]:0;
+}
+
+SWFTEXT* swf_TextIndexGetText(SWFTEXTINDEX * index, U16 id)
+{
+    int nr = index->id2text[id];
+    return nr?&index->texts[nr-1]:0;
+}
+
+void swf_TextIndexFree(SWFTEXTINDEX * index)
+{
+    int t;
+    if(!index)
+	return;
+    for(t=0;t<index->numruns;t++)
+	rfx_free(index->runs[t].glyphs);
+    for(t=0;t<index->numfonts;t++)
+	swf_FontFree(index->fonts[t]);
+    rfx_free(index->runs);
+    rfx_free(index->texts);
+    rfx_free(index->fonts);
+    rfx_free(index->id2font);
+    rfx_free(index->id2text);
+    rfx_free(index);
+}
+
 int swf_FontSetID(SWFFONT * f, U16 id)
 {
     if (!f)
@@ -969,6 +969,11 @@ void swf_GetUsedIDs(TAG * t, int * positions)
     enumerateUsedIDs(t, 0, callbackFillin, &ptr);
 }
 
+/* Every tag is visited, even if the SWF has an index: new ids are handed
+   out in the order the definitions appear, and all references have to be
+   rewritten in the same pass, so walking the index per id wouldn't touch
+   fewer tags. The index is only used to tell forward references from ids
+   which are never defined, and is rebuilt afterwards. */
 char swf_Relocate (SWF*swf, char*bitmap)
 {
     TAG*tag;
@@ -1037,6 +1042,13 @@ char swf_Relocate (SWF*swf, char*bitmap)
 		    } else if(!bitmap[id]) {
 			/* well- we don't know this id, but it's not reserved anyway, so just
 			   leave it alone */
+		    } else if(swf_IndexGetDefiningTag(swf, id)) {
+			/* a forward reference to a character which is defined later on.
+			   Assign the new id now, the definition will pick it up. */
+			int newid;
+			NEW_ID(newid);
+			bitmap[newid] = 1;
+			id = slaveids[id] = newid;
 		    } else {
 			/* this actually happens with files created with Flash CS4 and never.
 			   Apparently e.g. DefineButton tags are able to use forward declarations of objects. */
@@ -1056,6 +1068,9 @@ char swf_Relocate (SWF*swf, char*bitmap)
 	}
 	tag=tag->next;
     }
+    /* all the ids changed */
+    if(swf->index)
+	swf_IndexSWF(swf);
     return ok;
 }
 
@@ -1138,6 +1153,189 @@ void swf_RelocateDepth(SWF*swf, char*bitmap)
     }
 }
 
+/* Tag index: character id -> defining tag, id -> tags using (or adding
+   information to) that id, and frame -> first tag of the frame. */
+
+typedef struct _tagrefs {
+    TAG**tags;
+    int num;
+    int size;
+} tagrefs_t;
+
+struct _SWFINDEX {
+    TAG**id2tag;
+    tagrefs_t*refs;
+    TAG**showframes; // the SHOWFRAME tags of the main timeline
+    int numframes;
+    int framessize;
+    char framesdirty;
+    int numtexts;
+};
+
+static void index_addref(SWFINDEX*index, int id, TAG*tag)
+{
+    tagrefs_t*r = &index->refs[id];
+    if(r->num && r->tags[r->num-1] == tag)
+        return;
+    if(r->num == r->size) {
+        r->size = r->size?r->size*2:4;
+        r->tags = (TAG**)rfx_realloc(r->tags, sizeof(TAG*)*r->size);
+    }
+    r->tags[r->num++] = tag;
+}
+
+static void index_delref(SWFINDEX*index, int id, TAG*tag)
+{
+    tagrefs_t*r = &index->refs[id];
+    int t;
+    for(t=r->num-1;t>=0;t--) {
+        if(r->tags[t] == tag) {
+            memmove(&r->tags[t], &r->tags[t+1], sizeof(TAG*)*(r->num-t-1));
+            r->num--;
+            return;
+        }
+    }
+}
+
+static void index_tag(SWFINDEX*index, TAG*tag, char add)
+{
+    int num, t;
+    if(tag->id == ST_SHOWFRAME)
+        index->framesdirty = 1;
+    if(tag->id == ST_DEFINETEXT || tag->id == ST_DEFINETEXT2)
+        index->numtexts += add?1:-1;
+    if(tag->len < 2)
+        return;
+    if(swf_isDefiningTag(tag)) {
+        int id = swf_GetDefineID(tag);
+        if(add)
+            index->id2tag[id] = tag;
+        else if(index->id2tag[id] == tag)
+            index->id2tag[id] = 0;
+    } else if(swf_isPseudoDefiningTag(tag)) {
+        int id = swf_GetDefineID(tag);
+        if(add) index_addref(index, id, tag);
+        else    index_delref(index, id, tag);
+    }
+    /* enumerating the ids moves the read position- callers may still
+       be reading the tag, or expect to start at the beginning */
+    U32 pos = tag->pos;
+    U8 readBit = tag->readBit;
+    num = swf_GetNumUsedIDs(tag);
+    if(num) {
+        int*positions = (int*)rfx_alloc(sizeof(int)*num);
+        swf_GetUsedIDs(tag, positions);
+        for(t=0;t<num;t++) {
+            int id = GET16(&tag->data[positions[t]]);
+            if(add) index_addref(index, id, tag);
+            else    index_delref(index, id, tag);
+        }
+        rfx_free(positions);
+    }
+    tag->pos = pos;
+    tag->readBit = readBit;
+}
+
+static void index_frames(SWF*swf)
+{
+    SWFINDEX*index = swf->index;
+    TAG*tag = swf->firstTag;
+    int level = 0;
+    index->numframes = 0;
+    while(tag) {
+        if(tag->id == ST_DEFINESPRITE && !swf_IsFolded(tag))
+            level++;
+        else if(tag->id == ST_END && level)
+            level--;
+        else if(tag->id == ST_SHOWFRAME && !level) {
+            if(index->numframes == index->framessize) {
+                index->framessize = index->framessize?index->framessize*2:64;
+                index->showframes = (TAG**)rfx_realloc(index->showframes, sizeof(TAG*)*index->framessize);
+            }
+            index->showframes[index->numframes++] = tag;
+        }
+        tag = tag->next;
+    }
+    index->framesdirty = 0;
+}
+
+void swf_IndexFree(SWF*swf)
+{
+    SWFINDEX*index = swf->index;
+    int t;
+    if(!index)
+        return;
+    for(t=0;t<65536;t++) {
+        if(index->refs[t].tags)
+            rfx_free(index->refs[t].tags);
+    }
+    rfx_free(index->id2tag);
+    rfx_free(index->refs);
+    if(index->showframes)
+        rfx_free(index->showframes);
+    rfx_free(index);
+    swf->index = 0;
+}
+
+void swf_IndexSWF(SWF*swf)
+{
+    SWFINDEX*index;
+    TAG*tag;
+    swf_IndexFree(swf);
+    index = swf->index = (SWFINDEX*)rfx_calloc(sizeof(SWFINDEX));
+    index->id2tag = (TAG**)rfx_calloc(sizeof(TAG*)*65536);
+    index->refs = (tagrefs_t*)rfx_calloc(sizeof(tagrefs_t)*65536);
+    for(tag=swf->firstTag;tag;tag=tag->next)
+        index_tag(index, tag, 1);
+    index_frames(swf);
+}
+
+void swf_IndexAddTag(SWF*swf, TAG*tag)
+{
+    if(swf && swf->index)
+        index_tag(swf->index, tag, 1);
+}
+
+void swf_IndexRemoveTag(SWF*swf, TAG*tag)
+{
+    if(swf && swf->index)
+        index_tag(swf->index, tag, 0);
+}
+
+TAG* swf_IndexGetDefiningTag(SWF*swf, U16 id)
+{
+    return swf->index?swf->index->id2tag[id]:0;
+}
+
+TAG** swf_IndexGetReferences(SWF*swf, U16 id, int*num)
+{
+    if(!swf->index) {
+        *num = 0;
+        return 0;
+    }
+    *num = swf->index->refs[id].num;
+    return swf->index->refs[id].tags;
+}
+
+int swf_IndexGetNumTexts(SWF*swf)
+{
+    return swf->index?swf->index->numtexts:0;
+}
+
+TAG* swf_IndexGetFrame(SWF*swf, int frame)
+{
+    SWFINDEX*index = swf->index;
+    if(!index || frame<0)
+        return 0;
+    if(index->framesdirty)
+        index_frames(swf);
+    if(!frame)
+        return swf->firstTag;
+    if(frame > index->numframes)
+        return 0;
+    return index->showframes[frame-1]->next;
+}
+
 U8 swf_isShapeTag(TAG*tag)
 {
     if(tag->id == ST_DEFINESHAPE ||
@@ -1228,30 +1426,323 @@ TAG* swf_Concatenate (TAG*list1,TAG*list2)
     return swf1.firstTag;
 }
 
-static int tagHash(TAG*tag)
+static int dataHash(U8*data, int len)
 {
     int t, h=0;
     unsigned int a = 0x6b973e5a;
-    /* start at pos 2, as 0 and 1 are the id */
-    for(t=2;t<tag->len;t++) {
+    for(t=0;t<len;t++) {
         unsigned int b = a;
         a >>= 8;
-        a += tag->data[t]*0xefbc35a5*b*(t+1);
+        a += data[t]*0xefbc35a5*b*(t+3);
     }
     return a&0x7fffffff; //always return positive number
 }
 
-void swf_Optimize(SWF*swf)
+/* The optimizer compares defining tags in one of three ways:
+   OPT_RAW:    the tag bytes (minus the id) have to be identical
+   OPT_SHAPE:  shapes are compared in a canonical form: relative to the
+               upper left corner of their bbox, and with sorted fill styles.
+               Shapes which only differ by a translation are merged, and
+               the placements of the removed shape are moved accordingly.
+   OPT_BITMAP: bitmaps are compared by their decoded pixels.
+*/
+#define OPT_RAW 0
+#define OPT_SHAPE 1
+#define OPT_BITMAP 2
+
+typedef struct _optentry {
+    TAG*tag;
+    char type;
+    U8*data;
+    int len;
+    SPOINT origin;
+} optentry_t;
+
+typedef struct _fillentry {
+    U8 data[128];
+    int len;
+    int index;
+} fillentry_t;
+
+#define RGBA2U32(c) ((c).r|(c).g<<8|(c).b<<16|(U32)(c).a<<24)
+
+static void opt_put(U8*data, int*pos, U32 v, int bytes)
+{
+    while(bytes--) {
+        data[(*pos)++] = v;
+        v >>= 8;
+    }
+}
+
+static int opt_serializefill(fillentry_t*f, FILLSTYLE*fs, SPOINT origin)
+{
+    int t;
+    f->len = 0;
+    opt_put(f->data, &f->len, fs->type, 1);
+    if(fs->type == FILL_SOLID) {
+        opt_put(f->data, &f->len, RGBA2U32(fs->color), 4);
+        return 1;
+    }
+    if(fs->type != FILL_LINEAR && fs->type != FILL_RADIAL && 
+       !(fs->type >= FILL_TILED && fs->type <= FILL_CLIPPED+2))
+        return 0;
+    opt_put(f->data, &f->len, fs->m.sx, 4);
+    opt_put(f->data, &f->len, fs->m.r1, 4);
+    opt_put(f->data, &f->len, fs->m.r0, 4);
+    opt_put(f->data, &f->len, fs->m.sy, 4);
+    opt_put(f->data, &f->len, fs->m.tx - origin.x, 4);
+    opt_put(f->data, &f->len, fs->m.ty - origin.y, 4);
+    if(fs->type >= FILL_TILED) {
+        opt_put(f->data, &f->len, fs->id_bitmap, 2);
+    } else {
+        if(fs->gradient.num > 15)
+            return 0;
+        opt_put(f->data, &f->len, fs->gradient.num, 1);
+        for(t=0;t<fs->gradient.num;t++) {
+            opt_put(f->data, &f->len, fs->gradient.ratios[t], 1);
+            opt_put(f->data, &f->len, RGBA2U32(fs->gradient.rgba[t]), 4);
+        }
+    }
+    return 1;
+}
+
+static int opt_comparefills(const void*_a, const void*_b)
+{
+    fillentry_t*a = (fillentry_t*)_a;
+    fillentry_t*b = (fillentry_t*)_b;
+    if(a->len != b->len)
+        return a->len - b->len;
+    return memcmp(a->data, b->data, a->len);
+}
+
+/* write a canonical representation of a DefineShape/2/3 tag, which
+   doesn't depend on the position of the shape or on the order of
+   its fill styles */
+static int opt_canonicalshape(TAG*tag, writer_t*w, SPOINT*origin)
+{
+    SHAPE2 shape;
+    SHAPEREC*l;
+    int fill0 = 0, fill1 = 0, line = 0;
+    fillentry_t*fills = 0;
+    int*fillmap = 0;
+    U8 buf[32];
+    int t, num = 0, ok = 1;
+
+    if(tag->id != ST_DEFINESHAPE && tag->id != ST_DEFINESHAPE2 && tag->id != ST_DEFINESHAPE3)
+        return 0;
+    swf_ParseDefineShape(tag, &shape);
+    if(!shape.bbox) {
+        swf_Shape2Free(&shape);
+        return 0;
+    }
+    origin->x = shape.bbox->xmin;
+    origin->y = shape.bbox->ymin;
+
+    fills = (fillentry_t*)rfx_alloc(sizeof(fillentry_t)*(shape.numfillstyles+1));
+    fillmap = (int*)rfx_calloc(sizeof(int)*(shape.numfillstyles+1));
+    for(t=0;t<shape.numfillstyles;t++) {
+        if(!opt_serializefill(&fills[t], &shape.fillstyles[t], *origin))
+            ok = 0;
+        fills[t].index = t;
+    }
+    if(!ok)
+        goto done;
+
+    /* identical fill styles are mapped to the same index */
+    qsort(fills, shape.numfillstyles, sizeof(fillentry_t), opt_comparefills);
+    for(t=0;t<shape.numfillstyles;t++) {
+        if(!t || opt_comparefills(&fills[t-1], &fills[t])) {
+            num++;
+            w->write(w, fills[t].data, fills[t].len);
+        }
+        fillmap[fills[t].index+1] = num;
+    }
+
+    t = 0;
+    opt_put(buf, &t, tag->id, 2);
+    opt_put(buf, &t, shape.bbox->xmax - shape.bbox->xmin, 4);
+    opt_put(buf, &t, shape.bbox->ymax - shape.bbox->ymin, 4);
+    opt_put(buf, &t, num, 4);
+    opt_put(buf, &t, shape.numlinestyles, 4);
+    w->write(w, buf, t);
+    for(t=0;t<shape.numlinestyles;t++) {
+        int pos = 0;
+        opt_put(buf, &pos, shape.linestyles[t].width, 2);
+        opt_put(buf, &pos, RGBA2U32(shape.linestyles[t].color), 4);
+        w->write(w, buf, pos);
+    }
+
+    for(l=shape.records;l<shape.records+shape.numrecords;l++) {
+        int pos = 0;
+        if(l->type == styleChange) {
+            if(l->x > shape.numfillstyles || l->y > shape.numfillstyles) {
+                ok = 0;
+                break;
+            }
+            fill0 = fillmap[l->x];
+            fill1 = fillmap[l->y];
+            line = l->sx;
+            continue;
+        }
+        opt_put(buf, &pos, l->type, 1);
+        opt_put(buf, &pos, fill0, 2);
+        opt_put(buf, &pos, fill1, 2);
+        opt_put(buf, &pos, line, 2);
+        opt_put(buf, &pos, l->x - origin->x, 4);
+        opt_put(buf, &pos, l->y - origin->y, 4);
+        if(l->type == splineTo) {
+            opt_put(buf, &pos, l->sx - origin->x, 4);
+            opt_put(buf, &pos, l->sy - origin->y, 4);
+        }
+        w->write(w, buf, pos);
+    }
+done:
+    for(t=0;t<shape.numfillstyles;t++) {
+        U8 type = shape.fillstyles[t].type;
+        if(type >= 0x10 && type <= 0x13)
+            swf_FreeGradient(&shape.fillstyles[t].gradient);
+    }
+    rfx_free(fills);
+    rfx_free(fillmap);
+    swf_Shape2Free(&shape);
+    return ok;
+}
+
+static RGBA* opt_decodebitmap(TAG*tag, int*width, int*height)
+{
+    /* no DefineBitsJPEG3: swf_ExtractImage() only approximates
+       the premultiplied colors */
+    if(tag->id != ST_DEFINEBITSLOSSLESS && tag->id != ST_DEFINEBITSLOSSLESS2
+#ifdef HAVE_JPEGLIB
+       && tag->id != ST_DEFINEBITSJPEG2
+#endif
+      )
+        return 0;
+    return swf_ExtractImage(tag, width, height);
+}
+
+static int opt_canonicalbitmap(TAG*tag, writer_t*w)
+{
+    int width, height, t, pos = 0;
+    U8 buf[16];
+    RGBA*img = opt_decodebitmap(tag, &width, &height);
+    if(!img)
+        return 0;
+    U32 h1 = 0x811c9dc5, h2 = 0x2545f491;
+    U32*p = (U32*)img;
+    for(t=0;t<width*height;t++) {
+        h1 = (h1 ^ p[t]) * 0x01000193;
+        h2 = (h2 + p[t]) * 0x9e3779b1;
+        h2 ^= h2 >> 15;
+    }
+    rfx_free(img);
+    opt_put(buf, &pos, width, 4);
+    opt_put(buf, &pos, height, 4);
+    opt_put(buf, &pos, h1, 4);
+    opt_put(buf, &pos, h2, 4);
+    w->write(w, buf, pos);
+    return 1;
+}
+
+/* the hashes of two bitmaps are the same- make sure the pixels are, too */
+static int opt_samebitmap(TAG*tag1, TAG*tag2)
+{
+    int w1,h1,w2,h2,same;
+    RGBA*img1 = opt_decodebitmap(tag1, &w1, &h1);
+    RGBA*img2 = opt_decodebitmap(tag2, &w2, &h2);
+    same = img1 && img2 && w1==w2 && h1==h2 && !memcmp(img1, img2, sizeof(RGBA)*w1*h1);
+    if(img1) rfx_free(img1);
+    if(img2) rfx_free(img2);
+    return same;
+}
+
+static void opt_entry(TAG*tag, optentry_t*e)
+{
+    writer_t w;
+    memset(e, 0, sizeof(optentry_t));
+    e->tag = tag;
+    writer_init_growingmemwriter(&w, 256);
+    if(swf_isShapeTag(tag) && opt_canonicalshape(tag, &w, &e->origin)) {
+        e->type = OPT_SHAPE;
+    } else if(swf_isImageTag(tag) && opt_canonicalbitmap(tag, &w)) {
+        e->type = OPT_BITMAP;
+    } else {
+        e->type = OPT_RAW;
+        e->data = &tag->data[2];
+        e->len = tag->len-2;
+        w.finish(&w);
+        return;
+    }
+    U8*data = (U8*)writer_growmemwrite_memptr(&w, &e->len);
+    e->data = (U8*)rfx_alloc(e->len);
+    memcpy(e->data, data, e->len);
+    w.finish(&w);
+}
+
+/* move the character placed by a PlaceObject/PlaceObject2 tag by (dx,dy)
+   in its own coordinate system */
+/* position of the character id in a PLACEOBJECT2/PLACEOBJECT3 tag */
+static int opt_placeidpos(TAG*tag)
+{
+    return tag->id == ST_PLACEOBJECT3?4:3;
+}
+
+static void opt_moveplacement(TAG*tag, SPOINT d)
+{
+    MATRIX m;
+    int pos, end;
+    U8 flags = 0, shared;
+    U8*data = tag->data;
+    int len = tag->len;
+
+    if(tag->id == ST_PLACEOBJECT) {
+        pos = 4;
+    } else {
+        flags = data[0];
+        pos = opt_placeidpos(tag) + ((flags&PF_CHAR)?2:0);
+    }
+    if(tag->id == ST_PLACEOBJECT || (flags&PF_MATRIX)) {
+        swf_SetTagPos(tag, pos);
+        swf_GetMatrix(tag, &m);
+        swf_ResetReadBits(tag);
+        end = tag->pos;
+    } else {
+        swf_GetMatrix(0, &m);
+        end = pos;
+    }
+    /* not swf_TurnPoint(), which rounds negative values the wrong way */
+    m.tx += (int)(((S64)m.sx*d.x + (S64)m.r1*d.y + 32768) >> 16);
+    m.ty += (int)(((S64)m.r0*d.x + (S64)m.sy*d.y + 32768) >> 16);
+
+    shared = tag->shared;
+    tag->data = 0;
+    tag->len = tag->memsize = 0;
+    tag->shared = 0;
+    swf_SetBlock(tag, data, pos);
+    if(tag->id != ST_PLACEOBJECT)
+        tag->data[0] |= PF_MATRIX;
+    swf_SetMatrix(tag, &m);
+    swf_SetBlock(tag, &data[end], len-end);
+    if(!shared)
+        rfx_free(data);
+}
+
+int swf_Optimize(SWF*swf)
 {
     const int hash_size = 131072;
     char* dontremap = (char*)rfx_calloc(sizeof(char)*65536);
+    char* dontmove = (char*)rfx_calloc(sizeof(char)*65536);
     U16* remap = (U16*)rfx_alloc(sizeof(U16)*65536);
-    TAG* id2tag = (TAG*)rfx_calloc(sizeof(TAG*)*65536);
-    TAG** hashmap = (TAG**)rfx_calloc(sizeof(TAG*)*hash_size);
+    SPOINT* offset = (SPOINT*)rfx_calloc(sizeof(SPOINT)*65536);
+    SPOINT* depthoffset = (SPOINT*)rfx_calloc(sizeof(SPOINT)*65536);
+    int* depthchar = (int*)rfx_alloc(sizeof(int)*65536);
+    optentry_t* hashmap = (optentry_t*)rfx_calloc(sizeof(optentry_t)*hash_size);
     TAG* tag;
+    int saved = 0;
     int t;
     for(t=0;t<65536;t++) {
         remap[t] = t;
+        depthchar[t] = -1;
     }
 
     swf_FoldAll(swf);
@@ -1267,12 +1758,57 @@ void swf_Optimize(SWF*swf)
            tag->id != ST_NAMECHARACTER) {
             dontremap[swf_GetDefineID(tag)] = 1;
         }
+        /* shapes which are used by anything else than main timeline
+           PlaceObject tags can't be exchanged for a translated copy.
+           Neither can a shape which replaces another one without a new
+           matrix, nor the shapes it replaces: the matrix it inherits was
+           written for them. */
+        if(tag->id == ST_PLACEOBJECT2 || tag->id == ST_PLACEOBJECT3) {
+            int depth = swf_GetDepth(tag);
+            int idpos = opt_placeidpos(tag);
+            if((tag->data[0]&(PF_MOVE|PF_CHAR|PF_MATRIX)) == (PF_MOVE|PF_CHAR)) {
+                dontmove[GET16(&tag->data[idpos])] = 1;
+                if(depthchar[depth]>=0)
+                    dontmove[depthchar[depth]] = 1;
+            }
+            if(tag->data[0]&PF_CHAR)
+                depthchar[depth] = GET16(&tag->data[idpos]);
+        } else if(tag->id == ST_PLACEOBJECT) {
+            depthchar[swf_GetDepth(tag)] = swf_GetPlaceID(tag);
+        } else if(tag->id == ST_REMOVEOBJECT || tag->id == ST_REMOVEOBJECT2) {
+            depthchar[swf_GetDepth(tag)] = -1;
+        } else {
+            int num = swf_GetNumUsedIDs(tag);
+            int*positions = (int*)rfx_alloc(sizeof(int)*num);
+            swf_GetUsedIDs(tag, positions);
+            for(t=0;t<num;t++)
+                dontmove[GET16(&tag->data[positions[t]])] = 1;
+            rfx_free(positions);
+        }
         tag=tag->next;
     }
     tag = swf->firstTag;
     while(tag) {
         TAG*next = tag->next;
 
+        /* placements of shapes which were replaced by a translated
+           copy need to be moved */
+        if(tag->id == ST_PLACEOBJECT || tag->id == ST_PLACEOBJECT2 || tag->id == ST_PLACEOBJECT3) {
+            int depth = swf_GetDepth(tag);
+            SPOINT d = depthoffset[depth];
+            if(tag->id == ST_PLACEOBJECT || (tag->data[0]&PF_CHAR)) {
+                d = depthoffset[depth] = offset[swf_GetPlaceID(tag)];
+            }
+            if((d.x || d.y) && (tag->id == ST_PLACEOBJECT || (tag->data[0]&(PF_CHAR|PF_MATRIX)))) {
+                saved += swf_WriteTag(-1, tag);
+                opt_moveplacement(tag, d);
+                saved -= swf_WriteTag(-1, tag);
+            }
+        } else if(tag->id == ST_REMOVEOBJECT || tag->id == ST_REMOVEOBJECT2) {
+            depthoffset[swf_GetDepth(tag)].x = 0;
+            depthoffset[swf_GetDepth(tag)].y = 0;
+        }
+
         /* remap the tag */
         int num = swf_GetNumUsedIDs(tag);
         int*positions = (int*)rfx_alloc(sizeof(int)*num);
@@ -1288,27 +1824,43 @@ void swf_Optimize(SWF*swf)
         /* now look for previous tags with the same
            content */
         if(swf_isDefiningTag(tag)) {
-            TAG*tag2;
+            optentry_t e;
+            optentry_t*e2 = 0;
             int id = swf_GetDefineID(tag);
-            int hash = tagHash(tag);
-            int match=0;
-            if(!dontremap[id]) 
-            while((tag2 = hashmap[hash%hash_size])) {
-                if(tag2 != (TAG*)0 && tag->len == tag2->len) {
-		    if(memcmp(&tag->data[2],&tag2->data[2],tag->len-2) == 0) {
-			match = 1;
-			break;
-		    }
+            int hash;
+            opt_entry(tag, &e);
+            hash = dataHash(e.data, e.len);
+            while((e2 = &hashmap[hash%hash_size])->tag && !dontremap[id]) {
+                if(e2->type == e.type && e2->len == e.len &&
+                   (e.type != OPT_RAW || e2->tag->id == tag->id) &&
+                   memcmp(e2->data, e.data, e.len) == 0) {
+                    if(e.type == OPT_SHAPE && dontmove[id] &&
+                       (e.origin.x != e2->origin.x || e.origin.y != e2->origin.y)) {
+                        /* would need to be moved */
+                    } else if(e.type == OPT_BITMAP && !opt_samebitmap(tag, e2->tag)) {
+                        /* hash collision */
+                    } else {
+                        break;
+                    }
                 }
                 hash++;
             }
-            if(!match) {
-                while(hashmap[hash%hash_size]) hash++;
-                hashmap[hash%hash_size] = tag;
+            if(dontremap[id]) {
+                while(hashmap[hash%hash_size].tag) hash++;
+                hashmap[hash%hash_size] = e;
+            } else if(!e2->tag) {
+                *e2 = e;
             } else {
 		/* we found two identical tags- remap one
 		   of them */
-                remap[id] = swf_GetDefineID(tag2);
+                remap[id] = swf_GetDefineID(e2->tag);
+                if(e.type == OPT_SHAPE) {
+                    offset[id].x = e.origin.x - e2->origin.x;
+                    offset[id].y = e.origin.y - e2->origin.y;
+                }
+                if(e.type != OPT_RAW)
+                    rfx_free(e.data);
+                saved += swf_WriteTag(-1, tag);
                 swf_DeleteTag(swf, tag);
             }
         } else if(swf_isPseudoDefiningTag(tag)) {
@@ -1317,6 +1869,7 @@ void swf_Optimize(SWF*swf)
                 /* if this tag was remapped, we don't
                    need the helper tag anymore. Discard
                    it. */
+                saved += swf_WriteTag(-1, tag);
                 swf_DeleteTag(swf, tag);
             }
         }
@@ -1324,10 +1877,20 @@ void swf_Optimize(SWF*swf)
         tag = next;
     }
     
+    for(t=0;t<hash_size;t++) {
+        if(hashmap[t].tag && hashmap[t].type != OPT_RAW)
+            rfx_free(hashmap[t].data);
+    }
     rfx_free(dontremap);
+    rfx_free(dontmove);
     rfx_free(remap);
-    rfx_free(id2tag);
+    rfx_free(offset);
+    rfx_free(depthoffset);
+    rfx_free(depthchar);
     rfx_free(hashmap);
+    if(swf->index)
+        swf_IndexSWF(swf);
+    return saved;
 }
 
 void swf_SetDefineBBox(TAG * tag, SRECT newbbox)
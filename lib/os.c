@@ -268,6 +268,30 @@ memfile_t* memfile_open(const char*path)
     return file;
 }
 
+/* maps the whole file behind handle (regardless of the current position).
+   The mapping is private, but writable- changes don't go back to the file.
+   Returns 0 if the handle can't be mapped (e.g. it's a pipe), so the
+   caller has to fall back to read()ing it. */
+memfile_t* memfile_open_handle(int handle)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_STAT)
+    struct stat sb;
+    void*data;
+    memfile_t*file;
+    if(fstat(handle, &sb)<0 || !S_ISREG(sb.st_mode) || !sb.st_size)
+        return 0;
+    data = mmap(0, sb.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, handle, 0);
+    if(data == MAP_FAILED)
+        return 0;
+    file = malloc(sizeof(memfile_t));
+    file->data = data;
+    file->len = sb.st_size;
+    return file;
+#else
+    return 0;
+#endif
+}
+
 void memfile_close(memfile_t*file)
 {
 #if defined(HAVE_MMAP) && defined(HAVE_STAT)
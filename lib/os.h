@@ -23,6 +23,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
 
 #ifndef __os_h__
 #define __os_h__
+#include <stddef.h>
 #include "../config.h"
 
 #ifdef __cplusplus
@@ -38,9 +39,10 @@ int setRegistryEntry(char*key,char*value);
 
 typedef struct _memfile {
     void*data;
-    int len;
+    size_t len;
 } memfile_t;
 memfile_t* memfile_open(const char*path);
+memfile_t* memfile_open_handle(int handle);
 void memfile_close(memfile_t*file);
 
 char* getInstallationPath();
@@ -28,12 +28,14 @@
   #include "splash/SplashBitmap.h"
   #include "splash/SplashPattern.h"
   #include "splash/Splash.h"
+  #include "splash/SplashClip.h"
 #else
   #include "xpdf/config.h"
   #include "SplashBitmap.h"
   #include "SplashGlyphBitmap.h"
   #include "SplashPattern.h"
   #include "Splash.h"
+  #include "SplashClip.h"
 #endif
 
 #include "../log.h"
@@ -68,6 +70,8 @@ BitmapOutputDev::BitmapOutputDev(InfoOutputDev*info, PDFDoc*doc, int*page2page,
     this->info = info;
     this->doc = doc;
     this->xref = doc->getXRef();
+    this->dbg_btm_counter = 1;
+    this->page_font_list = 0;
     
     /* color graphic output device, for creating bitmaps */
     this->rgbdev = new SplashOutputDev(splashModeRGB8, 1, gFalse, splash_white, gTrue, gTrue);
@@ -103,6 +107,10 @@ BitmapOutputDev::BitmapOutputDev(InfoOutputDev*info, PDFDoc*doc, int*page2page,
     this->config_skewedtobitmap = 0;
     this->config_alphatobitmap = 0;
     this->bboxpath = 0;
+    this->stalepolybitmap = 0;
+    this->staletextbitmap = 0;
+    this->stalepolytiles = 0;
+    this->staletexttiles = 0;
     //this->clipdev = 0;
     //this->clipstates = 0;
 }
@@ -127,6 +135,9 @@ BitmapOutputDev::~BitmapOutputDev()
     if(this->gfxdev) {
 	delete this->gfxdev;this->gfxdev= 0;
     }
+    if(this->page_font_list) {
+	gfxfontlist_free(this->page_font_list, 0);this->page_font_list = 0;
+    }
     if(this->boolpolydev) {
 	delete this->boolpolydev;this->boolpolydev = 0;
     }
@@ -136,6 +147,12 @@ BitmapOutputDev::~BitmapOutputDev()
     if(this->staletextbitmap) {
 	delete this->staletextbitmap;this->staletextbitmap = 0;
     }
+    if(this->stalepolytiles) {
+	tilemap_destroy(this->stalepolytiles);this->stalepolytiles = 0;
+    }
+    if(this->staletexttiles) {
+	tilemap_destroy(this->staletexttiles);this->staletexttiles = 0;
+    }
     if(this->booltextdev) {
 	delete this->booltextdev;this->booltextdev = 0;
     }
@@ -184,8 +201,6 @@ void BitmapOutputDev::setParameter(const char*key, const char*value)
 void writeBitmap(SplashBitmap*bitmap, char*filename);
 void writeAlpha(SplashBitmap*bitmap, char*filename);
 
-static int dbg_btm_counter=1;
-
 void BitmapOutputDev::flushBitmap()
 {
     int bitmap_width = rgbdev->getBitmapWidth();
@@ -334,6 +349,12 @@ void BitmapOutputDev::flushText()
 {
     msg("<verbose> Flushing text");
 
+    if(info->shared) {
+	gfxdevice_record_flush(this->gfxoutput, this->dev, &this->page_font_list);
+	this->emptypage = 0;
+	return;
+    }
+
     static gfxfontlist_t*output_font_list = 0;
     static gfxdevice_t*last = 0;
     if(last != this->dev) {
@@ -485,7 +506,7 @@ static inline GBool fixBBox(int*x1, int*y1, int*x2, int*y2, int width, int heigh
     return gTrue;
 }
 
-static void update_bitmap(SplashBitmap*bitmap, SplashBitmap*update, int x1, int y1, int x2, int y2, char overwrite)
+static void update_bitmap(SplashBitmap*bitmap, SplashBitmap*update, tilemap_t*tiles, int x1, int y1, int x2, int y2, char overwrite)
 {
     assert(bitmap->getMode()==splashModeMono1);
     assert(update->getMode()==splashModeMono1);
@@ -498,6 +519,11 @@ static void update_bitmap(SplashBitmap*bitmap, SplashBitmap*update, int x1, int
 
     if(!fixBBox(&x1, &y1, &x2, &y2, bitmap->getWidth(), bitmap->getHeight()))
 	return;
+
+    if(tiles) {
+	tilemap_or(tiles, bitmap->getDataPtr(), update->getDataPtr(), x1, y1, x2, y2, overwrite);
+	return;
+    }
     
     Guchar*b = bitmap->getDataPtr() + y1*width8 + x1/8;
     Guchar*u = update->getDataPtr() + y1*width8 + x1/8;
@@ -650,12 +676,12 @@ GBool BitmapOutputDev::checkNewText(int x1, int y1, int x2, int y2)
     msg("<trace> Testing new text data against current bitmap data, state=%s, counter=%d\n", STATE_NAME[layerstate], dbg_btm_counter);
     
     GBool ret = false;
-    if(intersection(booltextbitmap, stalepolybitmap, x1,y1,x2,y2)) {
+    if(intersection(booltextbitmap, stalepolybitmap, stalepolytiles, x1,y1,x2,y2)) {
 	if(layerstate==STATE_PARALLEL) {
 	    /* the new text is above the bitmap. So record that fact. */
 	    msg("<verbose> Text is above current bitmap/polygon data");
 	    layerstate=STATE_TEXT_IS_ABOVE;
-	    update_bitmap(staletextbitmap, booltextbitmap, x1, y1, x2, y2, 0);
+	    update_bitmap(staletextbitmap, booltextbitmap, staletexttiles, x1, y1, x2, y2, 0);
 	} else if(layerstate==STATE_BITMAP_IS_ABOVE) {
 	    /* there's a bitmap above the (old) text. So we need
 	       to flush out that text, and record that the *new*
@@ -668,7 +694,7 @@ GBool BitmapOutputDev::checkNewText(int x1, int y1, int x2, int y2)
 	   
 	    clearBoolTextDev();
 	    /* re-apply the update (which we would otherwise lose) */
-	    update_bitmap(staletextbitmap, booltextbitmap, x1, y1, x2, y2, 1);
+	    update_bitmap(staletextbitmap, booltextbitmap, staletexttiles, x1, y1, x2, y2, 1);
             ret = true;
 	} else {
 	    /* we already know that the current text section is
@@ -676,18 +702,18 @@ GBool BitmapOutputDev::checkNewText(int x1, int y1, int x2, int y2)
 	       bitmap data *and* new text data was drawn, and
 	       *again* it's above the current bitmap. */
 	    msg("<verbose> Text is still above current bitmap/polygon data");
-	    update_bitmap(staletextbitmap, booltextbitmap, x1, y1, x2, y2, 0);
+	    update_bitmap(staletextbitmap, booltextbitmap, staletexttiles, x1, y1, x2, y2, 0);
 	}
     }  else {
         msg("<verbose> no intersection");
-	update_bitmap(staletextbitmap, booltextbitmap, x1, y1, x2, y2, 0);
+	update_bitmap(staletextbitmap, booltextbitmap, staletexttiles, x1, y1, x2, y2, 0);
     }
     
     /* clear the thing we just drew from our temporary drawing bitmap */
     clearBooleanBitmap(booltextbitmap, x1, y1, x2, y2);
 
 #ifdef DEBUG
-    if(intersection(booltextbitmap, booltextbitmap, UNKNOWN_BOUNDING_BOX)) {
+    if(intersection(booltextbitmap, booltextbitmap, 0, UNKNOWN_BOUNDING_BOX)) {
         msg("<fatal> Text bitmap is not empty after clear. Bad bounding box?");
         exit(1);
     }
@@ -701,32 +727,32 @@ GBool BitmapOutputDev::checkNewBitmap(int x1, int y1, int x2, int y2)
     msg("<trace> Testing new graphics data against current text data, state=%s, counter=%d\n", STATE_NAME[layerstate], dbg_btm_counter);
 
     GBool ret = false;
-    if(intersection(boolpolybitmap, staletextbitmap, x1,y1,x2,y2)) {
+    if(intersection(boolpolybitmap, staletextbitmap, staletexttiles, x1,y1,x2,y2)) {
 	if(layerstate==STATE_PARALLEL) {
 	    msg("<verbose> Bitmap is above current text data");
 	    layerstate=STATE_BITMAP_IS_ABOVE;
-	    update_bitmap(stalepolybitmap, boolpolybitmap, x1, y1, x2, y2, 0);
+	    update_bitmap(stalepolybitmap, boolpolybitmap, stalepolytiles, x1, y1, x2, y2, 0);
 	} else if(layerstate==STATE_TEXT_IS_ABOVE) {
 	    msg("<verbose> Bitmap is above current text data (which is above some bitmap)");
 	    flushBitmap();
 	    layerstate=STATE_BITMAP_IS_ABOVE;
 	    clearBoolPolyDev();
-	    update_bitmap(stalepolybitmap, boolpolybitmap, x1, y1, x2, y2, 1);
+	    update_bitmap(stalepolybitmap, boolpolybitmap, stalepolytiles, x1, y1, x2, y2, 1);
             ret = true;
 	} else {
 	    msg("<verbose> Bitmap is still above current text data");
-	    update_bitmap(stalepolybitmap, boolpolybitmap, x1, y1, x2, y2, 0);
+	    update_bitmap(stalepolybitmap, boolpolybitmap, stalepolytiles, x1, y1, x2, y2, 0);
 	}
     }  else {
         msg("<verbose> no intersection");
-	update_bitmap(stalepolybitmap, boolpolybitmap, x1, y1, x2, y2, 0);
+	update_bitmap(stalepolybitmap, boolpolybitmap, stalepolytiles, x1, y1, x2, y2, 0);
     }
     
     /* clear the thing we just drew from our temporary drawing bitmap */
     clearBooleanBitmap(boolpolybitmap, x1, y1, x2, y2);
 
 #ifdef DEBUG
-    if(intersection(boolpolybitmap, boolpolybitmap, UNKNOWN_BOUNDING_BOX)) {
+    if(intersection(boolpolybitmap, boolpolybitmap, 0, UNKNOWN_BOUNDING_BOX)) {
 	writeAlpha(boolpolybitmap, "notempty.png");
         msg("<fatal> Polygon bitmap is not empty after clear. Bad bounding box?");
         int _x1, _y1, _x2, _y2;
@@ -863,6 +889,18 @@ GBool BitmapOutputDev::clip0and1differ(int x1,int y1,int x2,int y2)
     }
 }
 
+GBool BitmapOutputDev::charIsUnclipped(int x1, int y1, int x2, int y2)
+{
+    /* a char can only look different on clip1dev than on clip0dev if
+       a clipping path or a soft mask is involved */
+    Splash*splash = clip1dev->getSplash();
+    if(!splash || splash->getSoftMask() || clip1dev->getBitmap() != clip1bitmap)
+	return gFalse;
+    if(x2<=x1 || y2<=y1)
+	return gFalse;
+    return splash->getClip()->testRect(x1, y1, x2-1, y2-1) == splashClipAllInside;
+}
+
 GBool compare8(unsigned char*data1, unsigned char*data2, int len)
 {
     if(!len)
@@ -901,7 +939,7 @@ GBool compare8(unsigned char*data1, unsigned char*data2, int len)
     return 0;
 }
 
-GBool BitmapOutputDev::intersection(SplashBitmap*boolpoly, SplashBitmap*booltext, int x1, int y1, int x2, int y2)
+GBool BitmapOutputDev::intersection(SplashBitmap*boolpoly, SplashBitmap*booltext, tilemap_t*staletiles, int x1, int y1, int x2, int y2)
 {
     if(boolpoly->getMode()==splashModeMono1) {
 	/* alternative implementation, using one bit per pixel-
@@ -913,6 +951,10 @@ GBool BitmapOutputDev::intersection(SplashBitmap*boolpoly, SplashBitmap*booltext
         if(!fixBBox(&x1,&y1,&x2,&y2, width, height)) {
             return gFalse;
         }
+	if(staletiles) {
+	    /* only look at the tiles where the stale bitmap has pixels */
+	    return tilemap_intersects(staletiles, booltext->getDataPtr(), boolpoly->getDataPtr(), x1, y1, x2, y2);
+	}
 
 	Guchar*polypixels = boolpoly->getDataPtr();
 	Guchar*textpixels = booltext->getDataPtr();
@@ -1016,6 +1058,19 @@ void BitmapOutputDev::beginPage(GfxState *state, int pageNum)
     clip1dev->startPage(pageNum, state);
     gfxdev->startPage(pageNum, state);
 
+    if(stalepolybitmap) {
+	delete stalepolybitmap;stalepolybitmap = 0;
+    }
+    if(staletextbitmap) {
+	delete staletextbitmap;staletextbitmap = 0;
+    }
+    if(stalepolytiles) {
+	tilemap_destroy(stalepolytiles);stalepolytiles = 0;
+    }
+    if(staletexttiles) {
+	tilemap_destroy(staletexttiles);staletexttiles = 0;
+    }
+
     boolpolybitmap = boolpolydev->getBitmap();
     stalepolybitmap = new SplashBitmap(boolpolybitmap->getWidth(), boolpolybitmap->getHeight(), 1, boolpolybitmap->getMode(), 0);
     assert(stalepolybitmap->getRowSize() == boolpolybitmap->getRowSize());
@@ -1024,6 +1079,11 @@ void BitmapOutputDev::beginPage(GfxState *state, int pageNum)
     staletextbitmap = new SplashBitmap(booltextbitmap->getWidth(), booltextbitmap->getHeight(), 1, booltextbitmap->getMode(), 0);
     assert(staletextbitmap->getRowSize() == booltextbitmap->getRowSize());
 
+    clearBooleanBitmap(stalepolybitmap, UNKNOWN_BOUNDING_BOX);
+    clearBooleanBitmap(staletextbitmap, UNKNOWN_BOUNDING_BOX);
+    stalepolytiles = tilemap_new(stalepolybitmap->getWidth(), stalepolybitmap->getHeight());
+    staletexttiles = tilemap_new(staletextbitmap->getWidth(), staletextbitmap->getHeight());
+
     msg("<debug> startPage %dx%d (%dx%d)", this->width, this->height, booltextbitmap->getWidth(), booltextbitmap->getHeight());
 
     clip0bitmap = clip0dev->getBitmap();
@@ -1621,11 +1681,11 @@ void BitmapOutputDev::clearClips(int x1, int y1, int x2, int y2)
 }
 void BitmapOutputDev::clearBoolPolyDev()
 {
-    clearBooleanBitmap(stalepolybitmap, 0, 0, stalepolybitmap->getWidth(), stalepolybitmap->getHeight());
+    tilemap_clear(stalepolytiles, stalepolybitmap->getDataPtr());
 }
 void BitmapOutputDev::clearBoolTextDev()
 {
-    clearBooleanBitmap(staletextbitmap, 0, 0, staletextbitmap->getWidth(), staletextbitmap->getHeight());
+    tilemap_clear(staletexttiles, staletextbitmap->getDataPtr());
 }
 
 #define USE_GETGLYPH_BBOX
@@ -1740,11 +1800,6 @@ void BitmapOutputDev::drawChar(GfxState *state, double x, double y,
 	if(x2 > text_x2) text_x2 = x2;
 	if(y2 > text_y2) text_y2 = y2;
 
-	/* only clear the area we're going to check */
-	clearClips(x1,y1,x2,y2);
-	clip0dev->drawChar(state, x, y, dx, dy, originX, originY, code, nBytes, u, uLen);
-	clip1dev->drawChar(state, x, y, dx, dy, originX, originY, code, nBytes, u, uLen);
-
         int page_area_x1 = -this->movex;
         int page_area_y1 = -this->movey;
         int page_area_x2 = this->width-this->movex;
@@ -1754,10 +1809,26 @@ void BitmapOutputDev::drawChar(GfxState *state, double x, double y,
                                 x2>page_area_x2 ||
                                 y2>page_area_y2);
 
+	char is_clipped = 0;
+	char unclipped = 0;
+	if(!char_is_outside && !render_as_bitmap) {
+	    if(charIsUnclipped(x1,y1,x2,y2)) {
+		/* clip0dev and clip1dev would render exactly the same pixels,
+		   so don't bother rasterizing the char on them */
+		unclipped = 1;
+	    } else {
+		/* only clear the area we're going to check */
+		clearClips(x1,y1,x2,y2);
+		clip0dev->drawChar(state, x, y, dx, dy, originX, originY, code, nBytes, u, uLen);
+		clip1dev->drawChar(state, x, y, dx, dy, originX, originY, code, nBytes, u, uLen);
+		is_clipped = clip0and1differ(x1,y1,x2,y2);
+	    }
+	}
+
 	/* if this character is affected somehow by the various clippings (i.e., it looks
 	   different on a device without clipping), then draw it on the bitmap, not as
 	   text */
-	if(char_is_outside || render_as_bitmap || clip0and1differ(x1,y1,x2,y2)) {
+	if(char_is_outside || render_as_bitmap || is_clipped) {
             if(char_is_outside) msg("<verbose> Char %d is outside the page (%d,%d,%d,%d)", code, x1, y1, x2, y2);
             else if(render_as_bitmap)  msg("<verbose> Char %d needs to be rendered as bitmap", code);
             else msg("<verbose> Char %d is affected by clipping", code);
@@ -1777,7 +1848,12 @@ void BitmapOutputDev::drawChar(GfxState *state, double x, double y,
 	} else {
 	    /* this char is not at all affected by clipping. 
 	       Now just dump out the bitmap we're currently working on, if necessary. */
-	    booltextdev->drawChar(state, x, y, dx, dy, originX, originY, code, nBytes, u, uLen);
+	    if(unclipped) {
+		booltextdev->drawChar(state, x, y, dx, dy, originX, originY, code, nBytes, u, uLen);
+	    } else {
+		/* clip0dev already rasterized the (unclipped) char- reuse its pixels */
+		update_bitmap(booltextbitmap, clip0bitmap, 0, x1, y1, x2, y2, 0);
+	    }
 	    gfxdev->drawChar(state, x, y, dx, dy, originX, originY, code, nBytes, u, uLen);
 	}
     }
@@ -30,6 +30,7 @@
 #include "PDFDoc.h"
 #include "CommonOutputDev.h"
 #include "popplercompat.h"
+#include "bbox.h"
 
 struct ClipState
 {
@@ -194,7 +195,8 @@ private:
     GBool checkNewText(int x1, int y1, int x2, int y2);
     GBool checkNewBitmap(int x1, int y1, int x2, int y2);
     GBool clip0and1differ(int x1,int y1,int x2,int y2);
-    GBool intersection(SplashBitmap*boolpoly, SplashBitmap*booltext, int x1, int y1, int x2, int y2);
+    GBool intersection(SplashBitmap*boolpoly, SplashBitmap*booltext, tilemap_t*staletiles, int x1, int y1, int x2, int y2);
+    GBool charIsUnclipped(int x1, int y1, int x2, int y2);
     
     virtual gfxbbox_t getImageBBox(GfxState*state);
     virtual gfxbbox_t getBBox(GfxState*state);
@@ -210,6 +212,13 @@ private:
     int layerstate;
     GBool emptypage;
 
+    /* numbers the states in debug output */
+    int dbg_btm_counter;
+
+    /* fonts passed to the device, if the info device is shared between
+       threads (and the device hence only gets this page) */
+    gfxfontlist_t*page_font_list;
+
     SplashPath*bboxpath;
 
     SplashOutputDev*rgbdev;
@@ -226,6 +235,10 @@ private:
     SplashBitmap*booltextbitmap;
     SplashBitmap*staletextbitmap;
 
+    /* tiles of stalepolybitmap/staletextbitmap which might contain set pixels */
+    tilemap_t*stalepolytiles;
+    tilemap_t*staletexttiles;
+
     gfxdevice_t* gfxoutput;
     gfxdevice_t* gfxoutput_string;
     CharOutputDev*gfxdev;
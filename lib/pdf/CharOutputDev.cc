@@ -37,6 +37,9 @@
 #ifdef HAVE_FONTCONFIG
 #include <fontconfig.h>
 #endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 // xpdf header files
 #include "popplercompat.h"
@@ -432,7 +435,24 @@ static DisplayFontParamKind detectFontType(const char*filename)
     return displayFontTT;
 }
 
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t displayfont_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 DisplayFontParam *GFXGlobalParams::getDisplayFont(GString *fontName)
+{
+    /* fonts can be looked up from several rendering threads at once */
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&displayfont_mutex);
+#endif
+    DisplayFontParam*dfp = findDisplayFont(fontName);
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&displayfont_mutex);
+#endif
+    return dfp;
+}
+
+DisplayFontParam *GFXGlobalParams::findDisplayFont(GString *fontName)
 {
     msg("<verbose> looking for font %s", fontName->getCString());
 
@@ -525,10 +545,12 @@ CharOutputDev::CharOutputDev(InfoOutputDev*info, PDFDoc*doc, int*page2page, int
     this->num_pages = 0;
     this->links = 0;
     this->last_link = 0;
+    this->sent_fonts = dict_new2(&ptr_type);
 };
 
 CharOutputDev::~CharOutputDev()
 {
+    dict_destroy(this->sent_fonts);this->sent_fonts = 0;
 }
 
 void CharOutputDev::setParameter(const char*key, const char*value)
@@ -577,6 +599,9 @@ static char*getFontName(GfxFont*font)
 static void dumpFontInfo(const char*loglevel, GfxFont*font);
 static int lastdumps[1024];
 static int lastdumppos = 0;
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t lastdumps_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
 /* nr = 0  unknown
    nr = 1  substituting
    nr = 2  type 3
@@ -585,13 +610,20 @@ static void showFontError(GfxFont*font, int nr)
 {  
     Ref*r=font->getID();
     int t;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&lastdumps_mutex);
+#endif
     for(t=0;t<lastdumppos;t++)
 	if(lastdumps[t] == r->num)
 	    break;
-    if(t < lastdumppos)
+    char known = t < lastdumppos;
+    if(!known && lastdumppos < (int)(sizeof(lastdumps)/sizeof(int)))
+	lastdumps[lastdumppos++] = r->num;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&lastdumps_mutex);
+#endif
+    if(known)
       return;
-    if(lastdumppos<sizeof(lastdumps)/sizeof(int))
-    lastdumps[lastdumppos++] = r->num;
     if(nr == 0)
       msg("<warning> The following font caused problems:");
     else if(nr == 1)
@@ -710,8 +742,7 @@ GBool CharOutputDev::useDrawChar()
 const char*renderModeDesc[]= {"fill", "stroke", "fill+stroke", "invisible",
                       "clip+fill", "stroke+clip", "fill+stroke+clip", "clip"};
 
-static char tmp_printstr[4096];
-char* makeStringPrintable(char*str)
+static char* makeStringPrintable(char*str, char*tmp_printstr)
 {
     int len = strlen(str);
     int dots = 0;
@@ -746,7 +777,8 @@ void CharOutputDev::beginString(GfxState *state, GString *s)
     if(current_text_stroke) {
 	msg("<error> Error: Incompatible change of text rendering to %d while inside cliptext", render);
     }
-    msg("<trace> beginString(%s) render=%d", makeStringPrintable(s->getCString()), render);
+    char tmp[84];
+    msg("<trace> beginString(%s) render=%d", makeStringPrintable(s->getCString(), tmp), render);
 }
 
 static gfxline_t* mkEmptyGfxShape(double x, double y)
@@ -769,7 +801,13 @@ void CharOutputDev::drawChar(GfxState *state, double x, double y,
     }
 
     gfxfont_t*current_gfxfont = current_fontinfo->getGfxFont();
-    if(!current_fontinfo->seen) {
+    if(info->shared) {
+	if(!dict_contains(sent_fonts, current_gfxfont)) {
+	    dumpFontInfo("<verbose>", state->getFont());
+	    device->addfont(device, current_gfxfont);
+	    dict_put(sent_fonts, current_gfxfont, 0);
+	}
+    } else if(!current_fontinfo->seen) {
 	dumpFontInfo("<verbose>", state->getFont());
 	device->addfont(device, current_gfxfont);
         current_fontinfo->seen = 1;
@@ -78,6 +78,10 @@ public:
   double last_ascent;
   double last_descent;
   char last_char_was_space;
+
+  /* the fonts passed to the device so far, if the info device is
+     shared between threads (FontInfo::seen is then left alone) */
+  dict_t*sent_fonts;
     
   GFXLink*last_link;
   GFXLink*previous_link;
@@ -114,6 +118,8 @@ class GFXGlobalParams:  public GlobalParams {
     ~GFXGlobalParams();
     virtual DisplayFontParam *getDisplayFont(GString *fontName);
     virtual DisplayFontParam *getDisplayCIDFont(GString *fontName, GString *collection);
+    private:
+    DisplayFontParam *findDisplayFont(GString *fontName);
 };
 
 #endif //__charoutputdev_h__
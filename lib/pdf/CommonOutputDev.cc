@@ -2,6 +2,9 @@
 #include "CommonOutputDev.h"
 #include "../log.h"
 #include "../gfxdevice.h"
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 int config_break_on_warning = 0;
 
@@ -86,22 +89,36 @@ GFXOutputGlobals::~GFXOutputGlobals()
 }
 
 static GFXOutputGlobals*gfxglobals=0;
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t feature_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 static void showfeature(const char*feature, char fully, char warn)
 {
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&feature_mutex);
+#endif
     if(!gfxglobals)
 	gfxglobals = new GFXOutputGlobals();
 
     feature_t*f = gfxglobals->featurewarnings;
     while(f) {
 	if(!strcmp(feature, f->string))
-	    return;
+	    break;
 	f = f->next;
     }
-    f = (feature_t*)malloc(sizeof(feature_t));
-    f->string = strdup(feature);
-    f->next = gfxglobals->featurewarnings;
-    gfxglobals->featurewarnings = f;
+    if(!f) {
+	f = (feature_t*)malloc(sizeof(feature_t));
+	f->string = strdup(feature);
+	f->next = gfxglobals->featurewarnings;
+	gfxglobals->featurewarnings = f;
+	f = 0;
+    }
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&feature_mutex);
+#endif
+    if(f)
+	return;
     if(warn) {
 	msg("<warning> %s not yet %ssupported!",feature,fully?"fully ":"");
     } else {
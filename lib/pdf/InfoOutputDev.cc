@@ -90,6 +90,114 @@ static type_t fontclass_type = {
     fontclass_destroy
 };
 
+typedef struct _glyphkey {
+    char*fontid;
+    int code;
+} glyphkey_t;
+
+static unsigned int glyphkey_hash(const void*_k)
+{
+    const glyphkey_t*k = (const glyphkey_t*)_k;
+    unsigned int h = crc32_add_string(0, k->fontid);
+    return crc32_add_bytes(h, &k->code, sizeof(k->code));
+}
+static char glyphkey_equals(const void*_k1, const void*_k2)
+{
+    const glyphkey_t*k1 = (const glyphkey_t*)_k1;
+    const glyphkey_t*k2 = (const glyphkey_t*)_k2;
+    if(!k1 || !k2)
+	return k1==k2;
+    return k1->code == k2->code && !strcmp(k1->fontid, k2->fontid);
+}
+static void* glyphkey_dup(const void*_k)
+{
+    const glyphkey_t*k = (const glyphkey_t*)_k;
+    glyphkey_t*k2 = (glyphkey_t*)malloc(sizeof(glyphkey_t));
+    k2->fontid = strdup(k->fontid);
+    k2->code = k->code;
+    return k2;
+}
+static void glyphkey_free(void*_k)
+{
+    glyphkey_t*k = (glyphkey_t*)_k;
+    free(k->fontid);
+    free(k);
+}
+static type_t glyphkey_type = {
+    glyphkey_equals,
+    glyphkey_hash,
+    glyphkey_dup,
+    glyphkey_free
+};
+
+static size_t gfxline_size(gfxline_t*line)
+{
+    size_t size = 0;
+    while(line) {
+	size += sizeof(gfxline_t);
+	line = line->next;
+    }
+    return size;
+}
+
+GlyphCache::GlyphCache(size_t budget)
+{
+    this->dict = dict_new2(&glyphkey_type);
+    this->size = 0;
+    this->budget = budget;
+    this->hits = 0;
+    this->misses = 0;
+}
+GlyphCache::~GlyphCache()
+{
+    if(this->hits)
+	msg("<verbose> glyph cache: %d hits, %d misses, %d bytes", this->hits, this->misses, (int)this->size);
+    DICT_ITERATE_DATA(this->dict, GlyphOutline*, o) {
+	delete o->path;
+	gfxline_free(o->line);
+	delete o;
+    }
+    dict_destroy(this->dict);this->dict=0;
+}
+GlyphOutline* GlyphCache::get(const char*fontid, int code)
+{
+    glyphkey_t key = {(char*)fontid, code};
+    GlyphOutline*o = (GlyphOutline*)dict_lookup(this->dict, &key);
+    if(o) this->hits++;
+    else  this->misses++;
+    return o;
+}
+GlyphOutline* GlyphCache::add(const char*fontid, int code, SplashPath*path, double advance)
+{
+    size_t size = sizeof(GlyphOutline) + (path?path->getLength()*(sizeof(SplashPathPoint)+1):0);
+    if(this->size + size > this->budget)
+	return 0;
+    glyphkey_t key = {(char*)fontid, code};
+    GlyphOutline*o = new GlyphOutline;
+    o->path = path?path->copy():0;
+    o->advance = advance;
+    o->line = 0;
+    o->line_quality = 0;
+    o->line_xmax = 0;
+    o->size = size;
+    dict_put(this->dict, &key, o);
+    this->size += size;
+    return o;
+}
+void GlyphCache::setLine(GlyphOutline*o, gfxline_t*line, double quality, double xmax)
+{
+    size_t size = gfxline_size(line);
+    size_t oldsize = gfxline_size(o->line);
+    if(this->size - oldsize + size > this->budget)
+	return;
+    gfxline_free(o->line);
+    o->line = gfxline_clone(line);
+    o->line_quality = quality;
+    o->line_xmax = xmax;
+    o->size += size - oldsize;
+    this->size += size - oldsize;
+}
+
 InfoOutputDev::InfoOutputDev(XRef*xref) 
 {
     num_links = 0;
@@ -108,6 +216,9 @@ InfoOutputDev::InfoOutputDev(XRef*xref)
     last_font = 0;
     current_type3_font = 0;
     fontcache = dict_new2(&fontclass_type);
+    shared = 0;
+    imagecache = imagecache_new(IMAGECACHE_DEFAULT_BUDGET);
+    glyphcache = new GlyphCache(GLYPHCACHE_DEFAULT_BUDGET);
 }
 InfoOutputDev::~InfoOutputDev() 
 {
@@ -117,6 +228,9 @@ InfoOutputDev::~InfoOutputDev()
 	delete fd;
     }
     dict_destroy(this->fontcache);this->fontcache=0;
+    delete glyphcache;glyphcache=0;
+
+    imagecache_destroy(imagecache);imagecache=0;
 
     delete splash;splash=0;
 }
@@ -151,6 +265,10 @@ FontInfo::FontInfo(fontclass_t*fontclass)
     this->scale = 1.0;
     this->num_chars = 0;
     this->num_spaces = 0;
+    this->old_gfxfonts = 0;
+    this->num_old_gfxfonts = 0;
+    this->outdated = 0;
+    this->glyphcache = 0;
     resetPositioning();
 }
 FontInfo::~FontInfo()
@@ -168,6 +286,9 @@ FontInfo::~FontInfo()
     free(glyphs);glyphs=0;
     if(this->gfxfont)
         gfxfont_free(this->gfxfont);
+    for(t=0;t<num_old_gfxfonts;t++)
+        gfxfont_free(old_gfxfonts[t]);
+    free(old_gfxfonts);old_gfxfonts=0;
 
     if(this->fontclass) {
 	fontclass_type.free(this->fontclass);
@@ -274,6 +395,44 @@ gfxbbox_t gfxfont_bbox(gfxfont_t*font)
     return tmp;
 }
 
+static gfxline_t* splashpath_to_gfxline(SplashPath*path, double quality, double*_xmax)
+{
+    gfxdrawer_t drawer;
+    gfxdrawer_target_gfxline(&drawer);
+    int s;
+    int len = path?path->getLength():0;
+    double xmax = 0;
+    for(s=0;s<len;s++) {
+	Guchar f;
+	double x, y;
+	path->getPoint(s, &x, &y, &f);
+	if(!s || x > xmax)
+	    xmax = x;
+	if(f&splashPathFirst) {
+	    drawer.moveTo(&drawer, x, y);
+	}
+	if(f&splashPathCurve) {
+	    double x2,y2;
+	    path->getPoint(++s, &x2, &y2, &f);
+	    if(f&splashPathCurve) {
+		double x3,y3;
+		path->getPoint(++s, &x3, &y3, &f);
+		gfxdraw_cubicTo(&drawer, x, y, x2, y2, x3, y3, quality);
+	    } else {
+		drawer.splineTo(&drawer, x, y, x2, y2);
+	    }
+	} else {
+	    drawer.lineTo(&drawer, x, y);
+	}
+     //   printf("%f %f %s %s\n", x, y, (f&splashPathCurve)?"curve":"",
+     //       			  (f&splashPathFirst)?"first":"",
+     //       			  (f&splashPathLast)?"last":"");
+    }
+
+    *_xmax = xmax;
+    return (gfxline_t*)drawer.result(&drawer);
+}
+
 gfxfont_t* FontInfo::createGfxFont()
 {
     gfxfont_t*font = (gfxfont_t*)rfx_calloc(sizeof(gfxfont_t));
@@ -292,44 +451,21 @@ gfxfont_t* FontInfo::createGfxFont()
     for(t=0;t<this->num_glyphs;t++) {
 	if(this->glyphs[t]) {
 	    SplashPath*path = this->glyphs[t]->path;
-	    int len = path?path->getLength():0;
-	    //printf("glyph %d) %08x (%d line segments)\n", t, path, len);
 	    gfxglyph_t*glyph = &font->glyphs[font->num_glyphs];
 	    this->glyphs[t]->glyphid = font->num_glyphs;
 	    glyph->unicode = this->glyphs[t]->unicode;
-	    gfxdrawer_t drawer;
-	    gfxdrawer_target_gfxline(&drawer);
-	    int s;
-	    int count = 0;
+
+	    GlyphOutline*outline = this->glyphcache?this->glyphcache->get(this->fontclass->id, t):0;
 	    double xmax = 0;
-	    for(s=0;s<len;s++) {
-		Guchar f;
-		double x, y;
-		path->getPoint(s, &x, &y, &f);
-		if(!s || x > xmax)
-		    xmax = x;
-		if(f&splashPathFirst) {
-		    drawer.moveTo(&drawer, x, y);
-		}
-		if(f&splashPathCurve) {
-		    double x2,y2;
-		    path->getPoint(++s, &x2, &y2, &f);
-		    if(f&splashPathCurve) {
-			double x3,y3;
-			path->getPoint(++s, &x3, &y3, &f);
-			gfxdraw_cubicTo(&drawer, x, y, x2, y2, x3, y3, quality);
-		    } else {
-			drawer.splineTo(&drawer, x, y, x2, y2);
-		    }
-		} else {
-		    drawer.lineTo(&drawer, x, y);
-		}
-	     //   printf("%f %f %s %s\n", x, y, (f&splashPathCurve)?"curve":"",
-	     //       			  (f&splashPathFirst)?"first":"",
-	     //       			  (f&splashPathLast)?"last":"");
+	    if(outline && outline->line && outline->line_quality == quality) {
+		/* converted before, for this or another class of this font */
+		glyph->line = gfxline_clone(outline->line);
+		xmax = outline->line_xmax;
+	    } else {
+		glyph->line = splashpath_to_gfxline(path, quality, &xmax);
+		if(outline)
+		    this->glyphcache->setLine(outline, glyph->line, quality, xmax);
 	    }
-
-	    glyph->line = (gfxline_t*)drawer.result(&drawer);
 	    if(this->glyphs[t]->advance>0) {
 		glyph->advance = this->glyphs[t]->advance;
 	    } else {
@@ -411,11 +547,35 @@ static float find_average_glyph_advance(gfxfont_t*f)
     return m;
 }
 
+/* The info pass found a new glyph. If pages were rendered before the info
+   pass got to this one, a gfxfont might already have been passed to a
+   device. In that case, the next getGfxFont() creates a new font (under a
+   new id) which also contains the new glyphs. */
+void FontInfo::glyphAdded()
+{
+    if(this->gfxfont)
+	this->outdated = 1;
+}
+
 gfxfont_t* FontInfo::getGfxFont()
 {
+    if(this->outdated) {
+	/* devices might still reference the old font */
+	this->old_gfxfonts = (gfxfont_t**)realloc(this->old_gfxfonts, sizeof(gfxfont_t*)*(this->num_old_gfxfonts+1));
+	this->old_gfxfonts[this->num_old_gfxfonts++] = this->gfxfont;
+	this->gfxfont = 0;
+	this->outdated = 0;
+	this->seen = 0;
+    }
     if(!this->gfxfont) {
         this->gfxfont = this->createGfxFont();
-        this->gfxfont->id = strdup(this->id);
+	if(this->num_old_gfxfonts) {
+	    char buf[256];
+	    snprintf(buf, sizeof(buf), "%s.%d", this->id, this->num_old_gfxfonts+1);
+	    this->gfxfont->id = strdup(buf);
+	} else {
+	    this->gfxfont->id = strdup(this->id);
+	}
 	this->space_char = findSpace(this->gfxfont);
 	this->average_advance = find_average_glyph_advance(this->gfxfont);
 
@@ -553,7 +713,8 @@ void InfoOutputDev::updateTextMat(GfxState*state)
 GBool InfoOutputDev::needNonText() 
 { 
     /* this switches off certain expensive operations, like
-       pattern fill and forms */
+       pattern fill, shadings (sh) and forms. Patterns and shadings
+       don't draw text, so they don't add any fonts or glyphs. */
     return gFalse; 
 }
 
@@ -692,6 +853,8 @@ FontInfo* InfoOutputDev::getOrCreateFontInfo(GfxState*state)
 	dict_put(this->fontcache, &fontclass, fontinfo);
 	fontinfo->font = font;
 	fontinfo->max_size = 0;
+	if(font->getType() != fontType3)
+	    fontinfo->glyphcache = this->glyphcache;
 	if(current_splash_font) {
 	    fontinfo->ascender = current_splash_font->ascender;
 	    fontinfo->descender = current_splash_font->descender;
@@ -778,10 +941,19 @@ void InfoOutputDev::drawChar(GfxState *state, double x, double y,
     if(!g) {
 	g = fontinfo->glyphs[code] = new GlyphInfo();
 	g->advance_max = 0;
-	current_splash_font->last_advance = -1;
-	g->path = current_splash_font->getGlyphPath(code);
-	g->advance = current_splash_font->last_advance;
+	GlyphOutline*outline = fontinfo->glyphcache?fontinfo->glyphcache->get(fontinfo->fontclass->id, code):0;
+	if(outline) {
+	    g->path = outline->path?outline->path->copy():0;
+	    g->advance = outline->advance;
+	} else {
+	    current_splash_font->last_advance = -1;
+	    g->path = current_splash_font->getGlyphPath(code);
+	    g->advance = current_splash_font->last_advance;
+	    if(fontinfo->glyphcache)
+		fontinfo->glyphcache->add(fontinfo->fontclass->id, code, g->path, g->advance);
+	}
 	g->unicode = 0;
+	fontinfo->glyphAdded();
     }
     if(uLen && ((u[0]>=32 && u[0]<g->unicode) || !g->unicode)) {
 	g->unicode = u[0];
@@ -868,6 +1040,7 @@ GBool InfoOutputDev::beginType3Char(GfxState *state, double x, double y, double
 	currentglyph->x2=dx;
 	currentglyph->y2=dy;
 	currentglyph->advance=dx;
+	fontinfo->glyphAdded();
 	return gFalse;
     } else {
 	return gTrue;
@@ -968,6 +1141,27 @@ void InfoOutputDev::drawSoftMaskedImage(GfxState *state, Object *ref, Stream *st
     OutputDev::drawSoftMaskedImage(state,ref,str,width,height,colorMap, POPPLER_INTERPOLATE_ARG maskStr,maskWidth,maskHeight,maskColorMap POPPLER_MASK_INTERPOLATE_ARG);
 }
     
+/* Before sharing the device, do everything that would otherwise happen
+   lazily on the first lookup: create the gfxfonts, and let the font cache
+   grow its hash table (dict_lookup() does that when it walks a chain). */
+void InfoOutputDev::setShared(char shared)
+{
+    if(shared && !this->shared) {
+	int num = dict_count(fontcache), pos = 0;
+	FontInfo**fonts = (FontInfo**)rfx_alloc(sizeof(FontInfo*)*(num?num:1));
+	DICT_ITERATE_DATA(fontcache, FontInfo*, f) {
+	    fonts[pos++] = f;
+	}
+	int t;
+	for(t=0;t<pos;t++) {
+	    fonts[t]->getGfxFont();
+	    dict_lookup(fontcache, fonts[t]->fontclass);
+	}
+	rfx_free(fonts);
+    }
+    this->shared = shared;
+}
+
 void InfoOutputDev::dumpfonts(gfxdevice_t*dev)
 {
     GHashIter*i;
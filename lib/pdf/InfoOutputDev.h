@@ -49,6 +49,7 @@
 #include "../gfxtools.h"
 #include "../gfxfont.h"
 #include "../q.h"
+#include "imagecache.h"
 
 #define INTERNAL_FONT_SIZE 1024.0
 #define GLYPH_IS_SPACE(g) ((!(g)->line || ((g)->line->type==gfx_moveTo && !(g)->line->next)) && (g)->advance)
@@ -64,6 +65,41 @@ struct GlyphInfo
     double advance_max;
 };
 
+/* outlines of the glyphs of the (non-type3) fonts of the document. A font
+   used in several font classes (colors, or transforms, with
+   remove_font_transforms) has one FontInfo per class, but all of them share
+   the glyph outlines, both as extracted from the font file and as converted
+   to gfxlines. */
+struct GlyphOutline
+{
+    SplashPath*path;
+    double advance;
+
+    gfxline_t*line;
+    double line_quality;
+    double line_xmax;
+    size_t size;
+};
+
+class GlyphCache
+{
+    dict_t*dict;
+    size_t size;
+public:
+    size_t budget;
+    int hits, misses;
+
+    GlyphCache(size_t budget);
+    ~GlyphCache();
+
+    GlyphOutline* get(const char*fontid, int code);
+    /* returns NULL if the cache is full */
+    GlyphOutline* add(const char*fontid, int code, SplashPath*path, double advance);
+    void setLine(GlyphOutline*o, gfxline_t*line, double quality, double xmax);
+};
+
+#define GLYPHCACHE_DEFAULT_BUDGET (32*1024*1024)
+
 typedef struct _fontclass {
     float m00,m01,m10,m11;
     char*id;
@@ -74,17 +110,24 @@ class FontInfo
 {
     gfxfont_t*gfxfont;
 
+    /* fonts handed out before the info pass found all their glyphs */
+    gfxfont_t**old_gfxfonts;
+    int num_old_gfxfonts;
+    char outdated;
+
     char*id;
     double scale;
     
     gfxfont_t* createGfxFont();
 public:
     fontclass_t*fontclass;
+    GlyphCache*glyphcache;
     FontInfo(fontclass_t*fontclass);
     ~FontInfo();
 
     gfxmatrix_t get_gfxmatrix(GfxState*state);
     gfxfont_t* getGfxFont();
+    void glyphAdded();
 
     char usesSpaces();
 
@@ -137,6 +180,16 @@ class InfoOutputDev: public OutputDev
     int num_text_breaks;
     double average_char_size;
 
+    /* decoded images, shared by all the pages of the document */
+    imagecache_t*imagecache;
+    GlyphCache*glyphcache;
+
+    /* set while several threads render with this device. The font cache
+       is then only read from; output devices keep track by themselves of
+       which fonts they passed on. */
+    char shared;
+    void setShared(char shared);
+
     void dumpfonts(gfxdevice_t*dev);
     FontInfo* getFontInfo(GfxState*state);
 
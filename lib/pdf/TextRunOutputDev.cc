@@ -0,0 +1,168 @@
+/* TextRunOutputDev.cc
+   Output device which passes the text of a page, as runs of characters
+   with positions, to a callback.
+
+   This file is part of swftools.
+
+   Swftools is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   Swftools is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with swftools; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <string.h>
+#include "../../config.h"
+#include "../log.h"
+#include "../mem.h"
+#include "GfxState.h"
+#include "GfxFont.h"
+#include "TextRunOutputDev.h"
+
+TextRunOutputDev::TextRunOutputDev(PDFDoc*doc, int*page2page, int num_pages, pdf_textrun_callback_t callback, void*data)
+:CommonOutputDev(0, doc, page2page, num_pages, 0, 0, 0, 0, 0, 0)
+{
+    this->callback = callback;
+    this->data = data;
+    this->num_chars = 0;
+    this->currentpage = 0;
+    this->in_run = 0;
+    memset(&this->run, 0, sizeof(this->run));
+    this->chars_size = 256;
+    this->chars = (pdf_textchar_t*)rfx_alloc(sizeof(pdf_textchar_t)*this->chars_size);
+}
+
+TextRunOutputDev::~TextRunOutputDev()
+{
+    rfx_free(this->chars);this->chars = 0;
+}
+
+void TextRunOutputDev::setDevice(gfxdevice_t*dev)
+{
+}
+
+void TextRunOutputDev::setParameter(const char*key, const char*value)
+{
+}
+
+void TextRunOutputDev::beginPage(GfxState *state, int pageNum)
+{
+    this->currentpage = pageNum;
+    this->in_run = 0;
+}
+
+void TextRunOutputDev::finishPage()
+{
+    flushRun();
+}
+
+GBool TextRunOutputDev::upsideDown()
+{
+    return gTrue;
+}
+GBool TextRunOutputDev::useDrawChar()
+{
+    return gTrue;
+}
+GBool TextRunOutputDev::interpretType3Chars()
+{
+    /* report type 3 chars through drawChar(), like all the others */
+    return gFalse;
+}
+GBool TextRunOutputDev::needNonText()
+{
+    /* skips images, pattern fills and shadings */
+    return gFalse;
+}
+GBool TextRunOutputDev::useShadedFills()
+{
+    return gTrue;
+}
+GBool TextRunOutputDev::functionShadedFill(GfxState *state, GfxFunctionShading *shading)
+{
+    return gTrue;
+}
+GBool TextRunOutputDev::axialShadedFill(GfxState *state, GfxAxialShading *shading POPPLER_RAXIAL_MIN_MAX)
+{
+    return gTrue;
+}
+GBool TextRunOutputDev::radialShadedFill(GfxState *state, GfxRadialShading *shading POPPLER_RAXIAL_MIN_MAX)
+{
+    return gTrue;
+}
+
+void TextRunOutputDev::startRun(GfxState *state)
+{
+    GfxFont*font = state->getFont();
+    GString*name = font?font->getName():0;
+    int render = state->getRender();
+
+    this->run.page = this->currentpage;
+    this->run.fontname = name?name->getCString():"";
+    this->run.fontsize = state->getTransformedFontSize();
+    this->run.invisible = render == RENDER_INVISIBLE ||
+	                  render == RENDER_FILL && state->getFillColorSpace()->isNonMarking() ||
+	                  render == RENDER_STROKE && state->getStrokeColorSpace()->isNonMarking();
+    this->run.num_chars = 0;
+    this->in_run = 1;
+}
+
+void TextRunOutputDev::flushRun()
+{
+    if(this->in_run && this->run.num_chars) {
+	this->run.chars = this->chars;
+	this->callback(&this->run, this->data);
+	this->num_chars += this->run.num_chars;
+    }
+    this->run.num_chars = 0;
+    this->in_run = 0;
+}
+
+void TextRunOutputDev::beginString(GfxState *state, GString *s)
+{
+    flushRun();
+    startRun(state);
+}
+
+void TextRunOutputDev::endString(GfxState *state)
+{
+    flushRun();
+}
+
+void TextRunOutputDev::drawChar(GfxState *state, double x, double y,
+			double dx, double dy,
+			double originX, double originY,
+			CharCode code, int nBytes, Unicode *u, int uLen)
+{
+    if(!this->in_run)
+	startRun(state);
+
+    double px,py,tdx,tdy;
+    this->transformXY(state, x-originX, y-originY, &px, &py);
+    state->transformDelta(dx, dy, &tdx, &tdy);
+
+    /* ligatures map to more than one unicode- spread them over the advance */
+    int n = uLen>0?uLen:1;
+    if(this->run.num_chars + n > this->chars_size) {
+	while(this->run.num_chars + n > this->chars_size)
+	    this->chars_size *= 2;
+	this->chars = (pdf_textchar_t*)rfx_realloc(this->chars, sizeof(pdf_textchar_t)*this->chars_size);
+    }
+    int t;
+    for(t=0;t<n;t++) {
+	pdf_textchar_t*c = &this->chars[this->run.num_chars++];
+	c->unicode = uLen>0?u[t]:0;
+	c->x = px + tdx*t/n;
+	c->y = py + tdy*t/n;
+	c->dx = tdx/n;
+	c->dy = tdy/n;
+    }
+}
@@ -0,0 +1,79 @@
+/* TextRunOutputDev.h
+   Output device which passes the text of a page, as runs of characters
+   with positions, to a callback.
+
+   This file is part of swftools.
+
+   Swftools is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   Swftools is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with swftools; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef __textrunoutputdev_h__
+#define __textrunoutputdev_h__
+
+#include "../gfxdevice.h"
+#include "PDFDoc.h"
+#include "CommonOutputDev.h"
+#include "popplercompat.h"
+#include "pdf.h"
+
+/* Unlike the other output devices, this one doesn't need the info pass:
+   Characters are reported with the unicode xpdf maps them to, so no
+   fonts (and no glyph outlines) are ever built. xpdf is told to skip
+   images, patterns and shadings. */
+class TextRunOutputDev: public CommonOutputDev {
+public:
+    TextRunOutputDev(PDFDoc*doc, int*page2page, int num_pages, pdf_textrun_callback_t callback, void*data);
+    virtual ~TextRunOutputDev();
+
+    // CommonOutputDev:
+    virtual void setDevice(gfxdevice_t*dev);
+    virtual void setParameter(const char*key, const char*value);
+    virtual void beginPage(GfxState *state, int pageNum);
+    virtual void finishPage();
+
+    // OutputDev:
+    virtual GBool upsideDown();
+    virtual GBool useDrawChar();
+    virtual GBool interpretType3Chars();
+    virtual GBool needNonText();
+    virtual GBool useShadedFills();
+    virtual GBool functionShadedFill(GfxState *state, GfxFunctionShading *shading);
+    virtual GBool axialShadedFill(GfxState *state, GfxAxialShading *shading POPPLER_RAXIAL_MIN_MAX);
+    virtual GBool radialShadedFill(GfxState *state, GfxRadialShading *shading POPPLER_RAXIAL_MIN_MAX);
+
+    virtual void beginString(GfxState *state, GString *s);
+    virtual void endString(GfxState *state);
+    virtual void drawChar(GfxState *state, double x, double y,
+			  double dx, double dy,
+			  double originX, double originY,
+			  CharCode code, int nBytes, Unicode *u, int uLen);
+
+    /* number of characters passed to the callback */
+    int num_chars;
+
+private:
+    void startRun(GfxState *state);
+    void flushRun();
+
+    pdf_textrun_callback_t callback;
+    void*data;
+
+    int currentpage;
+    char in_run;
+    pdf_textrun_t run;
+    pdf_textchar_t*chars;
+    int chars_size;
+};
+
+#endif //__textrunoutputdev_h__
@@ -48,6 +48,7 @@
 #include "../devices/render.h"
 
 #include "../png.h"
+#include "cmyk.h"
 
 /* config */
 static int verbose = 0;
@@ -1088,6 +1089,185 @@ void drawimagelossless(gfxdevice_t*dev, gfxcolor_t*mem, int sizex,int sizey,
     drawimage(dev,mem,sizex,sizey,x1,y1,x2,y2,x3,y3,x4,y4, IMAGE_TYPE_LOSSLESS, multiply);
 }
 
+/* what the color map (color space, decode array) and the color key mask do
+   to the pixel values, so that an image drawn with a different color space
+   doesn't come out of the image cache */
+static unsigned int colormap_fingerprint(GfxImageColorMap*colorMap, int*maskColors)
+{
+    Guchar pixBuf[gfxColorMaxComps];
+    GfxRGB rgb;
+    int ncomps = colorMap->getNumPixelComps();
+    int max = (1 << colorMap->getBits()) - 1;
+    unsigned int h = colorMap->getColorSpace()->getMode();
+    int t,c,l;
+    if(max>255)
+	max = 255;
+    if(ncomps==1) {
+	for(t=0;t<=max;t++) {
+	    pixBuf[0] = t;
+	    colorMap->getRGB(pixBuf, &rgb);
+	    h = crc32_add_bytes(h, &rgb, sizeof(rgb));
+	}
+    } else {
+	for(l=1;l<=3;l++)
+	for(c=-1;c<ncomps;c++) {
+	    for(t=0;t<ncomps;t++)
+		pixBuf[t] = (c<0 || c==t)?max*l/3:0;
+	    colorMap->getRGB(pixBuf, &rgb);
+	    h = crc32_add_bytes(h, &rgb, sizeof(rgb));
+	}
+    }
+    if(maskColors)
+	h = crc32_add_bytes(h, maskColors, sizeof(int)*2*ncomps);
+    return h;
+}
+
+/* converts image rows to rgb. For images with one component per pixel, and
+   for rgb images, the color map is evaluated only once per component value,
+   into lookup tables. CMYK images are converted by cmyk_to_rgb_row().
+   Everything else goes through the color map pixel by pixel (but runs of
+   equal pixels are converted only once). */
+#define ROWCONVERT_GENERIC 0
+#define ROWCONVERT_PALETTE 1
+#define ROWCONVERT_RGB 2
+#define ROWCONVERT_CMYK 3
+
+typedef struct _rowconverter {
+    GfxImageColorMap*colorMap;
+    int ncomps;
+    char type;
+    gfxcolor_t pal[256];
+    unsigned char lut[4][256];
+    char cmyk_identity;
+} rowconverter_t;
+
+static GfxColorSpaceMode colorspace_mode(GfxColorSpace*cs)
+{
+#ifndef HAVE_POPPLER
+    /* (poppler might apply the ICC profile) */
+    if(cs->getMode() == csICCBased)
+	cs = ((GfxICCBasedColorSpace*)cs)->getAlt();
+#endif
+    return cs->getMode();
+}
+
+static char is_rgb_colorspace(GfxColorSpace*cs)
+{
+    GfxColorSpaceMode mode = colorspace_mode(cs);
+    return mode == csDeviceRGB || mode == csCalRGB;
+}
+
+/* maps the pixel values of each component to 0..255 (ink), through the
+   decode array. Fails for decode arrays outside of [0,1]. */
+static char rowconverter_init_cmyk(rowconverter_t*c, GfxImageColorMap*colorMap)
+{
+    int max = (1 << colorMap->getBits()) - 1;
+    int i,t;
+    c->cmyk_identity = colorMap->getBits() == 8;
+    for(i=0;i<4;i++) {
+	double low = colorMap->getDecodeLow(i);
+	double high = colorMap->getDecodeHigh(i);
+	if(low<0 || low>1 || high<0 || high>1)
+	    return 0;
+	for(t=0;t<=max;t++) {
+	    c->lut[i][t] = (unsigned char)((low + t*(high-low)/max)*255 + 0.5);
+	    if(c->lut[i][t] != t)
+		c->cmyk_identity = 0;
+	}
+    }
+    return 1;
+}
+
+static void rowconverter_init(rowconverter_t*c, GfxImageColorMap*colorMap)
+{
+    Guchar pixBuf[gfxColorMaxComps];
+    GfxRGB rgb;
+    int n = 1 << colorMap->getBits();
+    int t,i;
+    c->colorMap = colorMap;
+    c->ncomps = colorMap->getNumPixelComps();
+    c->type = ROWCONVERT_GENERIC;
+    if(colorMap->getBits() > 8)
+	return;
+    if(c->ncomps == 1) {
+	memset(c->pal, 0, sizeof(c->pal));
+	for(t=0;t<n;t++) {
+	    pixBuf[0] = t;
+	    colorMap->getRGB(pixBuf, &rgb);
+	    c->pal[t].r = (unsigned char)(colToByte(rgb.r));
+	    c->pal[t].g = (unsigned char)(colToByte(rgb.g));
+	    c->pal[t].b = (unsigned char)(colToByte(rgb.b));
+	    c->pal[t].a = 255;
+	}
+	c->type = ROWCONVERT_PALETTE;
+    } else if(c->ncomps == 3 && is_rgb_colorspace(colorMap->getColorSpace())) {
+	/* each of r,g,b only depends on its own component */
+	memset(pixBuf, 0, 3);
+	for(i=0;i<3;i++) {
+	    for(t=0;t<n;t++) {
+		pixBuf[i] = t;
+		colorMap->getRGB(pixBuf, &rgb);
+		c->lut[i][t] = (unsigned char)(colToByte(i==0?rgb.r:(i==1?rgb.g:rgb.b)));
+	    }
+	    pixBuf[i] = 0;
+	}
+	c->type = ROWCONVERT_RGB;
+    } else if(c->ncomps == 4 && colorspace_mode(colorMap->getColorSpace()) == csDeviceCMYK) {
+	if(rowconverter_init_cmyk(c, colorMap))
+	    c->type = ROWCONVERT_CMYK;
+    }
+}
+
+static void rowconverter_convert(rowconverter_t*c, Guchar*line, gfxcolor_t*out, int width)
+{
+    int x;
+    if(c->type == ROWCONVERT_PALETTE) {
+	for(x=0;x<width;x++) {
+	    out[x] = c->pal[line[x]];
+	}
+    } else if(c->type == ROWCONVERT_RGB) {
+	for(x=0;x<width;x++) {
+	    out[x].r = c->lut[0][line[0]];
+	    out[x].g = c->lut[1][line[1]];
+	    out[x].b = c->lut[2][line[2]];
+	    out[x].a = 255;
+	    line += 3;
+	}
+    } else if(c->type == ROWCONVERT_CMYK) {
+	if(c->cmyk_identity) {
+	    cmyk_to_rgb_row(line, out, width);
+	} else {
+	    unsigned char buf[256*4];
+	    while(width>0) {
+		int n = width<256?width:256;
+		for(x=0;x<n*4;x+=4) {
+		    buf[x+0] = c->lut[0][line[x+0]];
+		    buf[x+1] = c->lut[1][line[x+1]];
+		    buf[x+2] = c->lut[2][line[x+2]];
+		    buf[x+3] = c->lut[3][line[x+3]];
+		}
+		cmyk_to_rgb_row(buf, out, n);
+		line += n*4;
+		out += n;
+		width -= n;
+	    }
+	}
+    } else {
+	GfxRGB rgb;
+	Guchar*last = 0;
+	for(x=0;x<width;x++) {
+	    if(!last || memcmp(line, last, c->ncomps)) {
+		c->colorMap->getRGB(line, &rgb);
+		last = line;
+	    }
+	    out[x].r = (unsigned char)(colToByte(rgb.r));
+	    out[x].g = (unsigned char)(colToByte(rgb.g));
+	    out[x].b = (unsigned char)(colToByte(rgb.b));
+	    out[x].a = 255;
+	    line += c->ncomps;
+	}
+    }
+}
 
 void VectorGraphicOutputDev::drawGeneralImage(GfxState *state, Object *ref, Stream *str,
 				   int width, int height, GfxImageColorMap*colorMap, GBool invert,
@@ -1264,17 +1444,40 @@ void VectorGraphicOutputDev::drawGeneralImage(GfxState *state, Object *ref, Stre
 
   int x,y;
 
+  /* images which are XObjects are often used on more than one page- if
+     we've already decoded this one, reuse the pixels */
+  imagecache_key_t cachekey;
+  char cacheable = info && info->imagecache && ref && ref->isRef() && !inlineImg && !maskbitmap;
+  if(cacheable) {
+      memset(&cachekey, 0, sizeof(cachekey));
+      cachekey.num = ref->getRefNum();
+      cachekey.gen = ref->getRefGen();
+      cachekey.width = width;
+      cachekey.height = height;
+      cachekey.ncomps = ncomps;
+      cachekey.bits = bits;
+      cachekey.colormap = colormap_fingerprint(colorMap, maskColors);
+      gfxcolor_t*pic = imagecache_lookup(info->imagecache, &cachekey);
+      if(pic) {
+	  msg("<verbose> using cached %d by %d image %d %d R", width, height, cachekey.num, cachekey.gen);
+	  if(str->getKind()==strDCT)
+	      drawimagejpeg(device, pic, width, height, x1,y1,x2,y2,x3,y3,x4,y4, config_multiply);
+	  else
+	      drawimagelossless(device, pic, width, height, x1,y1,x2,y2,x3,y3,x4,y4, config_multiply);
+	  free(pic);
+	  delete imgStr;
+	  return;
+      }
+  }
+
   if(colorMap->getNumPixelComps()!=1 || str->getKind()==strDCT) {
       gfxcolor_t*pic=new gfxcolor_t[width*height];
+      rowconverter_t conv;
+      rowconverter_init(&conv, colorMap);
       for (y = 0; y < height; ++y) {
-	for (x = 0; x < width; ++x) {
-	  imgStr->getPixel(pixBuf);
-	  colorMap->getRGB(pixBuf, &rgb);
-	  pic[width*y+x].r = (unsigned char)(colToByte(rgb.r));
-	  pic[width*y+x].g = (unsigned char)(colToByte(rgb.g));
-	  pic[width*y+x].b = (unsigned char)(colToByte(rgb.b));
-	  pic[width*y+x].a = 255;//(U8)(rgb.a * 255 + 0.5);
-	  if(maskbitmap) {
+	rowconverter_convert(&conv, imgStr->getLine(), &pic[width*y], width);
+	if(maskbitmap) {
+	  for (x = 0; x < width; ++x) {
               int x1 = x*maskWidth/width;
               int y1 = y*maskHeight/height;
               int x2 = (x+1)*maskWidth/width;
@@ -1295,6 +1498,8 @@ void VectorGraphicOutputDev::drawGeneralImage(GfxState *state, Object *ref, Stre
 	  }
 	}
       }
+      if(cacheable)
+	  imagecache_store(info->imagecache, &cachekey, pic);
       if(str->getKind()==strDCT)
 	  drawimagejpeg(device, pic, width, height, x1,y1,x2,y2,x3,y3,x4,y4, config_multiply);
       else
@@ -1305,22 +1510,14 @@ void VectorGraphicOutputDev::drawGeneralImage(GfxState *state, Object *ref, Stre
       return;
   } else {
       gfxcolor_t*pic=new gfxcolor_t[width*height];
-      gfxcolor_t pal[256];
-      int n = 1 << colorMap->getBits();
-      int t;
-      for(t=0;t<256;t++) {
-	  pixBuf[0] = t;
-	  colorMap->getRGB(pixBuf, &rgb);
-	  pal[t].r = (unsigned char)(colToByte(rgb.r));
-	  pal[t].g = (unsigned char)(colToByte(rgb.g));
-	  pal[t].b = (unsigned char)(colToByte(rgb.b));
-	  pal[t].a = 255;//(U8)(rgb.b * 255 + 0.5);
-      }
+      rowconverter_t conv;
+      rowconverter_init(&conv, colorMap);
       for (y = 0; y < height; ++y) {
-	for (x = 0; x < width; ++x) {
-	  imgStr->getPixel(pixBuf);
-	  pic[width*y+x] = pal[pixBuf[0]];
-	  if(maskColors && *maskColors==pixBuf[0]) {
+	Guchar*line = imgStr->getLine();
+	rowconverter_convert(&conv, line, &pic[width*y], width);
+	if(maskColors) {
+	  for (x = 0; x < width; ++x) {
+	    if(*maskColors==line[x])
 	      pic[width*y+x].a = 0;
 	  }
 	}
@@ -1353,6 +1550,8 @@ void VectorGraphicOutputDev::drawGeneralImage(GfxState *state, Object *ref, Stre
 	      height = maskHeight;
 	  }
       }
+      if(cacheable)
+	  imagecache_store(info->imagecache, &cachekey, pic);
       drawimagelossless(device, pic, width, height, x1,y1,x2,y2,x3,y3,x4,y4, config_multiply);
 
       delete[] pic;
@@ -15,6 +15,12 @@
 
 #define TEXTOUT_WORD_LIST 1
 
+/* pages can be rendered in parallel (pdf_doc_render_pages_parallel()), so
+   the caches in GlobalParams need their locks */
+#ifdef HAVE_PTHREAD_H
+#define MULTITHREADED 1
+#endif
+
 // todo:
 //
 // HAVE_STRINGS_H
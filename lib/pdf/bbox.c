@@ -5,11 +5,7 @@
 #include <assert.h>
 #include "../types.h"
 #include "../mem.h"
-
-typedef struct _ibbox {
-    int xmin,ymin,xmax,ymax;
-    struct _ibbox*next;
-} ibbox_t;
+#include "bbox.h"
 
 ibbox_t* ibbox_new(int x1, int y1, int x2, int y2)
 {
@@ -163,7 +159,8 @@ static void ibbox_expand(ibbox_t*src, ibbox_t*add)
     if(add->ymax > src->ymax)
 	src->ymax = add->ymax;
 }
-static inline void merge(context_t*context, int set1, int set2)
+/* returns the head which was removed, if any */
+static inline head_t* merge(context_t*context, int set1, int set2)
 {
     void**data = context->group;
     assert(data[set1]);
@@ -179,18 +176,20 @@ static inline void merge(context_t*context, int set1, int set2)
     head_t*h1 = (head_t*)data[head1];
     head_t*h2 = (head_t*)data[head2];
     if(h1==h2)
-	return;
+	return 0;
 
     if(h1->rank>h2->rank) {
 	h1->rank++;
 	ibbox_expand(&h1->bbox,&h2->bbox);
 	data[head2] = (void*)&data[head1];
 	head_delete(context, h2);
+	return h2;
     } else {
 	h2->rank++;
 	ibbox_expand(&h2->bbox,&h1->bbox);
 	data[head1] = (void*)&data[head2];
 	head_delete(context, h1);
+	return h1;
     }
 }
 
@@ -271,7 +270,9 @@ static void overlap_bboxes(context_t*context)
 	    while(h2) {
 		if(h1!=h2) {
 		    if(ibbox_does_overlap(&h1->bbox, &h2->bbox)) {
-			merge(context, h1->pos, h2->pos);
+			/* don't continue with a head we just deleted */
+			if(merge(context, h1->pos, h2->pos) == next)
+			    next = h1->next;
 			changed = 1;
 			break;
 		    }
@@ -421,12 +422,49 @@ static void display(context_t*context)
     }
 }
 
-ibbox_t*get_bitmap_bboxes(unsigned char*alpha, int width, int height, int rowsize)
+static inline U64 load64(unsigned char*p)
+{
+    U64 v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+/* find the area of an alpha plane which has nonzero pixels, testing
+   eight pixels at a time. Returns 0 if the plane is empty. */
+static char get_occupied_area(unsigned char*alpha, int width, int height, int rowsize, ibbox_t*area)
+{
+    int xmin = width, xmax = 0;
+    int ymin = -1, ymax = 0;
+    int y;
+    for(y=0;y<height;y++) {
+	unsigned char*a = &alpha[y*rowsize];
+	int left = 0;
+	while(left+8<=width && !load64(&a[left])) left+=8;
+	while(left<width && !a[left]) left++;
+	if(left==width)
+	    continue;
+	int right = width;
+	while(right-8>=left && !load64(&a[right-8])) right-=8;
+	while(!a[right-1]) right--;
+
+	if(ymin<0)
+	    ymin = y;
+	ymax = y+1;
+	if(left<xmin) xmin = left;
+	if(right>xmax) xmax = right;
+    }
+    if(ymin<0)
+	return 0;
+    area->xmin = xmin;
+    area->ymin = ymin;
+    area->xmax = xmax;
+    area->ymax = ymax;
+    area->next = 0;
+    return 1;
+}
+
+static ibbox_t*get_bitmap_bboxes_area(unsigned char*alpha, int width, int height, int rowsize)
 {
-    int size = width*height;
-    if(width<=1 || height<=1)
-	return get_bitmap_bboxes_simple(alpha, width, height, rowsize);
-    
     context_t context;
     context.alpha = alpha;
     context.rowsize = rowsize;
@@ -463,6 +501,142 @@ ibbox_t*get_bitmap_bboxes(unsigned char*alpha, int width, int height, int rowsiz
     return bboxes;
 }
 
+ibbox_t*get_bitmap_bboxes(unsigned char*alpha, int width, int height, int rowsize)
+{
+    if(width<=1 || height<=1)
+	return get_bitmap_bboxes_simple(alpha, width, height, rowsize);
+
+    /* Only group the pixels of the area which actually is occupied.
+       Keeping one empty row and column in front of that area makes
+       the result the same as if we processed the whole plane. */
+    ibbox_t area;
+    if(!get_occupied_area(alpha, width, height, rowsize, &area))
+	return 0;
+    if(area.xmin>0) area.xmin--;
+    if(area.ymin>0) area.ymin--;
+
+    ibbox_t*bboxes = get_bitmap_bboxes_area(&alpha[area.ymin*rowsize+area.xmin], 
+	    area.xmax-area.xmin, area.ymax-area.ymin, rowsize);
+    ibbox_t*b;
+    for(b=bboxes;b;b=b->next) {
+	b->xmin += area.xmin;
+	b->ymin += area.ymin;
+	b->xmax += area.xmin;
+	b->ymax += area.ymin;
+    }
+    return bboxes;
+}
+
+tilemap_t* tilemap_new(int width, int height)
+{
+    tilemap_t*m = (tilemap_t*)rfx_calloc(sizeof(tilemap_t));
+    m->width8 = (width+7)/8;
+    m->height = height;
+    m->tiles_x = (m->width8+TILE_WIDTH8-1)/TILE_WIDTH8;
+    m->tiles_y = (height+TILE_HEIGHT-1)/TILE_HEIGHT;
+    m->tiles = (unsigned char*)rfx_calloc(m->tiles_x*m->tiles_y+1);
+    return m;
+}
+
+void tilemap_destroy(tilemap_t*m)
+{
+    rfx_free(m->tiles);
+    rfx_free(m);
+}
+
+/* the last tile of a row might be narrower than 64 pixels */
+static inline U64 load_tilerow(unsigned char*p, int len)
+{
+    U64 v = 0;
+    if(len==8) memcpy(&v, p, 8);
+    else       memcpy(&v, p, len);
+    return v;
+}
+static inline void store_tilerow(unsigned char*p, U64 v, int len)
+{
+    if(len==8) memcpy(p, &v, 8);
+    else       memcpy(p, &v, len);
+}
+
+/* the functions below take pixel coordinates which are already clipped
+   against the bitmap, and work on the bytes [x1/8,(x2+7)/8) of rows [y1,y2) */
+#define FOR_TILES(m,x1,y1,x2,y2) \
+    int bx1 = (x1)/8, bx2 = ((x2)+7)/8; \
+    int tx, ty; \
+    for(ty=(y1)/TILE_HEIGHT;ty<=((y2)-1)/TILE_HEIGHT;ty++) { \
+	int ya = ty*TILE_HEIGHT<(y1)?(y1):ty*TILE_HEIGHT; \
+	int yb = (ty+1)*TILE_HEIGHT>(y2)?(y2):(ty+1)*TILE_HEIGHT; \
+	for(tx=bx1/TILE_WIDTH8;tx<=(bx2-1)/TILE_WIDTH8;tx++) { \
+	    int xa = tx*TILE_WIDTH8<bx1?bx1:tx*TILE_WIDTH8; \
+	    int xb = (tx+1)*TILE_WIDTH8>bx2?bx2:(tx+1)*TILE_WIDTH8; \
+	    int len = xb-xa; \
+	    unsigned char*tile = &(m)->tiles[ty*(m)->tiles_x+tx];
+
+#define END_FOR_TILES }}
+
+void tilemap_or(tilemap_t*m, unsigned char*dest, unsigned char*src, int x1, int y1, int x2, int y2, char overwrite)
+{
+    if(x2<=x1 || y2<=y1)
+	return;
+    FOR_TILES(m,x1,y1,x2,y2)
+	U64 any = 0;
+	int y;
+	for(y=ya;y<yb;y++) {
+	    int pos = y*m->width8+xa;
+	    U64 s = load_tilerow(&src[pos], len);
+	    if(overwrite)
+		store_tilerow(&dest[pos], s, len);
+	    else if(s)
+		store_tilerow(&dest[pos], load_tilerow(&dest[pos], len)|s, len);
+	    any |= s;
+	}
+	if(any && !*tile) {
+	    *tile = 1;
+	    m->num_occupied++;
+	}
+    END_FOR_TILES
+}
+
+int tilemap_intersects(tilemap_t*m, unsigned char*data, unsigned char*other, int x1, int y1, int x2, int y2)
+{
+    if(!m->num_occupied || x2<=x1 || y2<=y1)
+	return 0;
+    FOR_TILES(m,x1,y1,x2,y2)
+	if(*tile) {
+	    int y;
+	    for(y=ya;y<yb;y++) {
+		int pos = y*m->width8+xa;
+		if(load_tilerow(&data[pos], len) & load_tilerow(&other[pos], len))
+		    return 1;
+	    }
+	}
+    END_FOR_TILES
+    return 0;
+}
+
+void tilemap_clear(tilemap_t*m, unsigned char*data)
+{
+    if(!m->num_occupied)
+	return;
+    int tx,ty;
+    for(ty=0;ty<m->tiles_y;ty++) {
+	for(tx=0;tx<m->tiles_x;tx++) {
+	    unsigned char*tile = &m->tiles[ty*m->tiles_x+tx];
+	    if(!*tile)
+		continue;
+	    int xa = tx*TILE_WIDTH8;
+	    int len = xa+TILE_WIDTH8>m->width8?m->width8-xa:TILE_WIDTH8;
+	    int yb = (ty+1)*TILE_HEIGHT>m->height?m->height:(ty+1)*TILE_HEIGHT;
+	    int y;
+	    for(y=ty*TILE_HEIGHT;y<yb;y++) {
+		memset(&data[y*m->width8+xa], 0, len);
+	    }
+	    *tile = 0;
+	}
+    }
+    m->num_occupied = 0;
+}
+
 #ifdef MAIN
 int main(int argn, char*argv[])
 {
@@ -12,10 +12,30 @@ typedef struct _ibbox {
 
 ibbox_t ibbox_clip(ibbox_t* outer, ibbox_t* inner);
 
-ibbox_t* ibbox_new(int x1, int y1, int x2, int y2, int rowsize);
+ibbox_t* ibbox_new(int x1, int y1, int x2, int y2);
 void ibbox_destroy(ibbox_t*b);
 ibbox_t*get_bitmap_bboxes(unsigned char*alpha, int width, int height, int rowsize);
 
+/* occupancy map for a 1 bit per pixel bitmap: one flag per tile of
+   64x32 pixels (one 64 bit word per tile row), telling whether that
+   tile might contain set pixels. All bitmap writes have to go through
+   tilemap_or() for the map to stay valid. */
+#define TILE_WIDTH8 8
+#define TILE_HEIGHT 32
+
+typedef struct _tilemap {
+    int width8, height;
+    int tiles_x, tiles_y;
+    unsigned char*tiles;
+    int num_occupied;
+} tilemap_t;
+
+tilemap_t* tilemap_new(int width, int height);
+void tilemap_destroy(tilemap_t*m);
+void tilemap_or(tilemap_t*m, unsigned char*dest, unsigned char*src, int x1, int y1, int x2, int y2, char overwrite);
+int tilemap_intersects(tilemap_t*m, unsigned char*data, unsigned char*other, int x1, int y1, int x2, int y2);
+void tilemap_clear(tilemap_t*m, unsigned char*data);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,4 +1,10 @@
 #ifndef __cmyk_h__
 #define __cmyk_h__
+#include "../gfxdevice.h"
 void convert_cmyk2rgb(float c,float m,float y,float k, unsigned char*r, unsigned char*g, unsigned char*b);
+
+/* converts n pixels of 8 bit cmyk (4 bytes per pixel, 0 = no ink) to rgb,
+   the same way xpdf's DeviceCMYK color space does (within +-1) */
+void cmyk_to_rgb_row(const unsigned char*cmyk, gfxcolor_t*out, int n);
+void cmyk_to_rgb_row_c(const unsigned char*cmyk, gfxcolor_t*out, int n);
 #endif
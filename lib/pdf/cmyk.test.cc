@@ -0,0 +1,93 @@
+/* cmyk.test.cc
+
+   Checks that cmyk_to_rgb_row() (the SSE2 or AVX2 version, if one was
+   compiled in) gives exactly the same colors as cmyk_to_rgb_row_c(), and
+   that both are within +-1 of xpdf's GfxDeviceCMYKColorSpace::getRGB().
+
+   Part of the swftools package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "GfxState.h"
+#include "cmyk.h"
+
+/* all values 0,5,10..255 for c, m and y, every row has all values of k */
+#define STEP 5
+#define NUM (255/STEP+1)
+
+static int check_row(const unsigned char*cmyk, int n, GfxDeviceCMYKColorSpace*cs)
+{
+    gfxcolor_t*fast = (gfxcolor_t*)malloc(sizeof(gfxcolor_t)*n);
+    gfxcolor_t*ref = (gfxcolor_t*)malloc(sizeof(gfxcolor_t)*n);
+    int x, ok = 1;
+    cmyk_to_rgb_row(cmyk, fast, n);
+    cmyk_to_rgb_row_c(cmyk, ref, n);
+    for(x=0;x<n && ok;x++) {
+	const unsigned char*p = &cmyk[x*4];
+	if(memcmp(&fast[x], &ref[x], sizeof(gfxcolor_t))) {
+	    fprintf(stderr, "cmyk %d %d %d %d: %d %d %d %d, should be %d %d %d %d\n",
+		    p[0], p[1], p[2], p[3],
+		    fast[x].a, fast[x].r, fast[x].g, fast[x].b,
+		    ref[x].a, ref[x].r, ref[x].g, ref[x].b);
+	    ok = 0;
+	}
+	GfxColor color;
+	GfxRGB rgb;
+	int i;
+	for(i=0;i<4;i++)
+	    color.c[i] = dblToCol(p[i]/255.0);
+	cs->getRGB(&color, &rgb);
+	if(ref[x].a != 255 ||
+	   abs(ref[x].r - colToByte(rgb.r)) > 1 ||
+	   abs(ref[x].g - colToByte(rgb.g)) > 1 ||
+	   abs(ref[x].b - colToByte(rgb.b)) > 1) {
+	    fprintf(stderr, "cmyk %d %d %d %d: %d %d %d, xpdf has %d %d %d\n",
+		    p[0], p[1], p[2], p[3], ref[x].r, ref[x].g, ref[x].b,
+		    colToByte(rgb.r), colToByte(rgb.g), colToByte(rgb.b));
+	    ok = 0;
+	}
+    }
+    free(fast);
+    free(ref);
+    return ok;
+}
+
+int main(int argn, char*argv[])
+{
+    GfxDeviceCMYKColorSpace cs;
+    unsigned char row[NUM*4*3];
+    int c, m, y, k;
+    for(c=0;c<=255;c+=STEP)
+    for(m=0;m<=255;m+=STEP)
+    for(y=0;y<=255;y+=STEP) {
+	for(k=0;k<NUM;k++) {
+	    unsigned char*p = &row[k*4];
+	    p[0] = c; p[1] = m; p[2] = y; p[3] = k*STEP;
+	}
+	if(!check_row(row, NUM, &cs))
+	    return 1;
+	/* the same pixels again, three times each, for the code which
+	   copies runs of identical pixels */
+	for(k=NUM*3-1;k>=0;k--)
+	    memcpy(&row[k*4], &row[(k/3)*4], 4);
+	if(!check_row(row, NUM*3, &cs))
+	    return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,173 @@
+#include <stdlib.h>
+#include <memory.h>
+#include "../../config.h"
+#include "../types.h"
+#include "../mem.h"
+#include "../q.h"
+#include "../log.h"
+#include "imagecache.h"
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+typedef struct _imagecache_entry {
+    imagecache_key_t key;
+    gfxcolor_t*data;
+    size_t size;
+    /* most recently used first */
+    struct _imagecache_entry*prev;
+    struct _imagecache_entry*next;
+} imagecache_entry_t;
+
+struct _imagecache {
+    dict_t*dict;
+    imagecache_entry_t*first;
+    imagecache_entry_t*last;
+    size_t size;
+    size_t budget;
+    int hits, misses;
+#ifdef HAVE_PTHREAD_H
+    /* pages of the same document may be rendered by several threads
+       (see the "threadsafe" parameter) */
+    pthread_mutex_t mutex;
+#endif
+};
+
+static unsigned int imagekey_hash(const void*k)
+{
+    return crc32_add_bytes(0, k, sizeof(imagecache_key_t));
+}
+static char imagekey_equals(const void*k1, const void*k2)
+{
+    if(!k1 || !k2)
+	return k1==k2;
+    return !memcmp(k1, k2, sizeof(imagecache_key_t));
+}
+static void* imagekey_dup(const void*k)
+{
+    imagecache_key_t*k2 = (imagecache_key_t*)rfx_alloc(sizeof(imagecache_key_t));
+    memcpy(k2, k, sizeof(imagecache_key_t));
+    return k2;
+}
+static void imagekey_free(void*k)
+{
+    rfx_free(k);
+}
+static type_t imagekey_type = {
+    imagekey_equals,
+    imagekey_hash,
+    imagekey_dup,
+    imagekey_free
+};
+
+static void lock(imagecache_t*c)
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&c->mutex);
+#endif
+}
+static void unlock(imagecache_t*c)
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&c->mutex);
+#endif
+}
+
+static void unlink_entry(imagecache_t*c, imagecache_entry_t*e)
+{
+    if(e->prev) e->prev->next = e->next;
+    else        c->first = e->next;
+    if(e->next) e->next->prev = e->prev;
+    else        c->last = e->prev;
+    e->prev = e->next = 0;
+}
+static void link_entry(imagecache_t*c, imagecache_entry_t*e)
+{
+    e->prev = 0;
+    e->next = c->first;
+    if(c->first) c->first->prev = e;
+    else         c->last = e;
+    c->first = e;
+}
+
+static void shrink(imagecache_t*c, size_t budget)
+{
+    while(c->last && c->size > budget) {
+	imagecache_entry_t*e = c->last;
+	unlink_entry(c, e);
+	dict_del(c->dict, &e->key);
+	c->size -= e->size;
+	rfx_free(e->data);
+	rfx_free(e);
+    }
+}
+
+imagecache_t* imagecache_new(size_t budget)
+{
+    imagecache_t*c = (imagecache_t*)rfx_calloc(sizeof(imagecache_t));
+    c->dict = dict_new2(&imagekey_type);
+    c->budget = budget;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_init(&c->mutex, 0);
+#endif
+    return c;
+}
+
+void imagecache_setbudget(imagecache_t*c, size_t budget)
+{
+    lock(c);
+    c->budget = budget;
+    shrink(c, budget);
+    unlock(c);
+}
+
+gfxcolor_t* imagecache_lookup(imagecache_t*c, imagecache_key_t*key)
+{
+    gfxcolor_t*data = 0;
+    lock(c);
+    imagecache_entry_t*e = (imagecache_entry_t*)dict_lookup(c->dict, key);
+    if(e) {
+	unlink_entry(c, e);
+	link_entry(c, e);
+	data = (gfxcolor_t*)rfx_alloc(e->size);
+	memcpy(data, e->data, e->size);
+	c->hits++;
+    } else {
+	c->misses++;
+    }
+    unlock(c);
+    return data;
+}
+
+void imagecache_store(imagecache_t*c, imagecache_key_t*key, gfxcolor_t*data)
+{
+    size_t size = (size_t)key->width*key->height*sizeof(gfxcolor_t);
+    lock(c);
+    if(size > c->budget || dict_contains(c->dict, key)) {
+	unlock(c);
+	return;
+    }
+    shrink(c, c->budget - size);
+
+    imagecache_entry_t*e = (imagecache_entry_t*)rfx_calloc(sizeof(imagecache_entry_t));
+    e->key = *key;
+    e->size = size;
+    e->data = (gfxcolor_t*)rfx_alloc(size);
+    memcpy(e->data, data, size);
+    link_entry(c, e);
+    dict_put(c->dict, key, e);
+    c->size += size;
+    unlock(c);
+}
+
+void imagecache_destroy(imagecache_t*c)
+{
+    if(c->hits)
+	msg("<verbose> image cache: %d hits, %d misses", c->hits, c->misses);
+    shrink(c, 0);
+    dict_destroy(c->dict);
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_destroy(&c->mutex);
+#endif
+    rfx_free(c);
+}
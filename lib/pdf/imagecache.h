@@ -0,0 +1,43 @@
+#ifndef __imagecache_h__
+#define __imagecache_h__
+
+#include <stddef.h>
+#include "../gfxdevice.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* document-wide cache of decoded images, so that an image XObject which
+   is used on many pages (logos, page backgrounds) only has to be decoded
+   once. Images are identified by their object reference plus everything
+   else the decoded pixels depend on (size, bit depth, a fingerprint of the
+   color map). Least recently used images are dropped once the decoded
+   data exceeds the memory budget. */
+
+typedef struct _imagecache_key {
+    int num, gen;
+    int width, height;
+    int ncomps, bits;
+    unsigned int colormap;
+} imagecache_key_t;
+
+typedef struct _imagecache imagecache_t;
+
+#define IMAGECACHE_DEFAULT_BUDGET (64*1024*1024)
+
+imagecache_t* imagecache_new(size_t budget);
+void imagecache_setbudget(imagecache_t*c, size_t budget);
+
+/* returns a copy of the cached pixels (to be free()d by the caller),
+   or NULL if the image isn't in the cache */
+gfxcolor_t* imagecache_lookup(imagecache_t*c, imagecache_key_t*key);
+void imagecache_store(imagecache_t*c, imagecache_key_t*key, gfxcolor_t*data);
+
+void imagecache_destroy(imagecache_t*c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,136 @@
+/* parallel.test.c
+
+   Checks that pdf_doc_render_pages_parallel() produces the same pages,
+   byte for byte, for any number of threads, and that every device gets
+   the fonts of its page, even if other devices got them before.
+
+   Part of the swftools package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../rfxswf.h"
+#include "../gfxdevice.h"
+#include "../gfxsource.h"
+#include "../devices/swf.h"
+#include "pdf.h"
+
+typedef struct _page {
+    unsigned char*data;
+    int len;
+} page_t;
+
+static page_t*render(gfxdocument_t*doc, int*pages, int num_pages, int num_threads)
+{
+    gfxdevice_t**devices = (gfxdevice_t**)rfx_calloc(sizeof(gfxdevice_t*)*num_pages);
+    int t;
+    for(t=0;t<num_pages;t++) {
+	devices[t] = (gfxdevice_t*)rfx_calloc(sizeof(gfxdevice_t));
+	gfxdevice_swf_init(devices[t]);
+    }
+    int done = pdf_doc_render_pages_parallel(doc, pages, num_pages, devices, num_threads);
+    assert(done == num_pages);
+
+    page_t*result = (page_t*)rfx_calloc(sizeof(page_t)*num_pages);
+    for(t=0;t<num_pages;t++) {
+	gfxresult_t*r = devices[t]->finish(devices[t]);
+	SWF*swf = (SWF*)r->get(r, "swf");
+
+	/* text without fonts is what you get if a device doesn't get
+	   addfont() for the fonts used on its page */
+	int texts = 0, fonts = 0;
+	TAG*tag = swf->firstTag;
+	while(tag) {
+	    if(tag->id == ST_DEFINETEXT || tag->id == ST_DEFINETEXT2)
+		texts++;
+	    if(swf_isFontTag(tag))
+		fonts++;
+	    tag = tag->next;
+	}
+	if(texts && !fonts) {
+	    fprintf(stderr, "page %d: %d text tags, but no fonts\n", pages[t], texts);
+	    exit(1);
+	}
+
+	writer_t w;
+	writer_init_growingmemwriter(&w, 65536);
+	swf_WriteSWF2(&w, swf);
+	void*mem = writer_growmemwrite_memptr(&w, &result[t].len);
+	result[t].data = (unsigned char*)rfx_alloc(result[t].len);
+	memcpy(result[t].data, mem, result[t].len);
+	w.finish(&w);
+
+	swf_FreeTags(swf);
+	free(swf);
+	r->destroy(r);
+	free(devices[t]);
+    }
+    free(devices);
+    return result;
+}
+
+int main(int argn, char*argv[])
+{
+    const char*filename = argn>1?argv[1]:"../../spec/textselectspaces.pdf";
+
+    gfxsource_t*driver = gfxsource_pdf_create();
+    gfxdocument_t*doc = driver->open(driver, filename);
+    if(!doc) {
+	fprintf(stderr, "Couldn't open %s\n", filename);
+	return 1;
+    }
+
+    /* every page twice, in reverse order */
+    int num_pages = doc->num_pages*2;
+    int*pages = (int*)rfx_alloc(sizeof(int)*num_pages);
+    int t;
+    for(t=0;t<num_pages;t++) {
+	pages[t] = doc->num_pages - t%doc->num_pages;
+    }
+
+    page_t*seq = render(doc, pages, num_pages, 1);
+    for(t=0;t<doc->num_pages;t++) {
+	page_t*p1 = &seq[t], *p2 = &seq[t+doc->num_pages];
+	if(p1->len != p2->len || memcmp(p1->data, p2->data, p1->len)) {
+	    fprintf(stderr, "page %d differs from its second copy\n", pages[t]);
+	    return 1;
+	}
+    }
+    int threads;
+    for(threads=2;threads<=4;threads+=2) {
+	page_t*par = render(doc, pages, num_pages, threads);
+	for(t=0;t<num_pages;t++) {
+	    if(seq[t].len != par[t].len || memcmp(seq[t].data, par[t].data, seq[t].len)) {
+		fprintf(stderr, "page %d differs with %d threads\n", pages[t], threads);
+		return 1;
+	    }
+	    free(par[t].data);
+	}
+	free(par);
+    }
+    for(t=0;t<num_pages;t++) {
+	free(seq[t].data);
+    }
+    free(seq);
+    free(pages);
+
+    doc->destroy(doc);
+    driver->destroy(driver);
+    printf("ok\n");
+    return 0;
+}
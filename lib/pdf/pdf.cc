@@ -16,17 +16,25 @@
 #include "FullBitmapOutputDev.h"
 #include "BitmapOutputDev.h"
 #include "VectorGraphicOutputDev.h"
+#include "TextRunOutputDev.h"
 #include "../mem.h"
+#include "../timer.h"
 #include "pdf.h"
 #define NO_ARGPARSER
 #include "../args.h"
 #include "../utf8.h"
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 static double zoom = 72; /* xpdf: 86 */
 static int zoomtowidth = 0;
 static double multiply = 1.0;
 static char* global_page_range = 0;
 static int threadsafe = 0;
+static int infothread = 0;
+static int imagecache_mb = -1;
+static int glyphcache_mb = -1;
 
 static int globalparams_count=0;
 
@@ -37,6 +45,7 @@ typedef struct _pdf_page_info
     int number_of_images;
     int number_of_links;
     int number_of_fonts;
+    char in_range;
     char has_info;
 } pdf_page_info_t;
 
@@ -51,6 +60,10 @@ typedef struct _pdf_doc_internal
     int protect;
     int nocopy;
     int noprint;
+
+    /* render settings, initialized from the (global) source parameters */
+    double zoom;
+    double multiply;
    
     GString*fileName;
     GString*userPW;
@@ -60,8 +73,20 @@ typedef struct _pdf_doc_internal
     InfoOutputDev*info;
 
     pdf_page_info_t*pages;
+    int num_pages;
     char*filename;
 
+#ifdef HAVE_PTHREAD_H
+    /* the info pass for the upcoming pages, see pdf_doc_lock() */
+    char info_thread_running;
+    pthread_t info_thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    char busy;
+    char stop;
+    int waiting;
+#endif
+
     /* page map */
     int*pagemap;
     int pagemap_size;
@@ -95,6 +120,107 @@ static const char* dirseparator()
 #endif
 }
 
+/* The document, and the InfoOutputDev with the font cache, are shared with
+   the background info pass (see the "infothread" parameter). Everything
+   else has to lock them while using them, and takes precedence. */
+static void pdf_doc_lock(pdf_doc_internal_t*i)
+{
+#ifdef HAVE_PTHREAD_H
+    if(!i->info_thread_running)
+	return;
+    pthread_mutex_lock(&i->mutex);
+    i->waiting++;
+    while(i->busy)
+	pthread_cond_wait(&i->cond, &i->mutex);
+    i->waiting--;
+    i->busy = 1;
+    pthread_mutex_unlock(&i->mutex);
+#endif
+}
+
+static void pdf_doc_unlock(pdf_doc_internal_t*i)
+{
+#ifdef HAVE_PTHREAD_H
+    if(!i->info_thread_running)
+	return;
+    pthread_mutex_lock(&i->mutex);
+    i->busy = 0;
+    pthread_cond_broadcast(&i->cond);
+    pthread_mutex_unlock(&i->mutex);
+#endif
+}
+
+static void page_info_pass(pdf_doc_internal_t*i, PDFDoc*doc, InfoOutputDev*info, int t, pdf_page_info_t*p)
+{
+    TIMER_START(starttime);
+    doc->displayPage((OutputDev*)info, t, i->zoom, i->zoom, /*rotate*/0, /*usemediabox*/true, /*crop*/true, i->config_print);
+    doc->processLinks((OutputDev*)info, t);
+    TIMER_STOP(TIMER_PDFINFO, starttime);
+    p->xMin = info->x1;
+    p->yMin = info->y1;
+    p->xMax = info->x2;
+    p->yMax = info->y2;
+    p->width = info->x2 - info->x1;
+    p->height = info->y2 - info->y1;
+    p->number_of_images = info->num_ppm_images + info->num_jpeg_images;
+    p->number_of_links = info->num_links;
+    p->number_of_fonts = info->num_fonts;
+    p->has_info = 1;
+}
+
+/* Run the InfoOutputDev over a page, unless that already happened. This
+   determines the page's size, and adds its fonts and glyphs to the font
+   cache of the document. */
+static void pdf_page_info(pdf_doc_internal_t*i, int t)
+{
+    if(t < 1 || t > i->num_pages)
+	return;
+    pdf_page_info_t*p = &i->pages[t-1];
+    if(!p->in_range || p->has_info)
+	return;
+    page_info_pass(i, i->doc, i->info, t, p);
+}
+
+/* Run the info pass over all pages in range. A device which gets a font
+   before the info pass has seen all of its glyphs gets a second copy of
+   the font once more glyphs turn up, so unless the "infothread" parameter
+   asked for pages to be analyzed as they come, the first page rendered
+   (and prepare()) analyzes the whole document. */
+static void pdf_all_pages_info(pdf_doc_internal_t*i)
+{
+    int t;
+    for(t=1;t<=i->num_pages;t++) {
+	pdf_page_info(i, t);
+    }
+}
+
+#ifdef HAVE_PTHREAD_H
+static void* pdf_info_thread(void*_i)
+{
+    pdf_doc_internal_t*i = (pdf_doc_internal_t*)_i;
+    int t;
+    for(t=1;t<=i->num_pages;t++) {
+	pthread_mutex_lock(&i->mutex);
+	while(i->busy || i->waiting)
+	    pthread_cond_wait(&i->cond, &i->mutex);
+	if(i->stop) {
+	    pthread_mutex_unlock(&i->mutex);
+	    break;
+	}
+	i->busy = 1;
+	pthread_mutex_unlock(&i->mutex);
+
+	pdf_page_info(i, t);
+
+	pthread_mutex_lock(&i->mutex);
+	i->busy = 0;
+	pthread_cond_broadcast(&i->cond);
+	pthread_mutex_unlock(&i->mutex);
+    }
+    return 0;
+}
+#endif
+
 void pdfpage_destroy(gfxpage_t*pdf_page)
 {
     pdf_page_internal_t*i= (pdf_page_internal_t*)pdf_page->internal;
@@ -102,26 +228,26 @@ void pdfpage_destroy(gfxpage_t*pdf_page)
     free(pdf_page);pdf_page=0;
 }
 
-static void render2(gfxpage_t*page, gfxdevice_t*dev, int x,int y, int x1,int y1,int x2,int y2)
+/* Render page nr of the document into dev, using the given xpdf document
+   and info device. The info device is always the document's own one; the
+   xpdf document is, too, unless we are in one of the threads of
+   pdf_doc_render_pages_parallel(). */
+static void render_page(pdf_doc_internal_t*pi, PDFDoc*doc, InfoOutputDev*info, int nr, gfxdevice_t*dev, int x,int y, int x1,int y1,int x2,int y2)
 {
-    pdf_doc_internal_t*pi = (pdf_doc_internal_t*)page->parent->internal;
     gfxsource_internal_t*i = (gfxsource_internal_t*)pi->parent->internal;
 
-    if(!pi->config_print && pi->nocopy) {msg("<fatal> PDF disallows copying");exit(0);}
-    if(pi->config_print && pi->noprint) {msg("<fatal> PDF disallows printing");exit(0);}
-
     CommonOutputDev*outputDev = 0;
     if(pi->config_full_bitmap_optimizing) {
-	FullBitmapOutputDev*d = new FullBitmapOutputDev(pi->info, pi->doc, pi->pagemap, pi->pagemap_pos, x, y, x1, y1, x2, y2);
+	FullBitmapOutputDev*d = new FullBitmapOutputDev(info, doc, pi->pagemap, pi->pagemap_pos, x, y, x1, y1, x2, y2);
 	outputDev = (CommonOutputDev*)d;
     } else if(pi->config_bitmap_optimizing) {
-	BitmapOutputDev*d = new BitmapOutputDev(pi->info, pi->doc, pi->pagemap, pi->pagemap_pos, x, y, x1, y1, x2, y2);
+	BitmapOutputDev*d = new BitmapOutputDev(info, doc, pi->pagemap, pi->pagemap_pos, x, y, x1, y1, x2, y2);
 	outputDev = (CommonOutputDev*)d;
     } else if(pi->config_only_text) {
-	CharOutputDev*d = new CharOutputDev(pi->info, pi->doc, pi->pagemap, pi->pagemap_pos, x, y, x1, y1, x2, y2);
+	CharOutputDev*d = new CharOutputDev(info, doc, pi->pagemap, pi->pagemap_pos, x, y, x1, y1, x2, y2);
 	outputDev = (CommonOutputDev*)d;
     } else {
-	VectorGraphicOutputDev*d = new VectorGraphicOutputDev(pi->info, pi->doc, pi->pagemap, pi->pagemap_pos, x, y, x1, y1, x2, y2);
+	VectorGraphicOutputDev*d = new VectorGraphicOutputDev(info, doc, pi->pagemap, pi->pagemap_pos, x, y, x1, y1, x2, y2);
 	outputDev = (CommonOutputDev*)d;
     }
 
@@ -138,30 +264,20 @@ static void render2(gfxpage_t*page, gfxdevice_t*dev, int x,int y, int x1,int y1,
     }
 
     gfxdevice_t* middev=0;
-    if(multiply!=1.0) {
+    if(pi->multiply!=1.0) {
     	middev = (gfxdevice_t*)malloc(sizeof(gfxdevice_t));
-	gfxdevice_rescale_init(middev, 0x00000000, 0, 0, 1.0 / multiply);
+	gfxdevice_rescale_init(middev, 0x00000000, 0, 0, 1.0 / pi->multiply);
         gfxdevice_rescale_setdevice(middev, dev);
 	dev = middev;
     } 
-	
-    if(!pi) {
-	msg("<fatal> pdf_page_render: Parent PDF this page belongs to doesn't exist yet/anymore");
-	return;
-    }
-
-    if(!pi->pages[page->nr-1].has_info) {
-	msg("<fatal> pdf_page_render: page %d was previously set as not-to-render via the \"pages\" option", page->nr);
-	return;
-    }
 
     if(pi->protect) {
         dev->setparameter(dev, "protect", "1");
     }
 
     outputDev->setDevice(dev);
-    pi->doc->processLinks((OutputDev*)outputDev, page->nr);
-    pi->doc->displayPage((OutputDev*)outputDev, page->nr, zoom*multiply, zoom*multiply, /*rotate*/0, true, true, pi->config_print);
+    doc->processLinks((OutputDev*)outputDev, nr);
+    doc->displayPage((OutputDev*)outputDev, nr, pi->zoom*pi->multiply, pi->zoom*pi->multiply, /*rotate*/0, true, true, pi->config_print);
     outputDev->finishPage();
     outputDev->setDevice(0);
     delete outputDev;
@@ -170,6 +286,32 @@ static void render2(gfxpage_t*page, gfxdevice_t*dev, int x,int y, int x1,int y1,
 	gfxdevice_rescale_setdevice(middev, 0x00000000);
 	middev->finish(middev);
     }
+}
+
+static void render2(gfxpage_t*page, gfxdevice_t*dev, int x,int y, int x1,int y1,int x2,int y2)
+{
+    pdf_doc_internal_t*pi = (pdf_doc_internal_t*)page->parent->internal;
+
+    if(!pi) {
+	msg("<fatal> pdf_page_render: Parent PDF this page belongs to doesn't exist yet/anymore");
+	return;
+    }
+
+    if(!pi->config_print && pi->nocopy) {msg("<fatal> PDF disallows copying");exit(0);}
+    if(pi->config_print && pi->noprint) {msg("<fatal> PDF disallows printing");exit(0);}
+
+    if(!pi->pages[page->nr-1].in_range) {
+	msg("<fatal> pdf_page_render: page %d was previously set as not-to-render via the \"pages\" option", page->nr);
+	return;
+    }
+
+    pdf_doc_lock(pi);
+    if(infothread)
+	pdf_page_info(pi, page->nr);
+    else
+	pdf_all_pages_info(pi);
+    render_page(pi, pi->doc, pi->info, page->nr, dev, x, y, x1, y1, x2, y2);
+    pdf_doc_unlock(pi);
 
 }
 
@@ -187,14 +329,27 @@ void pdfpage_rendersection(gfxpage_t*page, gfxdevice_t*output, gfxcoord_t x, gfx
     int x1=(int)_x1,y1=(int)_y1,x2=(int)_x2,y2=(int)_y2;
     if((x1|y1|x2|y2)==0) x2++;
 
-    render2(page, output, (int)x*multiply,(int)y*multiply,
-                          (int)x1*multiply,(int)y1*multiply,(int)x2*multiply,(int)y2*multiply);
+    render2(page, output, (int)x*pi->multiply,(int)y*pi->multiply,
+                          (int)x1*pi->multiply,(int)y1*pi->multiply,(int)x2*pi->multiply,(int)y2*pi->multiply);
 }
 
 void pdf_doc_destroy(gfxdocument_t*gfx)
 {
     pdf_doc_internal_t*i= (pdf_doc_internal_t*)gfx->internal;
 
+#ifdef HAVE_PTHREAD_H
+    if(i->info_thread_running) {
+	pthread_mutex_lock(&i->mutex);
+	i->stop = 1;
+	pthread_cond_broadcast(&i->cond);
+	pthread_mutex_unlock(&i->mutex);
+	pthread_join(i->info_thread, 0);
+	i->info_thread_running = 0;
+	pthread_mutex_destroy(&i->mutex);
+	pthread_cond_destroy(&i->cond);
+    }
+#endif
+
     if (i->userPW) {
 	delete i->userPW;i->userPW = 0;
     }
@@ -280,6 +435,11 @@ void pdf_doc_setparameter(gfxdocument_t*gfx, const char*name, const char*value)
         i->config_print = atoi(value);
     } else if(!strcmp(name, "onlytext")) {
         i->config_only_text = atoi(value);
+    } else if(!strcmp(name, "zoom")) {
+        i->zoom = atof(value);
+    } else if(!strcmp(name, "multiply")) {
+        i->multiply = atof(value);
+        gfxparams_store(i->parameters, name, value);
     } else {
         gfxparams_store(i->parameters, name, value);
     }
@@ -299,6 +459,26 @@ gfxpage_t* pdf_doc_getpage(gfxdocument_t*doc, int page)
 
     if(page < 1 || page > doc->num_pages)
         return 0;
+
+    pdf_doc_lock(di);
+    pdf_page_info(di, page);
+    pdf_doc_unlock(di);
+
+#ifdef HAVE_PTHREAD_H
+    if(infothread && !threadsafe && !di->info_thread_running && !di->stop) {
+	/* from now on, run the info pass for the upcoming pages in the
+	   background, whenever nobody else is using the document */
+	pthread_mutex_init(&di->mutex, 0);
+	pthread_cond_init(&di->cond, 0);
+	di->info_thread_running = 1;
+	if(pthread_create(&di->info_thread, 0, pdf_info_thread, di)) {
+	    di->info_thread_running = 0;
+	    di->stop = 1;
+	    pthread_mutex_destroy(&di->mutex);
+	    pthread_cond_destroy(&di->cond);
+	}
+    }
+#endif
     
     gfxpage_t* pdf_page = (gfxpage_t*)malloc(sizeof(gfxpage_t));
     pdf_page_internal_t*pi= (pdf_page_internal_t*)malloc(sizeof(pdf_page_internal_t));
@@ -362,7 +542,7 @@ static char*getInfoDate(Dict *infoDict, const char *key)
     return strdup("");
 }
 
-char* pdf_doc_getinfo(gfxdocument_t*doc, const char*name)
+static char* pdf_doc_getinfo2(gfxdocument_t*doc, const char*name)
 {
     pdf_doc_internal_t*i= (pdf_doc_internal_t*)doc->internal;
     if(!strcmp(name, "title")) return getInfoString(i->docinfo.getDict(), "Title");
@@ -392,6 +572,15 @@ char* pdf_doc_getinfo(gfxdocument_t*doc, const char*name)
     return strdup("");
 }
 
+char* pdf_doc_getinfo(gfxdocument_t*doc, const char*name)
+{
+    pdf_doc_internal_t*i= (pdf_doc_internal_t*)doc->internal;
+    pdf_doc_lock(i);
+    char*ret = pdf_doc_getinfo2(doc, name);
+    pdf_doc_unlock(i);
+    return ret;
+}
+
 
 /* shortcut to InfoOutputDev.cc */
 extern int config_unique_unicode;
@@ -448,6 +637,12 @@ static void pdf_setparameter(gfxsource_t*src, const char*name, const char*value)
         addGlobalLanguageDir(value);
     } else if(!strcmp(name, "threadsafe")) {
 	threadsafe = atoi(value);
+    } else if(!strcmp(name, "infothread")) {
+	infothread = atoi(value);
+    } else if(!strcmp(name, "imagecache")) {
+	imagecache_mb = atoi(value);
+    } else if(!strcmp(name, "glyphcache")) {
+	glyphcache_mb = atoi(value);
     } else if(!strcmp(name, "zoomtowidth")) {
 	zoomtowidth = atoi(value);
     } else if(!strcmp(name, "zoom")) {
@@ -467,13 +662,182 @@ static void pdf_setparameter(gfxsource_t*src, const char*name, const char*value)
 	printf("multiply=<times>  Render everything at <times> the resolution\n");
 	printf("poly2bitmap       Convert graphics to bitmaps\n");
 	printf("bitmap            Convert everything to bitmaps\n");
+	printf("infothread        Analyze the upcoming pages in a background thread\n");
+	printf("imagecache=<MB>   Memory for caching decoded images across pages (default: %d, 0 disables)\n", IMAGECACHE_DEFAULT_BUDGET>>20);
+	printf("glyphcache=<MB>   Memory for sharing glyph outlines between font classes (default: %d)\n", GLYPHCACHE_DEFAULT_BUDGET>>20);
     }	
 }
 
 void pdf_doc_prepare(gfxdocument_t*doc, gfxdevice_t*dev)
 {
     pdf_doc_internal_t*i= (pdf_doc_internal_t*)doc->internal;
+    /* the device gets all fonts at once, so they need to contain the
+       glyphs of all pages */
+    pdf_doc_lock(i);
+    pdf_all_pages_info(i);
     i->info->dumpfonts(dev);
+    pdf_doc_unlock(i);
+}
+
+int pdf_doc_extract_text(gfxdocument_t*gfx, int page, pdf_textrun_callback_t callback, void*data)
+{
+    pdf_doc_internal_t*pi = (pdf_doc_internal_t*)gfx->internal;
+
+    if(!pi->config_print && pi->nocopy) {
+	msg("<error> PDF disallows copying");
+	return 0;
+    }
+    if(page < 1 || page > pi->num_pages || !pi->pages[page-1].in_range)
+	return 0;
+
+    TextRunOutputDev*out = new TextRunOutputDev(pi->doc, pi->pagemap, pi->pagemap_pos, callback, data);
+    pdf_doc_lock(pi);
+    pi->doc->displayPage((OutputDev*)out, page, pi->zoom, pi->zoom, /*rotate*/0, true, true, pi->config_print);
+    out->finishPage();
+    pdf_doc_unlock(pi);
+    int num_chars = out->num_chars;
+    delete out;
+    return num_chars;
+}
+
+static InfoOutputDev* create_info_device(PDFDoc*doc)
+{
+    InfoOutputDev*info = new InfoOutputDev(doc->getXRef());
+    if(imagecache_mb>=0)
+	imagecache_setbudget(info->imagecache, (size_t)imagecache_mb<<20);
+    if(glyphcache_mb>=0)
+	info->glyphcache->budget = (size_t)glyphcache_mb<<20;
+    return info;
+}
+
+typedef struct _render_job
+{
+    pdf_doc_internal_t*pi;
+    int*pages;
+    gfxdevice_t**devices;
+    int num_pages;
+    int next;
+    int done;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_t mutex;
+#endif
+} render_job_t;
+
+static char render_job_valid_page(render_job_t*job, int k)
+{
+    int nr = job->pages[k];
+    return nr >= 1 && nr <= job->pi->num_pages && job->pi->pages[nr-1].in_range;
+}
+
+/* Render pages from the job, using the given xpdf document, until there
+   are none left. Fonts and page sizes come from the document's info pass,
+   which has seen all pages before the workers start, and is only read
+   from while they run. */
+static void render_job_run(render_job_t*job, PDFDoc*doc)
+{
+    pdf_doc_internal_t*pi = job->pi;
+    int done = 0;
+    while(1) {
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&job->mutex);
+#endif
+	int k = job->next++;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&job->mutex);
+#endif
+	if(k >= job->num_pages)
+	    break;
+
+	int nr = job->pages[k];
+	if(!render_job_valid_page(job, k)) {
+	    msg("<error> pdf_doc_render_pages_parallel: can't render page %d", nr);
+	    continue;
+	}
+
+	pdf_page_info_t*p = &pi->pages[nr-1];
+	gfxdevice_t*dev = job->devices[k];
+	dev->startpage(dev, p->width, p->height);
+	render_page(pi, doc, pi->info, nr, dev, 0, 0, 0, 0, 0, 0);
+	dev->endpage(dev);
+	done++;
+    }
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&job->mutex);
+#endif
+    job->done += done;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&job->mutex);
+#endif
+}
+
+#ifdef HAVE_PTHREAD_H
+/* One of the extra threads of pdf_doc_render_pages_parallel(). It opens
+   the file again, so that it has its own xref and parser state. If that
+   fails, it doesn't take any pages; the other threads render them. */
+static void* render_job_thread(void*_job)
+{
+    render_job_t*job = (render_job_t*)_job;
+    pdf_doc_internal_t*pi = job->pi;
+    /* the PDFDoc takes ownership of the file name */
+    PDFDoc*doc = new PDFDoc(new GString(pi->fileName), pi->userPW);
+    if(!doc->isOk()) {
+	msg("<warning> Couldn't reopen %s, rendering with one thread less", pi->filename);
+    } else {
+	render_job_run(job, doc);
+    }
+    delete doc;
+    return 0;
+}
+#endif
+
+int pdf_doc_render_pages_parallel(gfxdocument_t*gfx, int*pages, int num_pages, gfxdevice_t**devices, int num_threads)
+{
+    pdf_doc_internal_t*pi = (pdf_doc_internal_t*)gfx->internal;
+
+    if(!pi->config_print && pi->nocopy) {msg("<error> PDF disallows copying");return -1;}
+    if(pi->config_print && pi->noprint) {msg("<error> PDF disallows printing");return -1;}
+
+    render_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.pi = pi;
+    job.pages = pages;
+    job.devices = devices;
+    job.num_pages = num_pages;
+
+    if(num_threads > num_pages)
+	num_threads = num_pages;
+
+    /* one info pass for all workers. Each device gets the fonts of its
+       own page, so the output doesn't depend on which thread rendered
+       what, or on which pages were rendered before. */
+    pdf_doc_lock(pi);
+    pdf_all_pages_info(pi);
+    pi->info->setShared(1);
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_init(&job.mutex, 0);
+    pthread_t*threads = (pthread_t*)rfx_calloc(sizeof(pthread_t)*(num_threads>1?num_threads:1));
+    int t, started = 0;
+    /* the calling thread is the first worker. It renders with the
+       document's own xpdf document, which the lock gives us. */
+    for(t=1;t<num_threads;t++) {
+	if(pthread_create(&threads[started], 0, render_job_thread, &job))
+	    break;
+	started++;
+    }
+    msg("<verbose> Rendering %d pages with %d threads", num_pages, started+1);
+    render_job_run(&job, pi->doc);
+    for(t=0;t<started;t++) {
+	pthread_join(threads[t], 0);
+    }
+    rfx_free(threads);
+    pthread_mutex_destroy(&job.mutex);
+#else
+    render_job_run(&job, pi->doc);
+#endif
+    pi->info->setShared(0);
+    pdf_doc_unlock(pi);
+    return job.done;
 }
 
 static gfxdocument_t*pdf_open(gfxsource_t*src, const char*filename)
@@ -524,33 +888,21 @@ static gfxdocument_t*pdf_open(gfxsource_t*src, const char*filename)
           if(!i->doc->okToChange() || !i->doc->okToAddNotes())
               i->protect = 1;
     }
-	
-    if(zoomtowidth && i->doc->getNumPages()) {
-	Page*page = i->doc->getCatalog()->getPage(1);
-	PDFRectangle *r = page->getCropBox();
-	double width_before = r->x2 - r->x1;
-	zoom = 72.0 * zoomtowidth / width_before;
-	msg("<notice> Rendering at %f DPI. (Page width at 72 DPI: %f, target width: %d)", zoom, width_before, zoomtowidth);
-    }
 
-    i->info = new InfoOutputDev(i->doc->getXRef());
+    i->zoom = zoom;
+    i->multiply = multiply;
+
+    /* The info pass over the pages happens on demand: for a single page
+       when it is requested, for all of them when the first page is
+       rendered (see pdf_all_pages_info()). */
+    i->info = create_info_device(i->doc);
     int t;
+    i->num_pages = pdf_doc->num_pages;
     i->pages = (pdf_page_info_t*)malloc(sizeof(pdf_page_info_t)*pdf_doc->num_pages);
     memset(i->pages,0,sizeof(pdf_page_info_t)*pdf_doc->num_pages);
     for(t=1;t<=pdf_doc->num_pages;t++) {
 	if(!global_page_range || is_in_range(t, global_page_range)) {
-	    i->doc->displayPage((OutputDev*)i->info, t, zoom, zoom, /*rotate*/0, /*usemediabox*/true, /*crop*/true, i->config_print);
-	    i->doc->processLinks((OutputDev*)i->info, t);
-	    i->pages[t-1].xMin = i->info->x1;
-	    i->pages[t-1].yMin = i->info->y1;
-	    i->pages[t-1].xMax = i->info->x2;
-	    i->pages[t-1].yMax = i->info->y2;
-	    i->pages[t-1].width = i->info->x2 - i->info->x1;
-	    i->pages[t-1].height = i->info->y2 - i->info->y1;
-	    i->pages[t-1].number_of_images = i->info->num_ppm_images + i->info->num_jpeg_images;
-	    i->pages[t-1].number_of_links = i->info->num_links;
-	    i->pages[t-1].number_of_fonts = i->info->num_fonts;
-	    i->pages[t-1].has_info = 1;
+	    i->pages[t-1].in_range = 1;
 	}
     }
 
@@ -567,6 +919,14 @@ static gfxdocument_t*pdf_open(gfxsource_t*src, const char*filename)
 	pdf_doc->setparameter(pdf_doc, p->key, p->value);
 	p = p->next;
     }
+
+    if(zoomtowidth && i->doc->getNumPages()) {
+	Page*page = i->doc->getCatalog()->getPage(1);
+	PDFRectangle *r = page->getCropBox();
+	double width_before = r->x2 - r->x1;
+	i->zoom = 72.0 * zoomtowidth / width_before;
+	msg("<notice> Rendering at %f DPI. (Page width at 72 DPI: %f, target width: %d)", i->zoom, width_before, zoomtowidth);
+    }
     return pdf_doc;
 }
     
@@ -30,6 +30,39 @@ extern "C" {
 
 gfxsource_t*gfxsource_pdf_create();
 
+/* Render the given pages of a document opened by the pdf source on up to
+   num_threads threads. Every thread works on its own copy of the xpdf
+   document, so pages don't depend on each other: page pages[t] goes into
+   devices[t], framed by startpage()/endpage(), together with the fonts it
+   uses. The output is the same for any number of threads. Returns the
+   number of pages rendered, or -1 if the document doesn't allow it.
+   Invalid page numbers are skipped; their devices aren't touched. */
+int pdf_doc_render_pages_parallel(gfxdocument_t*doc, int*pages, int num_pages, gfxdevice_t**devices, int num_threads);
+
+typedef struct _pdf_textchar {
+    int unicode;    /* 0 if the font doesn't say */
+    double x,y;     /* origin of the character, in the coordinates render() would use */
+    double dx,dy;   /* advance to the next character */
+} pdf_textchar_t;
+
+/* the characters drawn by one text operator */
+typedef struct _pdf_textrun {
+    int page;
+    const char*fontname;
+    double fontsize;    /* after transformation */
+    char invisible;     /* e.g. the text layer of a scanned page */
+    pdf_textchar_t*chars;
+    int num_chars;
+} pdf_textrun_t;
+
+typedef void (*pdf_textrun_callback_t)(pdf_textrun_t*run, void*data);
+
+/* Fast text extraction: Interpret a page for its text only, and pass
+   it to callback as runs of characters. No fonts are set up and images,
+   patterns and shadings are skipped, so this is much cheaper than
+   rendering with the text device. Returns the number of characters. */
+int pdf_doc_extract_text(gfxdocument_t*doc, int page, pdf_textrun_callback_t callback, void*data);
+
 #ifdef __cplusplus
 }
 #endif
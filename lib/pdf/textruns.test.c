@@ -0,0 +1,178 @@
+/* textruns.test.c
+
+   Checks that pdf_doc_extract_text() finds the same characters, in the
+   same order and at the same positions, as rendering the page in
+   onlytext mode into the text device does.
+
+   Part of the swftools package.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "../gfxdevice.h"
+#include "../gfxsource.h"
+#include "../devices/text.h"
+#include "../mem.h"
+#include "pdf.h"
+
+typedef struct _chars {
+    pdf_textchar_t*chars;
+    int num;
+    int size;
+    int num_reported;
+    int page;
+    int bad_runs;
+} chars_t;
+
+static void add_char(chars_t*c, pdf_textchar_t*ch)
+{
+    if(c->num == c->size) {
+	c->size = c->size?c->size*2:256;
+	c->chars = (pdf_textchar_t*)rfx_realloc(c->chars, sizeof(pdf_textchar_t)*c->size);
+    }
+    c->chars[c->num++] = *ch;
+}
+
+static char at(pdf_textchar_t*c, double x, double y)
+{
+    return fabs(c->x - x) <= 0.01 && fabs(c->y - y) <= 0.01;
+}
+
+static void run_callback(pdf_textrun_t*run, void*data)
+{
+    chars_t*c = (chars_t*)data;
+    if(run->page != c->page || run->num_chars <= 0 || !run->chars)
+	c->bad_runs++;
+    c->num_reported += run->num_chars;
+    /* onlytext mode draws the characters of type 3 fonts as shapes, so
+       the text device doesn't see them. Those are the fonts without a
+       name. */
+    if(!*run->fontname)
+	return;
+    int t;
+    for(t=0;t<run->num_chars;t++) {
+	add_char(c, &run->chars[t]);
+    }
+}
+
+/* what the text device gets from onlytext mode. The unicode of a glyph
+   comes from the font the device was given, which doesn't always know
+   it. It's 0 then, or in the private use area. */
+static chars_t device_chars;
+static void (*text_drawchar)(gfxdevice_t*dev, gfxfont_t*font, int glyphnr, gfxcolor_t*color, gfxmatrix_t*matrix);
+static void record_drawchar(gfxdevice_t*dev, gfxfont_t*font, int glyphnr, gfxcolor_t*color, gfxmatrix_t*matrix)
+{
+    pdf_textchar_t c;
+    memset(&c, 0, sizeof(c));
+    c.unicode = font?font->glyphs[glyphnr].unicode:glyphnr;
+    c.x = matrix->tx;
+    c.y = matrix->ty;
+    add_char(&device_chars, &c);
+    text_drawchar(dev, font, glyphnr, color, matrix);
+}
+
+static void render_chars(gfxdocument_t*doc, int pagenr)
+{
+    gfxdevice_t dev;
+    gfxdevice_text_init(&dev);
+    text_drawchar = dev.drawchar;
+    dev.drawchar = record_drawchar;
+    gfxpage_t*page = doc->getpage(doc, pagenr);
+    dev.startpage(&dev, page->width, page->height);
+    page->render(page, &dev);
+    dev.endpage(&dev);
+    page->destroy(page);
+    gfxresult_t*r = dev.finish(&dev);
+    r->destroy(r);
+}
+
+int main(int argn, char*argv[])
+{
+    const char*filename = argn>1?argv[1]:"../../spec/textselectspaces.pdf";
+
+    gfxsource_t*driver = gfxsource_pdf_create();
+    gfxdocument_t*doc = driver->open(driver, filename);
+    if(!doc) {
+	fprintf(stderr, "Couldn't open %s\n", filename);
+	return 1;
+    }
+    doc->setparameter(doc, "onlytext", "1");
+
+    int pagenr, total = 0;
+    for(pagenr=1;pagenr<=doc->num_pages;pagenr++) {
+	chars_t runs;
+	memset(&runs, 0, sizeof(runs));
+	runs.page = pagenr;
+	int num = pdf_doc_extract_text(doc, pagenr, run_callback, &runs);
+	if(runs.bad_runs || num != runs.num_reported) {
+	    fprintf(stderr, "page %d: %d runs with the wrong page or no characters, %d of %d characters\n",
+		    pagenr, runs.bad_runs, runs.num_reported, num);
+	    return 1;
+	}
+
+	memset(&device_chars, 0, sizeof(device_chars));
+	render_chars(doc, pagenr);
+	int t = 0, j;
+	for(j=0;j<device_chars.num;j++) {
+	    pdf_textchar_t*d = &device_chars.chars[j];
+	    pdf_textchar_t*next = j+1<device_chars.num?&device_chars.chars[j+1]:0;
+	    pdf_textchar_t*r = t<runs.num?&runs.chars[t]:0;
+	    if(!r || !at(r, d->x, d->y)) {
+		fprintf(stderr, "page %d: the text device has %d at %.2f,%.2f, text runs have ",
+			pagenr, d->unicode, d->x, d->y);
+		if(r)
+		    fprintf(stderr, "%d at %.2f,%.2f\n", r->unicode, r->x, r->y);
+		else
+		    fprintf(stderr, "nothing\n");
+		return 1;
+	    }
+	    t++;
+	    /* a ligature is one glyph for the device, but one character
+	       per unicode, spread over the glyph's advance, in the runs */
+	    int parts = 1;
+	    while(t<runs.num && !(next && at(&runs.chars[t], next->x, next->y)) &&
+		  at(&runs.chars[t], r->x + r->dx*parts, r->y + r->dy*parts)) {
+		t++;
+		parts++;
+	    }
+	    if(parts == 1 && d->unicode && (d->unicode < 0xe000 || d->unicode > 0xf8ff) &&
+	       r->unicode != d->unicode) {
+		fprintf(stderr, "page %d: %d at %.2f,%.2f, the text device has %d\n",
+			pagenr, r->unicode, r->x, r->y, d->unicode);
+		return 1;
+	    }
+	}
+	if(t != runs.num) {
+	    fprintf(stderr, "page %d: %d characters in text runs, the text device only has %d\n",
+		    pagenr, runs.num, t);
+	    return 1;
+	}
+	total += num;
+	rfx_free(runs.chars);
+	rfx_free(device_chars.chars);
+    }
+    if(!total) {
+	fprintf(stderr, "no text in %s\n", filename);
+	return 1;
+    }
+
+    doc->destroy(doc);
+    driver->destroy(driver);
+    printf("ok\n");
+    return 0;
+}
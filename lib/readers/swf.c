@@ -420,7 +420,7 @@ void swf_FreeTaglist(TAG*tag)
     while(tag)
     { 
 	TAG * tnew = tag->next;
-	if (tag->data) 
+	if (tag->data && !tag->shared) 
 	    rfx_free(tag->data);
 	rfx_free(tag);
 	tag = tnew;
@@ -531,6 +531,7 @@ static void renderCharacter(render_t*r, placement_t*p, character_t*c)
     if(c->type == TYPE_SHAPE) {
 	SHAPE2 shape;
 	swf_ParseDefineShape(c->tag, &shape);
+	swf_Shape2GetLines(&shape);
 
 	MATRIX m,m2;
 	swf_MatrixJoin(&m2, &r->m, &r->current_placement->po.matrix);
@@ -726,7 +727,7 @@ gfxdocument_t*swf_open(gfxsource_t*src, const char*filename)
         perror("Couldn't open file: ");
         return 0;
     }
-    if FAILED(swf_ReadSWF(f,&i->swf)) { 
+    if FAILED(swf_ReadSWFShared(f,&i->swf)) { 
         fprintf(stderr, "%s is not a valid SWF file or contains errors.\n",filename);
         close(f);
         return 0;
@@ -145,7 +145,13 @@ int swf_SetBlock(TAG * t,const U8 * b,int l)
   swf_ResetWriteBits(t);
   if (newlen>t->memsize)
   { U32  newmem  = MEMSIZE(newlen);  
-    U8 * newdata = (U8*)(rfx_realloc(t->data,newmem));
+    U8 * newdata;
+    if (t->shared)
+    { newdata = (U8*)rfx_alloc(newmem);
+      memcpy(newdata,t->data,t->len);
+      t->shared = 0;
+    } else
+      newdata = (U8*)(rfx_realloc(t->data,newmem));
     t->memsize = newmem;
     t->data    = newdata;
   }
@@ -199,32 +205,48 @@ int swf_SetU32(TAG * t,U32 v)
   return 0;
 }
 
+/* The bit functions move up to 32 bits at once through a 64 bit
+   buffer. The bit position is kept in t->readBit/t->writeBit (as the mask
+   of the next bit in the current byte), exactly like it was with the old
+   one-bit-at-a-time implementation, so both can be mixed freely with the
+   byte functions and swf_ResetReadBits()/swf_ResetWriteBits(). */
+
+/* position (0-7) of the bit selected by a readBit/writeBit mask. The masks
+   are powers of two, which all have different remainders modulo 11. */
+static const U8 mask2pos[11] = {0,7,6,0,5,3,0,0,4,1,2};
+#define BITPOS(mask) (mask2pos[(mask)%11])
+
 U32 swf_GetBits(TAG * t,int nbits)
-{ U32 res = 0;
+{ U8*p;
+  U64 buf;
+  int bitpos, end;
   if (!nbits) return 0;
-  if (!t->readBit) t->readBit = 0x80;
-  while (nbits)
-  { res<<=1;
+  bitpos = t->readBit?BITPOS(t->readBit):0;
+  end = bitpos + nbits;
+  p = &t->data[t->pos];
 #ifdef DEBUG_RFXSWF
-    if (t->pos>=t->len) 
-    { fprintf(stderr,"GetBits() out of bounds: TagID = %i, pos=%d, len=%d\n",t->id, t->pos, t->len);
-      int i,m=t->len>10?10:t->len;
-      for(i=-1;i<m;i++) {
-        fprintf(stderr, "(%d)%02x ", i, t->data[i]);
-      } 
-      fprintf(stderr, "\n");
-      return res;
-    }
+  if (t->pos+((end+7)>>3) > t->len) 
+  { fprintf(stderr,"GetBits() out of bounds: TagID = %i, pos=%d, len=%d\n",t->id, t->pos, t->len);
+    int i,m=t->len>10?10:t->len;
+    for(i=-1;i<m;i++) {
+      fprintf(stderr, "(%d)%02x ", i, t->data[i]);
+    } 
+    fprintf(stderr, "\n");
+    return 0;
+  }
 #endif
-    if (t->data[t->pos]&t->readBit) res|=1;
-    t->readBit>>=1;
-    nbits--;
-    if (!t->readBit)
-    { if (nbits) t->readBit = 0x80;
-      t->pos++;
-    }
+  if (t->pos+8 <= t->memsize)
+  { buf = (U64)p[0]<<56 | (U64)p[1]<<48 | (U64)p[2]<<40 | (U64)p[3]<<32 |
+          (U64)p[4]<<24 | (U64)p[5]<<16 | (U64)p[6]<<8 | (U64)p[7];
+  } else
+  { /* near the end of the buffer- only touch the bytes we need */
+    int i, bytes = (end+7)>>3;
+    buf = 0;
+    for(i=0;i<bytes;i++) buf |= (U64)p[i]<<(56-i*8);
   }
-  return res;
+  t->pos += end>>3;
+  t->readBit = (end&7)?0x80>>(end&7):0;
+  return (U32)((buf<<bitpos)>>(64-nbits));
 }
 
 S32 swf_GetSBits(TAG * t,int nbits)
@@ -243,18 +265,33 @@ S32 reader_GetSBits(reader_t*reader, int nbits)
 }
 
 int swf_SetBits(TAG * t,U32 v,int nbits)
-{ U32 bm = 1<<(nbits-1);
-
-  while (nbits)
-  { if (!t->writeBit)
-    { if (FAILED(swf_SetU8(t,0))) return -1;
-      t->writeBit = 0x80;
-    }
-    if (v&bm) t->data[t->len-1] |= t->writeBit;
-    bm>>=1;
-    t->writeBit>>=1;
-    nbits--;
+{ U64 buf;
+  U8 b[8];
+  int free, bytes, i;
+  if (nbits<=0) return 0;
+  if (nbits<32) v &= ((U32)1<<nbits)-1;
+  free = t->writeBit?8-BITPOS(t->writeBit):0;
+  if (nbits<=free)
+  { /* fits into the current byte */
+    t->data[t->len-1] |= v<<(free-nbits);
+    free -= nbits;
+    t->writeBit = free?1<<(free-1):0;
+    return 0;
+  }
+  /* fill up the current byte, then append whole bytes */
+  nbits -= free;
+  if (free) t->data[t->len-1] |= v>>nbits;
+  buf = (U64)v<<(64-nbits);
+  bytes = (nbits+7)>>3;
+  if (t->len+bytes > t->memsize)
+  { for(i=0;i<bytes;i++) b[i] = buf>>(56-i*8);
+    if (swf_SetBlock(t,b,bytes)!=bytes) return -1;
+  } else
+  { U8*p = &t->data[t->len];
+    for(i=0;i<bytes;i++) p[i] = buf>>(56-i*8);
+    t->len += bytes;
   }
+  t->writeBit = (nbits&7)?0x80>>(nbits&7):0;
   return 0;
 }
 
@@ -1162,8 +1199,9 @@ TAG * swf_InsertTagBefore(SWF* swf, TAG * before,U16 id)
 
 void swf_ClearTag(TAG * t)
 {
-  if (t->data) rfx_free(t->data);
+  if (t->data && !t->shared) rfx_free(t->data);
   t->data = 0;
+  t->shared = 0;
   t->pos = 0;
   t->len = 0;
   t->readBit = 0;
@@ -1188,12 +1226,14 @@ TAG* swf_DeleteTag(SWF*swf, TAG * t)
 {
   TAG*next = t->next;
 
+  if (swf && swf->index)
+    swf_IndexRemoveTag(swf, t);
   if (swf && swf->firstTag==t) 
     swf->firstTag = t->next;
   if (t->prev) t->prev->next = t->next;
   if (t->next) t->next->prev = t->prev;
 
-  if (t->data) rfx_free(t->data);
+  if (t->data && !t->shared) rfx_free(t->data);
   rfx_free(t);
   return next;
 }
@@ -1386,7 +1426,8 @@ void swf_UnFoldSprite(TAG * t)
 	break;
   }
   
-  rfx_free(t->data); t->data = 0;
+  if (!t->shared) rfx_free(t->data);
+  t->data = 0; t->shared = 0;
   t->memsize = t->len = t->pos = 0;
 
   swf_SetU16(t, spriteid);
@@ -1413,9 +1454,10 @@ void swf_FoldSprite(TAG * t)
 
   t->pos = 0;
   id = swf_GetU16(t);
-  rfx_free(t->data);
+  if (!t->shared) rfx_free(t->data);
   t->len = t->pos = t->memsize = 0;
   t->data = 0;
+  t->shared = 0;
 
   frames = 0;
 
@@ -1477,24 +1519,34 @@ int swf_IsFolded(TAG * t)
 void swf_FoldAll(SWF*swf)
 {
     TAG*tag = swf->firstTag;
+    char changed = 0;
     //swf_DumpSWF(stdout, swf);
     while(tag) {
-	if(tag->id == ST_DEFINESPRITE) {
+	if(tag->id == ST_DEFINESPRITE && !swf_IsFolded(tag)) {
 	    swf_FoldSprite(tag);
+	    changed = 1;
 	    //swf_DumpSWF(stdout, swf);
 	}
 	tag = swf_NextTag(tag);
     }
+    /* the sprite tags were removed from the tag list */
+    if(changed && swf->index)
+	swf_IndexSWF(swf);
 }
 
 void swf_UnFoldAll(SWF*swf)
 {
     TAG*tag = swf->firstTag;
+    char changed = 0;
     while(tag) {
-	if(tag->id == ST_DEFINESPRITE)
+	if(tag->id == ST_DEFINESPRITE && swf_IsFolded(tag)) {
 	    swf_UnFoldSprite(tag);
+	    changed = 1;
+	}
 	tag = tag->next;
     }
+    if(changed && swf->index)
+	swf_IndexSWF(swf);
 }
 
 void swf_OptimizeTagOrder(SWF*swf)
@@ -1557,8 +1609,73 @@ void swf_OptimizeTagOrder(SWF*swf)
 
 // Movie Functions
 
-int swf_ReadSWF2(reader_t*reader, SWF * swf)   // Reads SWF to memory (malloc'ed), returns length or <0 if fails
+/* let the tags point into data, returns the number of bytes used */
+static size_t swf_ParseSharedTags(U8*data, size_t len, TAG*t)
+{
+  size_t pos = 0;
+  while(pos+2 <= len) {
+    U16 raw = GET16(&data[pos]);
+    U32 taglen = raw&0x3f;
+    int id = raw>>6;
+    pos += 2;
+    if(taglen==0x3f) {
+      if(pos+4 > len) break;
+      taglen = GET32(&data[pos]);
+      pos += 4;
+    }
+    // Sprite handling fix: Flatten sprite tree
+    if(id==ST_DEFINESPRITE) taglen = 2*sizeof(U16);
+    if(taglen > len-pos) {
+      #ifdef DEBUG_RFXSWF
+      fprintf(stderr, "rfxswf: Warning: Short read (tagid %d). File truncated?\n", id);
+      #endif
+      break;
+    }
+    t = swf_InsertTag(t, id);
+    if(taglen) {
+      t->data = &data[pos];
+      t->len = t->memsize = taglen;
+      t->shared = 1;
+    }
+    pos += taglen;
+  }
+  return pos;
+}
+
+/* the file size in the header is only used as a hint for the initial buffer
+   size- it can be anything in broken or malicious files */
+#define SHARED_SIZE_HINT_MAX (16*1024*1024)
+
+/* read the rest of the stream into one buffer, and let the tags point into it */
+static void swf_ReadSharedTags(reader_t*reader, SWF*swf, TAG*t)
+{
+  size_t size = (swf->fileSize>64 && swf->fileSize<=SHARED_SIZE_HINT_MAX)?swf->fileSize:4096;
+  size_t len = 0;
+  int l;
+  U8*data = (U8*)rfx_alloc(size);
+  while((l = reader->read(reader, &data[len], size-len)) > 0) {
+    len += l;
+    if(len == size) {
+      if(size > 0x7fffffff/2) {
+        fprintf(stderr, "rfxswf: Warning: SWF too large, ignoring everything after %u bytes\n", (unsigned)len);
+        break;
+      }
+      size *= 2;
+      data = (U8*)rfx_realloc(data, size);
+    }
+  }
+  swf->tagdata = data;
+  swf_ParseSharedTags(data, len, t);
+}
+
+/* if file is set, reader is a memreader on file->data+start. Tags of uncompressed
+   files then point into the mapping, and swf->tagfile takes ownership of it.
+   *end is set to the number of bytes consumed, which might not fit into
+   the return value. */
+static int swf_ReadSWF3(reader_t*reader, SWF * swf, char shared, memfile_t*file, size_t start, size_t*end)
 {     
+  reader_t zreader; // needs to be valid until we return reader->pos
+  int ret = -1;
   if (!swf) return -1;
   memset(swf,0x00,sizeof(SWF));
 
@@ -1566,7 +1683,6 @@ int swf_ReadSWF2(reader_t*reader, SWF * swf)   // Reads SWF to memory (malloc'ed
     int len;
     TAG * t;
     TAG t1;
-    reader_t zreader;
     
     if ((len = reader->read(reader ,b,8))<8) return -1;
 
@@ -1580,6 +1696,7 @@ int swf_ReadSWF2(reader_t*reader, SWF * swf)   // Reads SWF to memory (malloc'ed
     if(swf->compressed) {
 	reader_init_zlibinflate(&zreader, reader);
 	reader = &zreader;
+	file = 0;
     }
     swf->compressed = 0; // derive from version number from now on
 
@@ -1591,10 +1708,27 @@ int swf_ReadSWF2(reader_t*reader, SWF * swf)   // Reads SWF to memory (malloc'ed
 
     /* read tags and connect to list */
     t1.next = 0;
-    t = &t1;
-    while (t) {
-      t = swf_ReadTag(reader,t);
-      if(t && t->id == ST_FILEATTRIBUTES) {
+    if(shared && file) {
+      U8*data = (U8*)file->data+start;
+      size_t len = file->len-start;
+      size_t pos = reader->pos;
+      if(swf->fileSize>=8 && swf->fileSize<len)
+        len = swf->fileSize;
+      if(pos<=len)
+        pos += swf_ParseSharedTags(&data[pos], len-pos, &t1);
+      swf->tagfile = file;
+      if(end) *end = pos;
+      ret = pos>0x7fffffff?0x7fffffff:(int)pos;
+    } else if(shared) {
+      swf_ReadSharedTags(reader, swf, &t1);
+    } else {
+      t = &t1;
+      while (t) {
+        t = swf_ReadTag(reader,t);
+      }
+    }
+    for(t=t1.next;t;t=t->next) {
+      if(t->id == ST_FILEATTRIBUTES) {
         swf->fileAttributes = swf_GetU32(t);
         swf_ResetReadBits(t);
       }
@@ -1604,7 +1738,17 @@ int swf_ReadSWF2(reader_t*reader, SWF * swf)   // Reads SWF to memory (malloc'ed
       t1.next->prev = NULL;
   }
   
-  return reader->pos;
+  return ret>=0?ret:reader->pos;
+}
+
+int swf_ReadSWF2(reader_t*reader, SWF * swf)   // Reads SWF to memory (malloc'ed), returns length or <0 if fails
+{
+  return swf_ReadSWF3(reader, swf, 0, 0, 0, 0);
+}
+
+int swf_ReadSWF2Shared(reader_t*reader, SWF * swf)
+{
+  return swf_ReadSWF3(reader, swf, 1, 0, 0, 0);
 }
 
 SWF* swf_OpenSWF(char*filename)
@@ -1627,6 +1771,42 @@ int swf_ReadSWF(int handle, SWF * swf)
   return swf_ReadSWF2(&reader, swf);
 }
 
+int swf_ReadSWFShared(int handle, SWF * swf)
+{
+  reader_t reader;
+  reader_init_filereader(&reader, handle);
+  return swf_ReadSWF2Shared(&reader, swf);
+}
+
+int swf_ReadSWFMapped(int handle, SWF * swf)
+{
+  reader_t reader;
+  memfile_t*file = memfile_open_handle(handle);
+  if(file) {
+    int ret = -1;
+    char inplace = 0;
+    off_t start = lseek(handle, 0, SEEK_CUR);
+    if(start>=0 && (size_t)start<file->len) {
+      size_t end = 0;
+      size_t len = file->len-start;
+      /* the reader only sees the header of uncompressed files (their tags
+         are parsed straight from the mapping), so capping it is fine */
+      reader_init_memreader(&reader, (U8*)file->data+start, len>0x7fffffff?0x7fffffff:(int)len);
+      ret = swf_ReadSWF3(&reader, swf, 1, file, start, &end);
+      reader.dealloc(&reader);
+      inplace = ret>=0 && swf->tagfile;
+      if(inplace)
+        lseek(handle, start+end, SEEK_SET);
+      else
+        lseek(handle, 0, SEEK_END); // like the reader, we consumed everything
+    }
+    if(!inplace)
+      memfile_close(file);
+    return ret;
+  }
+  return swf_ReadSWFShared(handle, swf);
+}
+
 void swf_ReadABCfile(char*filename, SWF*swf)
 {
     memset(swf, 0, sizeof(SWF));
@@ -1913,6 +2093,9 @@ SWF* swf_CopySWF(SWF*swf)
     TAG*tag, *ntag;
     memcpy(nswf, swf, sizeof(SWF));
     nswf->firstTag = 0;
+    nswf->index = 0;
+    nswf->tagdata = 0;
+    nswf->tagfile = 0;
     tag = swf->firstTag;
     ntag = 0;
     while(tag) {
@@ -1929,11 +2112,16 @@ void swf_FreeTags(SWF * swf)                 // Frees all malloc'ed memory for t
 
   while (t)
   { TAG * tnew = t->next;
-    if (t->data) rfx_free(t->data);
+    if (t->data && !t->shared) rfx_free(t->data);
     rfx_free(t);
     t = tnew;
   }
   swf->firstTag = 0;
+  swf_IndexFree(swf);
+  if (swf->tagdata) rfx_free(swf->tagdata);
+  swf->tagdata = 0;
+  if (swf->tagfile) memfile_close(swf->tagfile);
+  swf->tagfile = 0;
 }
 
 // include advanced functions
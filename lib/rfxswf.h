@@ -125,6 +125,7 @@ typedef struct _TAG             // NEVER access a Tag-Struct directly !
 
   U8            readBit;        // for Bit-Manipulating Functions [read]
   U8            writeBit;       // [write]
+  U8            shared;         // data points into SWF.tagdata/tagfile, see swf_ReadSWFShared()
 
 } TAG;
 
@@ -163,6 +164,9 @@ typedef struct _SWF
   U16           frameCount;     // valid after load and save
   TAG *         firstTag;
   U32           fileAttributes; // for SWFs >= Flash9
+  struct _SWFINDEX* index;      // optional, see swf_IndexSWF()
+  U8 *          tagdata;        // tag bodies of shared tags, see swf_ReadSWFShared()
+  struct _memfile* tagfile;     // mapped input file the shared tags point into
 } SWF;
 
 // Basic Functions
@@ -170,6 +174,20 @@ typedef struct _SWF
 SWF* swf_OpenSWF(char*filename);
 int  swf_ReadSWF2(reader_t*reader, SWF * swf);   // Reads SWF via callback
 int  swf_ReadSWF(int handle,SWF * swf);     // Reads SWF to memory (malloc'ed), returns length or <0 if fails
+
+/* Like swf_ReadSWF2/swf_ReadSWF, but the (uncompressed) file is kept in one
+   buffer and the tags point into it instead of having their own copies.
+   Tags get their own memory as soon as they grow (copy-on-write). The
+   buffer is freed by swf_FreeTags(), so tags mustn't be moved into another
+   SWF which outlives this one.
+   swf_ReadSWFMapped() maps regular files into memory instead of read()ing
+   them. For uncompressed files, the tags then point directly into the
+   (private) mapping; compressed files are inflated out of it. The file
+   must not be truncated or rewritten while the SWF is in use, so it's only
+   for programs which can't write over their input. */
+int  swf_ReadSWF2Shared(reader_t*reader, SWF * swf);
+int  swf_ReadSWFShared(int handle,SWF * swf);
+int  swf_ReadSWFMapped(int handle,SWF * swf);
 int  swf_WriteSWF2(writer_t*writer, SWF * swf);     // Writes SWF via callback, returns length or <0 if fails
 int  swf_WriteSWF(int handle,SWF * swf);    // Writes SWF to file, returns length or <0 if fails
 int  swf_SaveSWF(SWF * swf, char*filename);
@@ -194,6 +212,20 @@ void swf_FoldSprite(TAG*tag);
 void swf_UnFoldSprite(TAG*tag);
 int swf_IsFolded(TAG*tag);
 
+// tag index (character id -> defining tag, id -> referencing tags, frame -> first tag).
+// swf_DeleteTag() keeps the index up to date. Tags inserted after the index was
+// built have to be added with swf_IndexAddTag() once their data is complete.
+
+typedef struct _SWFINDEX SWFINDEX;
+void  swf_IndexSWF(SWF*swf);                   // build (or rebuild) the index
+void  swf_IndexFree(SWF*swf);
+void  swf_IndexAddTag(SWF*swf, TAG*tag);
+void  swf_IndexRemoveTag(SWF*swf, TAG*tag);
+TAG*  swf_IndexGetDefiningTag(SWF*swf, U16 id);
+TAG** swf_IndexGetReferences(SWF*swf, U16 id, int*num); // in tag order
+int   swf_IndexGetNumTexts(SWF*swf);
+TAG*  swf_IndexGetFrame(SWF*swf, int frame);   // first tag of a frame (starting at 0)
+
 // tag reordering:
 
 void swf_OptimizeTagOrder(SWF*swf);
@@ -426,6 +458,7 @@ typedef struct _SHAPE           // NEVER access a Shape-Struct directly !
 /* SHAPE can be converted into SHAPE2: */
 
 struct _SHAPELINE;
+struct _SHAPEREC;
 typedef struct _SHAPE2
 {
     LINESTYLE * linestyles;
@@ -434,9 +467,21 @@ typedef struct _SHAPE2
     int numfillstyles;
     struct _SHAPELINE * lines;
     SRECT* bbox; // may be NULL
+    struct _SHAPEREC * records; // the outline is either in lines or in records, never in both
+    int numrecords;
 } SHAPE2;
 
-enum SHAPELINETYPE {moveTo, lineTo, splineTo};
+enum SHAPELINETYPE {moveTo, lineTo, splineTo, styleChange};
+
+/* compact form of a shape outline. Coordinates are absolute, like in SHAPELINE.
+   Styles aren't stored per edge- a styleChange record sets the styles of all
+   following records. */
+typedef struct _SHAPEREC
+{
+    U8 type;        // moveTo, lineTo, splineTo or styleChange
+    SCOORD x,y;     // end point. styleChange: x=fillstyle0, y=fillstyle1
+    SCOORD sx,sy;   // control point (splineTo). styleChange: sx=linestyle
+} SHAPEREC;
 typedef struct _SHAPELINE
 {
     enum SHAPELINETYPE type;
@@ -448,6 +493,12 @@ typedef struct _SHAPELINE
     struct _SHAPELINE * next;
 } SHAPELINE;
 
+typedef struct _SHAPEEDGE // a straight (ax=ay=0) or curved edge, for swf_ShapeSetEdges
+{ S32 x,y;      // line: delta to end point, curve: delta to control point
+  S32 ax,ay;    // curve: delta from control point to anchor point
+  U8 curve;
+} SHAPEEDGE;
+
 // Shapes
 
 int   swf_ShapeNew(SHAPE ** s);
@@ -475,6 +526,7 @@ int   swf_ShapeSetAll(TAG * t,SHAPE * s,S32 x,S32 y,int line,int fill0,int fill1
 
 int   swf_ShapeSetLine(TAG * t,SHAPE * s,S32 x,S32 y);
 int   swf_ShapeSetCurve(TAG * t,SHAPE * s,S32 x,S32 y,S32 ax,S32 ay);
+int   swf_ShapeSetEdges(TAG * t,SHAPE * s,SHAPEEDGE * edges,int num); // same as calling the two above for every edge
 int   swf_ShapeSetCircle(TAG * t,SHAPE * s,S32 x,S32 y,S32 rx,S32 ry);
 int   swf_ShapeSetEnd(TAG * t);
 int   swf_SetShapeStyleCount(TAG * t,U16 n);
@@ -495,6 +547,11 @@ SHAPE2*    swf_Shape2Clone(SHAPE2 * s);
 void	   swf_Shape2Free(SHAPE2 * s);
 void	swf_DumpShape(SHAPE2*shape2);
 
+/* swf_ParseDefineShape() stores the outline as records. These two convert
+   a SHAPE2 from one form into the other (in place) and return the result. */
+SHAPELINE* swf_Shape2GetLines(SHAPE2*shape);
+SHAPEREC*  swf_Shape2GetRecords(SHAPE2*shape, int*num);
+
 void swf_ParseDefineShape(TAG*tag, SHAPE2*shape);
 void swf_SetShape2(TAG*tag, SHAPE2*shape2);
 
@@ -648,6 +705,7 @@ int swf_FontReduce(SWFFONT * f);
 int swf_FontReduce_swfc(SWFFONT * f);
 
 int swf_FontInitUsage(SWFFONT * f);
+void swf_FontClearUsage(SWFFONT * f);
 int swf_FontUseGlyph(SWFFONT * f, int glyph, U16 size);
 void swf_FontUsePair(SWFFONT * f, int char1, int char2);
 int swf_FontUseGetPair(SWFFONT * f, int char1, int char2);
@@ -668,6 +726,43 @@ void swf_FontPostprocess(SWF*swf);
 
 int swf_ParseDefineText(TAG * t, void(*callback)(void*self, int*chars, int*xpos, int nr, int fontid, int fontsize, int xstart, int ystart, RGBA* color), void*self);
 
+typedef struct _SWFTEXTRUN
+{ int		fontid;  // -1 = no font set
+  SWFFONT *	font;    // 0 if the font isn't defined in the file
+  int		fontsize;
+  RGBA		color;
+  int		x,y;     // start of the run, in text coordinates
+  int		num;
+  int	*	glyphs;
+  int	*	xpos;    // position of each glyph, relative to x
+  U32	*	unicode; // character of each glyph, as far as the font knows
+} SWFTEXTRUN;
+
+typedef struct _SWFTEXT
+{ U16		id;
+  MATRIX	matrix;  // from the DefineText tag
+  SWFTEXTRUN *	runs;
+  int		numruns;
+} SWFTEXT;
+
+typedef struct _SWFTEXTINDEX
+{ SWFFONT **	fonts;   // in tag order
+  int		numfonts;
+  SWFTEXT *	texts;   // in tag order
+  int		numtexts;
+  SWFTEXTRUN *	runs;    // the runs of all texts
+  int		numruns;
+  int	*	id2font;
+  int	*	id2text;
+} SWFTEXTINDEX;
+
+SWFTEXTINDEX* swf_TextIndexSWF(SWF * swf, int threads);
+// Extracts all fonts and parses all DefineText tags of the file, on up to <threads> threads.
+// Leaves the tags themselves untouched.
+SWFFONT* swf_TextIndexGetFont(SWFTEXTINDEX * index, U16 id);
+SWFTEXT* swf_TextIndexGetText(SWFTEXTINDEX * index, U16 id);
+void swf_TextIndexFree(SWFTEXTINDEX * index);
+
 void swf_WriteFont(SWFFONT* font, char* filename);
 SWFFONT* swf_ReadFont(const char* filename);
 
@@ -760,7 +855,7 @@ void swf_SetSoundInfo(TAG*tag, SOUNDINFO*info);
 
 // swftools.c
 
-void swf_Optimize(SWF*swf);
+int swf_Optimize(SWF*swf); // merge duplicate definitions, returns the number of bytes saved
 U8 swf_isDefiningTag(TAG * t);
 U8 swf_isPseudoDefiningTag(TAG * t);
 U8 swf_isAllowedSpriteTag(TAG * t);
@@ -1018,6 +1113,7 @@ typedef struct _VIDEOSTREAM
 
     /* modifyable: */
     int do_motion; //enable motion compensation (slow!)
+    int threads; //analyze the blocks of P-Frames on this many threads
 
 } VIDEOSTREAM;
 
@@ -0,0 +1,80 @@
+/* timer.c
+
+Cumulative timers for the expensive stages of a conversion.
+
+Part of the swftools package. 
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include "../config.h"
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#include "timer.h"
+
+const char*timer_names[NUM_TIMERS] = {"gfxpoly", "jpeg", "zlib", "pdfinfo"};
+char timers_enabled = 0;
+
+static double timers[NUM_TIMERS];
+#ifdef HAVE_PTHREAD_H
+/* pages may be rendered by more than one thread */
+static pthread_mutex_t timer_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+void timers_enable(char enable)
+{
+    timers_enabled = enable;
+}
+
+double timer_now()
+{
+#ifdef WIN32
+    return GetTickCount()/1000.0;
+#else
+    struct timeval t;
+    gettimeofday(&t, 0);
+    return t.tv_sec + t.tv_usec/1000000.0;
+#endif
+}
+
+void timer_add(timerid_t id, double seconds)
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&timer_mutex);
+#endif
+    timers[id] += seconds;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&timer_mutex);
+#endif
+}
+
+double timer_get(timerid_t id)
+{
+    double t;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&timer_mutex);
+#endif
+    t = timers[id];
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&timer_mutex);
+#endif
+    return t;
+}
@@ -0,0 +1,53 @@
+/* timer.h
+
+Cumulative timers for the expensive stages of a conversion (polygon
+processing, image compression, PDF page analysis). They are off by default,
+in which case TIMER_START/TIMER_STOP don't even read the clock.
+
+Part of the swftools package. 
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef __timer_h__
+#define __timer_h__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    TIMER_GFXPOLY,  /* gfxpoly_process() */
+    TIMER_JPEG,     /* JPEG compression of images */
+    TIMER_ZLIB,     /* lossless (zlib) compression of images */
+    TIMER_PDFINFO,  /* the analysis pass over a PDF page */
+    NUM_TIMERS
+} timerid_t;
+
+extern const char*timer_names[NUM_TIMERS];
+extern char timers_enabled;
+
+void timers_enable(char enable);
+double timer_now();
+void timer_add(timerid_t id, double seconds);
+double timer_get(timerid_t id);
+
+#define TIMER_START(t) double t = timers_enabled?timer_now():0
+#define TIMER_STOP(id,t) if(timers_enabled) timer_add((id), timer_now()-(t))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__timer_h__
@@ -255,7 +255,7 @@ if "freetype" not in config.libraries:
     sys.exit(1)
 
 base_sources = [
-"lib/q.c", "lib/utf8.c", "lib/png.c", "lib/jpeg.c", "lib/wav.c", "lib/mp3.c", "lib/os.c", "lib/bitio.c", "lib/log.c", "lib/mem.c", "lib/ttf.c", "lib/kdtree.c", "lib/xml.c"
+"lib/q.c", "lib/utf8.c", "lib/png.c", "lib/jpeg.c", "lib/wav.c", "lib/mp3.c", "lib/os.c", "lib/bitio.c", "lib/log.c", "lib/mem.c", "lib/ttf.c", "lib/kdtree.c", "lib/xml.c", "lib/timer.c"
 ]
 rfxswf_sources = [
 "lib/modules/swfaction.c", "lib/modules/swfbits.c", "lib/modules/swfbutton.c",
@@ -275,8 +275,8 @@ libpdf_sources = [
 "lib/pdf/CharOutputDev.cc",
 "lib/pdf/InfoOutputDev.cc", "lib/pdf/BitmapOutputDev.cc",
 "lib/pdf/FullBitmapOutputDev.cc",
-"lib/pdf/CommonOutputDev.cc",
-"lib/pdf/bbox.c",
+"lib/pdf/CommonOutputDev.cc", "lib/pdf/TextRunOutputDev.cc",
+"lib/pdf/bbox.c", "lib/pdf/imagecache.c", "lib/pdf/cmyk.cc",
 "lib/pdf/pdf.cc", "lib/pdf/fonts.c", "lib/pdf/xpdf/GHash.cc",
 "lib/pdf/xpdf/GList.cc", "lib/pdf/xpdf/GString.cc", "lib/pdf/xpdf/gmem.cc", "lib/pdf/xpdf/gfile.cc",
 "lib/pdf/xpdf/FoFiTrueType.cc", "lib/pdf/xpdf/FoFiType1.cc", "lib/pdf/xpdf/FoFiType1C.cc",
@@ -301,7 +301,7 @@ libgfx_sources = [
 "lib/gfxpoly/poly.c", "lib/gfxpoly/renderpoly.c", "lib/gfxpoly/stroke.c",
 "lib/gfxpoly/wind.c", "lib/gfxpoly/xrow.c",
 "lib/devices/dummy.c", "lib/devices/file.c", "lib/devices/render.c", "lib/devices/text.c", "lib/devices/record.c",
-"lib/devices/ops.c", "lib/devices/polyops.c", "lib/devices/bbox.c", "lib/devices/rescale.c",
+"lib/devices/ops.c", "lib/devices/polyops.c", "lib/devices/bbox.c", "lib/devices/rescale.c", "lib/devices/stats.c",
 "lib/art/art_affine.c", "lib/art/art_alphagamma.c", "lib/art/art_bpath.c", "lib/art/art_gray_svp.c",
 "lib/art/art_misc.c", "lib/art/art_pixbuf.c", "lib/art/art_rect.c", "lib/art/art_rect_svp.c",
 "lib/art/art_rect_uta.c", "lib/art/art_render.c", "lib/art/art_render_gradient.c", "lib/art/art_render_mask.c",
@@ -44,6 +44,7 @@
 #include "../lib/devices/polyops.h"
 #include "../lib/devices/record.h"
 #include "../lib/devices/rescale.h"
+#include "../lib/devices/stats.h"
 #include "../lib/gfxfilter.h"
 #include "../lib/pdf/pdf.h"
 #include "../lib/log.h"
@@ -73,8 +74,14 @@ static int max_time = 0;
 
 static int flatten = 0;
 
+static int stream = 0;
+static int serve = 0;
+static int jobs = 1;
+
 static char* filters = 0;
 
+static char* stats_filename = 0;
+
 char* fontpaths[256];
 int fontpathpos = 0;
 
@@ -379,6 +386,34 @@ int args_callback_option(char*name,char*val) {
 	flatten = 1;
 	return 0;
     }
+    else if (!strcmp(name, "D"))
+    {
+	serve = 1;
+	return 0;
+    }
+    else if (!strcmp(name, "k"))
+    {
+	stream = 1;
+	return 0;
+    }
+    else if (!strcmp(name, "J"))
+    {
+	jobs = atoi(val);
+	if(jobs<1) {
+	    fprintf(stderr, "Invalid number of jobs: %s\n", val);
+	    exit(1);
+	}
+	return 1;
+    }
+    else if (!strcmp(name, "M"))
+    {
+	if(strncmp(val, "json", 4) || (val[4] && val[4]!=':')) {
+	    fprintf(stderr, "Unknown statistics format: %s\n", val);
+	    exit(1);
+	}
+	stats_filename = val[4]?&val[5]:"-";
+	return 1;
+    }
     else if (!strcmp(name, "F"))
     {
 	char *s = strdup(val);
@@ -482,7 +517,11 @@ static struct options_t options[] = {
 {"f", "fonts"},
 {"G", "flatten"},
 {"I", "info"},
+{"k", "stream"},
+{"D", "serve"},
 {"Q", "maxtime"},
+{"M", "stats"},
+{"J", "jobs"},
 {"X", "width"},
 {"Y", "height"},
 {0,0}
@@ -535,7 +574,11 @@ void args_callback_usage(char *name)
     printf("-f , --fonts                   Store full fonts in SWF. (Don't reduce to used characters).\n");
     printf("-G , --flatten                 Remove as many clip layers from file as possible. \n");
     printf("-I , --info                    Don't do actual conversion, just display a list of all pages in the PDF.\n");
+    printf("-k , --stream                  Write each page to the output file as soon as it's converted, to save memory.\n");
+    printf("-D , --serve                   Keep the PDF open and convert the pages requested on stdin (one number per line) to stdout.\n");
     printf("-Q , --maxtime n               Abort conversion after n seconds. Only available on Unix.\n");
+    printf("-M , --stats json[:file]       Write timings and counters for every page, as JSON, to file (default: stderr).\n");
+    printf("-J , --jobs n                  With %% in the output filename, convert n pages at a time, in parallel.\n");
     printf("\n");
 }
 
@@ -560,6 +603,224 @@ float getRate(char*filename)
     return swf.frameRate / 256.0;
 }
 
+/* the output device and the devices in front of it */
+typedef struct _devicechain {
+    gfxdevice_t swf,wrap,rescale,stats;
+} devicechain_t;
+static devicechain_t chain;
+
+/* --stats: what the stats device measured for every page, and the
+   (uncompressed) size of the SWF tags the page produced, by tag id.
+   Fonts count for the page which uses them first. */
+typedef struct _pagestats {
+    gfxpagestats_t dev;
+    int tagbytes[1024];
+} pagestats_t;
+static pagestats_t*pagestats = 0;
+static int num_pagestats = 0;
+static int trailer_tagbytes[1024];
+static double start_time = 0;
+static double write_time = 0;
+
+/* call before out->finish(). Returns the index of the first page
+   of the current output file. */
+static int stats_collect(gfxdevice_t*out)
+{
+    if(!stats_filename)
+	return 0;
+    int num = 0, t;
+    int first = num_pagestats;
+    gfxpagestats_t*pages = gfxdevice_stats_getpages(out, &num);
+    pagestats = (pagestats_t*)realloc(pagestats, (num_pagestats+num)*sizeof(pagestats_t));
+    for(t=0;t<num;t++) {
+	memset(&pagestats[first+t], 0, sizeof(pagestats_t));
+	pagestats[first+t].dev = pages[t];
+    }
+    num_pagestats += num;
+    return first;
+}
+
+/* tags which start with the id of the font they belong to */
+static char stats_is_font_tag(TAG*tag)
+{
+    return swf_isFontTag(tag) || tag->id == ST_DEFINEFONTALIGNZONES || tag->id == ST_DEFINEFONTNAME;
+}
+
+static void stats_count_tags(gfxresult_t*result, int first)
+{
+    if(!stats_filename)
+	return;
+    SWF*swf = (SWF*)result->get(result, "swf");
+    if(!swf)
+	return;
+
+    /* the swf device writes the fonts before the first frame, so find
+       out which page uses every character id first */
+    int*firstuse = (int*)rfx_alloc(sizeof(int)*65536);
+    memset(firstuse, -1, sizeof(int)*65536);
+    int page = first;
+    TAG*tag;
+    for(tag=swf->firstTag;tag;tag=tag->next) {
+	int num = stats_is_font_tag(tag)?0:swf_GetNumUsedIDs(tag);
+	if(num) {
+	    int*ptr = (int*)rfx_alloc(sizeof(int)*num);
+	    int t;
+	    swf_GetUsedIDs(tag, ptr);
+	    for(t=0;t<num;t++) {
+		int id = GET16(&tag->data[ptr[t]]);
+		if(firstuse[id]<0)
+		    firstuse[id] = page;
+	    }
+	    rfx_free(ptr);
+	}
+	if(tag->id == ST_SHOWFRAME)
+	    page++;
+    }
+
+    page = first;
+    for(tag=swf->firstTag;tag;tag=tag->next) {
+	int p = page;
+	if(stats_is_font_tag(tag) && tag->len>=2 && firstuse[GET16(tag->data)]>=0)
+	    p = firstuse[GET16(tag->data)];
+	int*bytes = p<num_pagestats?pagestats[p].tagbytes:trailer_tagbytes;
+	bytes[tag->id&0x3ff] += swf_WriteTag2(0, tag);
+	if(tag->id == ST_SHOWFRAME)
+	    page++;
+    }
+    rfx_free(firstuse);
+    swf_FreeTags(swf);
+    free(swf);
+}
+
+static int stats_print_tags(FILE*fi, int*bytes)
+{
+    int t, total = 0;
+    fprintf(fi, "{");
+    for(t=0;t<1024;t++) {
+	if(!bytes[t])
+	    continue;
+	TAG tag;
+	tag.id = t;
+	char*name = swf_TagGetName(&tag);
+	fprintf(fi, total?", ":"");
+	if(name)
+	    fprintf(fi, "\"%s\": %d", name, bytes[t]);
+	else
+	    fprintf(fi, "\"TAG%d\": %d", t, bytes[t]);
+	total += bytes[t];
+    }
+    fprintf(fi, "}");
+    return total;
+}
+
+static void stats_write()
+{
+    if(!stats_filename)
+	return;
+    FILE*fi = stderr;
+    if(strcmp(stats_filename, "-")) {
+	fi = fopen(stats_filename, "wb");
+	if(!fi) {
+	    perror(stats_filename);
+	    return;
+	}
+    }
+    long maxrss = 0;
+    int t, s;
+
+    /* prepare() runs the analysis pass over all pages before the first
+       one is rendered, so the stats device counts all of it towards the
+       first page. It gets its own record instead. */
+    double analysis = 0;
+    for(t=0;t<num_pagestats;t++)
+	analysis += pagestats[t].dev.timers[TIMER_PDFINFO];
+    fprintf(fi, "{\n  \"analysis\": {\"time\": %.6f},\n", analysis);
+
+    fprintf(fi, "  \"pages\": [\n");
+    for(t=0;t<num_pagestats;t++) {
+	gfxpagestats_t*p = &pagestats[t].dev;
+	double devicetime = 0;
+	for(s=0;s<NUM_STATS_CALLS;s++)
+	    devicetime += p->calltime[s];
+	/* the time the PDF interpreter spent on the page: the render
+	   time not spent in the output device */
+	double interpret = p->render - devicetime;
+	fprintf(fi, "    {\"page\": %d, \"time\": %.6f, \"interpret\": %.6f, \"device\": %.6f, \"maxrss_kb\": %ld,\n",
+		t+1, p->time - p->timers[TIMER_PDFINFO], interpret, devicetime, p->maxrss);
+	fprintf(fi, "     \"timers\": {");
+	int first = 1;
+	for(s=0;s<NUM_TIMERS;s++) {
+	    if(s == TIMER_PDFINFO)
+		continue;
+	    fprintf(fi, "%s\"%s\": %.6f", first?"":", ", timer_names[s], p->timers[s]);
+	    first = 0;
+	}
+	fprintf(fi, "},\n     \"calls\": {");
+	for(s=0;s<NUM_STATS_CALLS;s++)
+	    fprintf(fi, "%s\"%s\": {\"count\": %d, \"time\": %.6f}", s?", ":"", 
+		    gfxdevice_stats_callnames[s], p->calls[s], p->calltime[s]);
+	fprintf(fi, "},\n     \"tags\": ");
+	int bytes = stats_print_tags(fi, pagestats[t].tagbytes);
+	fprintf(fi, ", \"bytes\": %d}%s\n", bytes, t<num_pagestats-1?",":"");
+	if(p->maxrss > maxrss)
+	    maxrss = p->maxrss;
+    }
+    fprintf(fi, "  ],\n  \"trailer\": {\"tags\": ");
+    int bytes = stats_print_tags(fi, trailer_tagbytes);
+    fprintf(fi, ", \"bytes\": %d},\n", bytes);
+    fprintf(fi, "  \"total\": {\"time\": %.6f, \"write\": %.6f, \"maxrss_kb\": %ld, \"timers\": {",
+	    timer_now() - start_time, write_time, maxrss);
+    for(s=0;s<NUM_TIMERS;s++)
+	fprintf(fi, "%s\"%s\": %.6f", s?", ":"", timer_names[s], timer_get((timerid_t)s));
+    fprintf(fi, "}}\n}\n");
+    if(fi != stderr)
+	fclose(fi);
+}
+
+/* --serve: read page numbers from stdin, one per line, and answer every
+   request with a line "<page> <length>" followed by <length> bytes of SWF
+   data, or with "<page> error". The document, its fonts and the converted
+   SWF fonts stay in memory between requests. */
+void serve_pages(gfxdocument_t*pdf, gfxdevice_t*out)
+{
+    char line[256];
+    while(fgets(line, sizeof(line), stdin)) {
+	if(!strncmp(line, "quit", 4))
+	    break;
+	int pagenr = atoi(line);
+	if(pagenr < 1 || pagenr > pdf->num_pages) {
+	    printf("%d error\n", pagenr);
+	    fflush(stdout);
+	    continue;
+	}
+	gfxpage_t*page = pdf->getpage(pdf, pagenr);
+	if(!page) {
+	    printf("%d error\n", pagenr);
+	    fflush(stdout);
+	    continue;
+	}
+	out->startpage(out, page->width, page->height);
+	page->render(page, out);
+	out->endpage(out);
+	page->destroy(page);
+
+	gfxresult_t*result = gfxdevice_swf_fragment(&chain.swf);
+	SWF*fragment = (SWF*)result->get(result, "swf");
+	writer_t w;
+	writer_init_growingmemwriter(&w, 65536);
+	swf_WriteSWF2(&w, fragment);
+	int len = 0;
+	void*data = writer_growmemwrite_memptr(&w, &len);
+	printf("%d %d\n", pagenr, len);
+	fwrite(data, len, 1, stdout);
+	fflush(stdout);
+	w.finish(&w);
+	swf_FreeTags(fragment);
+	free(fragment);
+	result->destroy(result);
+    }
+}
+
 void show_info(gfxsource_t*driver, char*filename)
 {
     gfxdocument_t* pdf = driver->open(driver, filename);
@@ -588,23 +849,22 @@ void show_info(gfxsource_t*driver, char*filename)
     pdf->destroy(pdf);
 }
 
-
-static gfxdevice_t swf,wrap,rescale;
-gfxdevice_t*create_output_device()
+static gfxdevice_t*init_device_chain(devicechain_t*c)
 {
-    gfxdevice_swf_init(&swf);
+    gfxdevice_t*out;
+    gfxdevice_swf_init(&c->swf);
 
     /* set up filter chain */
 	
-    out = &swf;
+    out = &c->swf;
     if(flatten) {
-        gfxdevice_removeclippings_init(&wrap, &swf);
-        out = &wrap;
+        gfxdevice_removeclippings_init(&c->wrap, &c->swf);
+        out = &c->wrap;
     }
 
     if(maxwidth || maxheight) {
-        gfxdevice_rescale_init(&rescale, out, maxwidth, maxheight, 0);
-        out = &rescale;
+        gfxdevice_rescale_init(&c->rescale, out, maxwidth, maxheight, 0);
+        out = &c->rescale;
     }
 
     if(filters) {
@@ -617,15 +877,74 @@ gfxdevice_t*create_output_device()
 	gfxfilterchain_destroy(chain);
     }
 
+    if(stats_filename) {
+	gfxdevice_stats_init(&c->stats, out);
+	out = &c->stats;
+    }
+
     /* pass global parameters to output device */
     parameter_t*p = device_config;
     while(p) {
 	out->setparameter(out, p->name, p->value);
 	p = p->next;
     }
+    if(stream) {
+	out->setparameter(out, "stream", outputname);
+    }
+    return out;
+}
+
+gfxdevice_t*create_output_device()
+{
+    out = init_device_chain(&chain);
     return out;
 }
 
+/* --jobs: convert the pages of a one-file-per-page conversion in
+   batches of "jobs" pages, in parallel, every page into its own
+   devices. Every file only gets the fonts of its own page. */
+static int convert_pages_parallel(gfxdocument_t*pdf)
+{
+    int*pages = (int*)rfx_alloc(sizeof(int)*jobs);
+    devicechain_t*chains = (devicechain_t*)rfx_calloc(sizeof(devicechain_t)*jobs);
+    gfxdevice_t**devices = (gfxdevice_t**)rfx_calloc(sizeof(gfxdevice_t*)*jobs);
+    int pagenr = 1, ret = 0;
+    while(pagenr <= pdf->num_pages && !ret) {
+	int num = 0, t;
+	for(;pagenr <= pdf->num_pages && num < jobs; pagenr++) {
+	    if(is_in_range(pagenr, pagerange)) {
+		pages[num] = pagenr;
+		devices[num] = init_device_chain(&chains[num]);
+		num++;
+	    }
+	}
+	if(!num)
+	    break;
+	if(pdf_doc_render_pages_parallel(pdf, pages, num, devices, num) < num) {
+	    msg("<error> Couldn't convert pages %d-%d", pages[0], pages[num-1]);
+	    ret = 1;
+	}
+	for(t=0;t<num;t++) {
+	    gfxresult_t*result = devices[t]->finish(devices[t]);
+	    if(!ret) {
+		char buf[1024];
+		sprintf(buf, outputname, pages[t]);
+		double save_start = timer_now();
+		if(result->save(result, buf) < 0) {
+		    ret = 1;
+		}
+		write_time += timer_now() - save_start;
+		msg("<notice> Writing SWF file %s", buf);
+	    }
+	    result->destroy(result);
+	}
+    }
+    rfx_free(devices);
+    rfx_free(chains);
+    rfx_free(pages);
+    return ret;
+}
+
 int main(int argn, char *argv[])
 {
     int ret;
@@ -653,6 +972,7 @@ int main(int argn, char *argv[])
 #endif
 
     processargs(argn, argv);
+    start_time = timer_now();
     
     driver = gfxsource_pdf_create();
     
@@ -669,7 +989,7 @@ int main(int argn, char *argv[])
 	exit(1);
     }
 
-    if (!info_only) {
+    if (!info_only && !serve) {
         if(!outputname)
         {
             if(filename) {
@@ -712,8 +1032,14 @@ int main(int argn, char *argv[])
 	return 0;
     }
 
+    if(serve) {
+	/* stdout is ours */
+	setConsoleLogging(-1);
+	stream = 0;
+    }
+
     char*u = 0;
-    if((u = strchr(outputname, '%'))) {
+    if(!serve && (u = strchr(outputname, '%'))) {
 	if(strchr(u+1, '%') || 
 	   strchr(outputname, '%')!=u)  {
 	    msg("<error> only one %% allowed in filename\n");
@@ -725,6 +1051,11 @@ int main(int argn, char *argv[])
 	}
 	msg("<notice> outputting one file per page");
 	one_file_per_page = 1;
+	if(jobs>1 && (xnup>1 || ynup>1 || custom_clip || custom_move || stats_filename)) {
+	    msg("<warning> --jobs doesn't work together with N-up, clipping, moving or --stats, converting one page at a time");
+	    jobs = 1;
+	}
+	stream = 0;
 	char*pattern = (char*)malloc(strlen(outputname)+2);
 	/* convert % to %d */
 	int l = u-outputname+1;
@@ -746,6 +1077,22 @@ int main(int argn, char *argv[])
 	p = p->next;
     }
 
+    if(serve) {
+	/* prepare() analyzes the whole document and passes all fonts to
+	   the device before the first request. A font which was passed
+	   while some of its glyphs were still unknown would be passed
+	   again later, with a new id, so without this the answer for a
+	   page would depend on which pages were requested before. */
+	gfxdevice_t*out = create_output_device();
+	pdf->prepare(pdf, out);
+	serve_pages(pdf, out);
+	gfxresult_t*result = out->finish(out);
+	result->destroy(result);
+	pdf->destroy(pdf);
+	driver->destroy(driver);
+	return 0;
+    }
+
     struct mypage_t {
 	int x;
 	int y;
@@ -776,6 +1123,13 @@ int main(int argn, char *argv[])
 
     pagenum = 0;
 
+    if(one_file_per_page && jobs>1) {
+	ret = convert_pages_parallel(pdf);
+	pdf->destroy(pdf);
+	driver->destroy(driver);
+	return ret;
+    }
+
     gfxdevice_t*out = create_output_device();;
     pdf->prepare(pdf, out);
 
@@ -842,12 +1196,16 @@ int main(int argn, char *argv[])
 	    pagenum = 0;
 
 	    if(one_file_per_page) {
+		int first = stats_collect(out);
 		gfxresult_t*result = out->finish(out);out=0;
+		stats_count_tags(result, first);
 		char buf[1024];
 		sprintf(buf, outputname, pagenr);
+		double save_start = timer_now();
 		if(result->save(result, buf) < 0) {
 		    return 1;
 		}
+		write_time += timer_now() - save_start;
 		result->destroy(result);result=0;
 		out = create_output_device();;
                 pdf->prepare(pdf, out);
@@ -861,11 +1219,15 @@ int main(int argn, char *argv[])
 	gfxresult_t*result = out->finish(out);out=0;
 	result->destroy(result);result=0;
     } else {
+	int first = stats_collect(out);
 	gfxresult_t*result = out->finish(out);
+	stats_count_tags(result, first);
 	msg("<notice> Writing SWF file %s", outputname);
+	double save_start = timer_now();
 	if(result->save(result, outputname) < 0) {
 	    exit(1);
 	}
+	write_time += timer_now() - save_start;
 	int width = (int)(ptroff_t)result->get(result, "width");
 	int height = (int)(ptroff_t)result->get(result, "height");
 	result->destroy(result);result=0;
@@ -907,6 +1269,7 @@ int main(int argn, char *argv[])
     pdf->destroy(pdf);
     driver->destroy(driver);
 
+    stats_write();
    
     /* free global parameters */
     p = device_config;
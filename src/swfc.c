@@ -1079,7 +1079,8 @@ static void s_endSWF()
     swf_OptimizeTagOrder(swf);
 
     if(optimize) {
-	swf_Optimize(swf);
+	int saved = swf_Optimize(swf);
+	msg("<verbose> optimizer saved %d bytes", saved);
     }
 
     if(!(swf->movieSize.xmax-swf->movieSize.xmin) || !(swf->movieSize.ymax-swf->movieSize.ymin)) {
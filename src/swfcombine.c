@@ -26,6 +26,9 @@
 #include "../lib/args.h"
 #include "../lib/log.h"
 #include "../config.h"
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 struct config_t
 {
@@ -59,18 +62,19 @@ struct config_t
    int mastermovey;
    float masterscalex;
    float masterscaley;
+   int jobs;
 };
 struct config_t config;
 
 char * master_filename = 0;
 char * master_name = 0;
-char * slave_filename[128];
-char * slave_name[128];
-int slave_movex[128];
-int slave_movey[128];
-float slave_scalex[128];
-float slave_scaley[128];
-char slave_isframe[128];
+char ** slave_filename;
+char ** slave_name;
+int * slave_movex;
+int * slave_movey;
+float * slave_scalex;
+float * slave_scaley;
+char * slave_isframe;
 int numslaves = 0;
 
 char * outputname = "output.swf";
@@ -143,6 +147,15 @@ int args_callback_option(char*name,char*val) {
 	config.zlib = 1;
 	return 0;
     }
+    else if (!strcmp(name, "j"))
+    {
+	config.jobs = atoi(val);
+	if(config.jobs<1) {
+	    fprintf(stderr, "Error: -j needs a number of threads (at least 1).\n");
+	    exit(1);
+	}
+	return 1;
+    }
     else if (!strcmp(name, "r"))
     {
 
@@ -248,6 +261,7 @@ static struct options_t options[] = {
 {"B", "accelerated-blit"},
 {"L", "local-with-filesystem"},
 {"z", "zlib"},
+{"j", "jobs"},
 {0,0}
 };
 
@@ -330,6 +344,7 @@ void args_callback_usage(char *name)
     printf("-B , --accelerated-blit        Set the \"use accelerated blit\" bit in the output file\n");
     printf("-L , --local-with-filesystem     Make output file \"local-with-filesystem\"\n");
     printf("-z , --zlib <zlib>             Enable Flash 6 (MX) Zlib Compression\n");
+    printf("-j , --jobs <threads>          With --cat: read and relocate all files at once, using <threads> threads\n");
     printf("\n");
 }
 
@@ -997,6 +1012,230 @@ void catcombine(SWF*master, char*slave_name, SWF*slave, SWF*newswf)
     swf_DeleteTag(newswf, tag);
 }
 
+/* --cat with -j: all files are read and relocated up front (in parallel),
+   each one into its own range of ids, and the tag lists are then simply
+   chained together. Avoids copying the (growing) output once per file. */
+
+typedef struct _batchfile
+{
+    char*filename;
+    SWF swf;
+    int numids; // number of distinct ids defined or used in the file
+    int firstid;
+} batchfile_t;
+
+typedef struct _batchjob
+{
+    batchfile_t*files;
+    int num;
+    int next;
+    int pass; // 0 = read, 1 = relocate
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_t mutex;
+#endif
+} batchjob_t;
+
+static int count_ids(SWF*swf)
+{
+    char*used = (char*)rfx_calloc(65536);
+    TAG*tag = swf->firstTag;
+    int t, count = 0;
+    while(tag) {
+	int num = swf_GetNumUsedIDs(tag);
+	if(swf_isDefiningTag(tag))
+	    used[swf_GetDefineID(tag)] = 1;
+	if(num) {
+	    int*ptr = (int*)rfx_alloc(sizeof(int)*num);
+	    swf_GetUsedIDs(tag, ptr);
+	    for(t=0;t<num;t++)
+		used[GET16(&tag->data[ptr[t]])] = 1;
+	    rfx_free(ptr);
+	}
+	tag = tag->next;
+    }
+    for(t=0;t<65536;t++)
+	count += used[t];
+    rfx_free(used);
+    return count;
+}
+
+static void batch_process(batchjob_t*job, batchfile_t*f)
+{
+    if(job->pass == 0) {
+	int fi = open(f->filename, O_RDONLY|O_BINARY);
+	if(fi<0 || swf_ReadSWFShared(fi, &f->swf)<0) {
+	    msg("<fatal> Couldn't open/read %s.", f->filename);
+	    exit(1);
+	}
+	close(fi);
+	swf_RemoveJPEGTables(&f->swf);
+	removeCommonTags(&f->swf);
+	swf_FoldAll(&f->swf);
+	f->numids = count_ids(&f->swf);
+    } else {
+	char*bitmap = (char*)rfx_alloc(65536);
+	memset(bitmap, 1, 65536);
+	memset(&bitmap[f->firstid], 0, f->numids);
+	swf_Relocate(&f->swf, bitmap);
+	rfx_free(bitmap);
+    }
+}
+
+static void* batch_thread(void*_job)
+{
+    batchjob_t*job = (batchjob_t*)_job;
+    while(1) {
+	int nr;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&job->mutex);
+#endif
+	nr = job->next++;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&job->mutex);
+#endif
+	if(nr >= job->num)
+	    break;
+	batch_process(job, &job->files[nr]);
+    }
+    return 0;
+}
+
+static void batch_run(batchjob_t*job, int pass)
+{
+    job->pass = pass;
+    job->next = 0;
+#ifdef HAVE_PTHREAD_H
+    pthread_t*threads = (pthread_t*)rfx_alloc(config.jobs*sizeof(pthread_t));
+    int t, num;
+    for(t=0;t<config.jobs && t<job->num;t++) {
+	if(pthread_create(&threads[t], 0, batch_thread, job))
+	    break;
+    }
+    num = t;
+    if(!num) {
+	/* couldn't start any threads- do it ourselves */
+	batch_thread(job);
+    }
+    for(t=0;t<num;t++)
+	pthread_join(threads[t], 0);
+    rfx_free(threads);
+#else
+    batch_thread(job);
+#endif
+}
+
+/* the tags of newswf point into the files read by the job, so these
+   have to stay around until newswf has been written. Free both
+   with catcombine_free(). */
+void catcombine_batch(batchjob_t*job, SWF*newswf)
+{
+    char* depths;
+    int t, id = 1;
+    TAG*tag = 0;
+
+    memset(job, 0, sizeof(batchjob_t));
+    job->num = numslaves+1;
+    job->files = (batchfile_t*)rfx_calloc(sizeof(batchfile_t)*job->num);
+    job->files[0].filename = master_filename;
+    for(t=0;t<numslaves;t++)
+	job->files[t+1].filename = slave_filename[t];
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_init(&job->mutex, 0);
+#endif
+
+    batch_run(job, 0);
+
+    for(t=0;t<job->num;t++) {
+	job->files[t].firstid = id;
+	id += job->files[t].numids;
+    }
+    if(id > 65536) {
+	msg("<fatal> The files together use %d ids, only 65535 are possible.", id-1);
+	exit(1);
+    }
+    msg("<verbose> %d files read, %d ids", job->num, id-1);
+
+    batch_run(job, 1);
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_destroy(&job->mutex);
+#endif
+
+    memcpy(newswf, &job->files[0].swf, sizeof(SWF));
+    newswf->firstTag = 0;
+    newswf->tagdata = 0;
+    newswf->index = 0;
+    if(config.flashversion)
+	newswf->fileVersion = config.flashversion;
+    adjustheader(newswf);
+
+    depths = (char*)rfx_calloc(65536);
+    for(t=0;t<job->num;t++) {
+	SWF*swf = &job->files[t].swf;
+	TAG*stag = swf->firstTag;
+	int d;
+	if(!newswf->fileVersion)
+	    newswf->fileVersion = swf->fileVersion;
+	newswf->fileAttributes |= swf->fileAttributes;
+
+	/* remove everything the previous file left on the stage */
+	for(d=0;d<65536;d++) {
+	    if(depths[d]) {
+		tag = swf_InsertTag(tag, ST_REMOVEOBJECT2);
+		swf_SetU16(tag, d);
+		if(!newswf->firstTag)
+		    newswf->firstTag = tag;
+		depths[d] = 0;
+	    }
+	}
+	/* move (rather than copy) the tags over. The files' SWF structs
+	   stay around, they own the tag data. */
+	while(stag && stag->id!=ST_END) {
+	    TAG*next = stag->next;
+	    switch(stag->id) {
+		case ST_PLACEOBJECT:
+		case ST_PLACEOBJECT2:
+		case ST_PLACEOBJECT3:
+		    depths[swf_GetDepth(stag)] = 1;
+		break;
+		case ST_REMOVEOBJECT:
+		case ST_REMOVEOBJECT2:
+		    depths[swf_GetDepth(stag)] = 0;
+		break;
+	    }
+	    stag->prev = tag;
+	    stag->next = 0;
+	    if(tag)
+		tag->next = stag;
+	    else
+		newswf->firstTag = stag;
+	    tag = stag;
+	    stag = next;
+	}
+	swf->firstTag = stag;
+	if(stag)
+	    stag->prev = 0;
+    }
+    rfx_free(depths);
+    tag = swf_InsertTag(tag, ST_END);
+    if(!newswf->firstTag)
+	newswf->firstTag = tag;
+
+    /* merge fonts, bitmaps etc. which are the same in several files */
+    t = swf_Optimize(newswf);
+    msg("<verbose> Merged identical objects, saved %d bytes", t);
+}
+
+void catcombine_free(batchjob_t*job, SWF*newswf)
+{
+    int t;
+    /* newswf's tags point into the files' data, so they go first */
+    swf_FreeTags(newswf);
+    for(t=0;t<job->num;t++)
+	swf_FreeTags(&job->files[t].swf);
+    rfx_free(job->files);
+    job->files = 0;
+}
+
 void normalcombine(SWF*master, char*slave_name, SWF*slave, SWF*newswf)
 {
     int spriteid = -1;
@@ -1208,8 +1447,10 @@ int main(int argn, char *argv[])
     SWF master;
     SWF slave;
     SWF newswf;
+    batchjob_t catjob;
     int t;
 
+    memset(&catjob, 0, sizeof(catjob));
     config.overlay = 0; 
     config.antistream = 0; 
     config.alloctest = 0;
@@ -1234,6 +1475,15 @@ int main(int argn, char *argv[])
     config.stack1 = 0;
     config.dummy = 0;
     config.zlib = 0;
+    config.jobs = 0;
+
+    slave_filename = (char**)rfx_calloc(sizeof(char*)*argn);
+    slave_name = (char**)rfx_calloc(sizeof(char*)*argn);
+    slave_movex = (int*)rfx_calloc(sizeof(int)*argn);
+    slave_movey = (int*)rfx_calloc(sizeof(int)*argn);
+    slave_scalex = (float*)rfx_calloc(sizeof(float)*argn);
+    slave_scaley = (float*)rfx_calloc(sizeof(float)*argn);
+    slave_isframe = (char*)rfx_calloc(sizeof(char)*argn);
 
     processargs(argn, argv);
     initLog(0,-1,0,0,-1,config.loglevel);
@@ -1261,6 +1511,9 @@ int main(int argn, char *argv[])
 
 	makestackmaster(&master);
     }
+    else if(config.cat && config.jobs) {
+	/* the master is read together with the slaves, see catcombine_batch() */
+    }
     else {
 	int ret;
 	msg("<verbose> master entity %s (named \"%s\")\n", master_filename, master_name);
@@ -1318,6 +1571,9 @@ int main(int argn, char *argv[])
 		msg("<error> You must have at least one slave entity.");
 	    return 0;
 	}
+	if(config.cat && config.jobs)
+	    catcombine_batch(&catjob, &newswf);
+	else
 	for(t = 0; t < numslaves; t++)
 	{
 	    config.movex = slave_movex[t];
@@ -1391,6 +1647,9 @@ int main(int argn, char *argv[])
     }
     close(fi);
 
+    if(catjob.files)
+	catcombine_free(&catjob, &newswf);
+
     return 0; //ok
 }
 
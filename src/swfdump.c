@@ -895,7 +895,7 @@ void handleShape(TAG*tag, char*prefix)
 
     printf("%s |\n", prefix);
 
-    line = shape.lines;
+    line = swf_Shape2GetLines(&shape);
     while(line) {
 	printf("%s | fill: %02d/%02d line:%02d - ",
 		prefix, 
@@ -1031,6 +1031,7 @@ static void handleFontAlign2(TAG*tag, char*prefix)
     int num = 0;
 #ifdef ALIGN_WITH_GLYPHS
     SWF swf;
+    memset(&swf, 0, sizeof(swf));
     swf.firstTag = tag;
     while(swf.firstTag->prev) swf.firstTag = swf.firstTag->prev;
     SWFFONT* font = 0;
@@ -1159,7 +1160,7 @@ int main (int argc,char ** argv)
         swf_ReadABCfile(filename, &swf);
     } else {
         f = open(filename,O_RDONLY|O_BINARY);
-        if FAILED(swf_ReadSWF(f,&swf))
+        if FAILED(swf_ReadSWFMapped(f,&swf))
         { 
             fprintf(stderr, "%s is not a valid SWF file or contains errors.\n",filename);
             close(f);
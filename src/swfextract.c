@@ -33,6 +33,9 @@
 #define _ZLIB_INCLUDED_
 #endif
 #endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 char * filename = 0;
 char * destfilename = "output.swf";
@@ -58,6 +61,12 @@ char movetozero = 0;
 int numextracts = 0;
 char *outputformat = NULL;
 
+int jobs = 0;
+#define LOSSLESS_PNG 0
+#define LOSSLESS_FASTPNG 1
+#define LOSSLESS_RGBA 2
+int losslessformat = LOSSLESS_PNG;
+
 struct options_t options[] =
 {
  {"o","output"},
@@ -78,6 +87,8 @@ struct options_t options[] =
  {"V","version"},
  {"b","binary"},
  {"O","outputformat"},
+ {"J","jobs"},
+ {"l","lossless"},
  {0,0}
 };
 
@@ -202,6 +213,27 @@ int args_callback_option(char*name,char*val)
       outputformat = val;
 	return 1;
     }
+    else if(!strcmp(name, "J")) {
+	jobs = atoi(val);
+	if(jobs<1) {
+	    fprintf(stderr, "Error: -J needs a number of threads (at least 1)\n");
+	    exit(1);
+	}
+	return 1;
+    }
+    else if(!strcmp(name, "l")) {
+	if(!strcmp(val, "png")) {
+	    losslessformat = LOSSLESS_PNG;
+	} else if(!strcmp(val, "fastpng")) {
+	    losslessformat = LOSSLESS_FASTPNG;
+	} else if(!strcmp(val, "rgba")) {
+	    losslessformat = LOSSLESS_RGBA;
+	} else {
+	    fprintf(stderr, "Error: unknown lossless format \"%s\" (try png, fastpng or rgba)\n", val);
+	    exit(1);
+	}
+	return 1;
+    }
     else {
         printf("Unknown option: -%s\n", name);
 	exit(1);
@@ -233,7 +265,9 @@ void args_callback_usage(char*name)
     printf("\t-j , --jpeg ID\t\t\t Extract JPEG picture(s)\n");
 #ifdef _ZLIB_INCLUDED_
     printf("\t-p , --pngs ID\t\t\t Extract PNG picture(s)\n");
+    printf("\t-l , --lossless format\t\t Write lossless pictures as png, fastpng or rgba\n");
 #endif
+    printf("\t-J , --jobs threads\t\t Decode and write pictures and sounds in parallel\n");
     printf("\n");
     printf("Sound extraction:\n");
     printf("\t-m , --mp3\t\t\t Extract main mp3 stream\n");
@@ -255,7 +289,8 @@ void prepare_name(char *buf, size_t len, const char *prefix,
   if (outputformat!=NULL) {
     // override default file name formatting
     // make sure single-file behavior is not used
-    numextracts = -1;
+    if(numextracts != -1)
+	numextracts = -1;
     // Other parts of codebase use vsnprintf, so I assume snprintf
     // is available on all platforms that swftools currently works on.
     // We need to check for buffer overflows now that the user is 
@@ -274,16 +309,17 @@ U8 mainr,maing,mainb;
    7 = wanted, expanded
  */
 char used[65536];
-TAG*tags[65536];
-int changed;
+U16 todo[65536]; // ids which are used, but not expanded yet
+int numtodo;
 char * tagused;
 int extractname_id = -1;
 
 void idcallback(void*data)
 {
-    if(!(used[GET16(data)]&1)) {
-	changed = 1;
-	used[GET16(data)] |= 1;
+    int id = GET16(data);
+    if(!(used[id]&1)) {
+	used[id] |= 1;
+	todo[numtodo++] = id;
     }
 }
 
@@ -314,6 +350,7 @@ void enumerateIDs(TAG*tag, void(*callback)(void*))
     swf_GetUsedIDs(tag, ptr);
     for(t=0;t<num;t++)
 	callback(&tag->data[ptr[t]]);
+    free(ptr);
 }
 
 void moveToZero(TAG*tag)
@@ -361,27 +398,29 @@ void extractTag(SWF*swf, char*filename)
 
     swf_GetRect(0, &objectbbox);
 
-    do {
-       changed = 0;
-       for(t=0;t<65536;t++) {
-	   if(used[t] && !(used[t]&2)) {
-	     if(tags[t]==0) {
-		 msg("<warning> ID %d is referenced, but never defined.", t);
-	     } else if(tags[t]->id==ST_DEFINESPRITE) {
-		 TAG*tag = tags[t];
-		 while(tag->id != ST_END)
-		 {
-		     enumerateIDs(tag, idcallback);
-		     tag = tag->next;
-		 }
-	     }
-	     else 
-	       enumerateIDs(tags[t], idcallback);
-	     used[t] |= 2;
-	   }
-       }
+    numtodo = 0;
+    for(t=0;t<65536;t++) {
+	if(used[t] && !(used[t]&2))
+	    todo[numtodo++] = t;
+    }
+    while(numtodo) {
+	int id = todo[--numtodo];
+	TAG*tag = swf_IndexGetDefiningTag(swf, id);
+	if(used[id]&2)
+	    continue;
+	used[id] |= 2;
+	if(!tag) {
+	    msg("<warning> ID %d is referenced, but never defined.", id);
+	} else if(tag->id==ST_DEFINESPRITE) {
+	    while(tag->id != ST_END)
+	    {
+		enumerateIDs(tag, idcallback);
+		tag = tag->next;
+	    }
+	}
+	else 
+	    enumerateIDs(tag, idcallback);
     }
-    while(changed);
 
     srctag = swf->firstTag;
     tagnum = 0;
@@ -709,6 +748,10 @@ int findjpegboundary(U8*data, int len)
     return pos;
 }
 
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t jpegmutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 /* extract jpeg data out of a tag */
 int handlejpeg(TAG*tag)
 {
@@ -773,6 +816,10 @@ int handlejpeg(TAG*tag)
 	}
 	unsigned char*image;
 	unsigned width=0, height=0;
+#ifdef HAVE_PTHREAD_H
+	/* lib/jpeg.c and lib/png.c keep their state in globals */
+	pthread_mutex_lock(&jpegmutex);
+#endif
 	jpeg_load_from_mem(&tag->data[6], end-6, &image, &width, &height);
 
 	uLongf datalen = width*height;
@@ -781,6 +828,9 @@ int handlejpeg(TAG*tag)
 	int error = uncompress(data, &datalen, &tag->data[end], (uLong)(tag->len - end));
 	if(error != Z_OK) {
 	  fprintf(stderr, "Zlib error %d\n", error);
+#ifdef HAVE_PTHREAD_H
+	  pthread_mutex_unlock(&jpegmutex);
+#endif
 	  return 0;
 	}
 	int t, size = width*height;
@@ -789,6 +839,9 @@ int handlejpeg(TAG*tag)
 	}
 	free(data);
 	png_write(filename, image, width, height);
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&jpegmutex);
+#endif
 	free(image);
     }
     else {
@@ -803,7 +856,12 @@ int handlejpeg(TAG*tag)
 }
 
 #ifdef _ZLIB_INCLUDED_
-static U32 mycrc32;
+/* the crc is kept per file, so that several pictures can be written
+   at the same time (-J) */
+typedef struct _pngfile {
+    FILE*fi;
+    U32 crc;
+} pngfile_t;
 
 static U32*crc32_table = 0;
 static void make_crc32_table(void)
@@ -822,40 +880,39 @@ static void make_crc32_table(void)
     crc32_table[t] = c;
   }
 }
-static inline void png_write_byte(FILE*fi, U8 byte)
+static void png_write_bytes(pngfile_t*png, U8*bytes, int len)
+{
+    U32 crc = png->crc;
+    int t;
+    for(t=0;t<len;t++)
+	crc = crc32_table[(crc ^ bytes[t]) & 0xff] ^ (crc >> 8);
+    png->crc = crc;
+    fwrite(bytes,len,1,png->fi);
+}
+static inline void png_write_byte(pngfile_t*png, U8 byte)
 {
-    fwrite(&byte,1,1,fi);
-    mycrc32 = crc32_table[(mycrc32 ^ byte) & 0xff] ^ (mycrc32 >> 8);
+    png_write_bytes(png,&byte,1);
 }
-static void png_start_chunk(FILE*fi, char*type, int len)
+static void png_start_chunk(pngfile_t*png, char*type, int len)
 {
     U8 mytype[4]={0,0,0,0};
     U32 mylen = BE_32_TO_NATIVE(len);
     memcpy(mytype,type,strlen(type));
-    fwrite(&mylen, 4, 1, fi);
-    mycrc32=0xffffffff;
-    png_write_byte(fi,mytype[0]);
-    png_write_byte(fi,mytype[1]);
-    png_write_byte(fi,mytype[2]);
-    png_write_byte(fi,mytype[3]);
-}
-static void png_write_bytes(FILE*fi, U8*bytes, int len)
-{
-    int t;
-    for(t=0;t<len;t++)
-	png_write_byte(fi,bytes[t]);
+    fwrite(&mylen, 4, 1, png->fi);
+    png->crc=0xffffffff;
+    png_write_bytes(png,mytype,4);
 }
-static void png_write_dword(FILE*fi, U32 dword)
+static void png_write_dword(pngfile_t*png, U32 dword)
 {
-    png_write_byte(fi,dword>>24);
-    png_write_byte(fi,dword>>16);
-    png_write_byte(fi,dword>>8);
-    png_write_byte(fi,dword);
+    png_write_byte(png,dword>>24);
+    png_write_byte(png,dword>>16);
+    png_write_byte(png,dword>>8);
+    png_write_byte(png,dword);
 }
-static void png_end_chunk(FILE*fi)
+static void png_end_chunk(pngfile_t*png)
 {
-    U32 tmp = BE_32_TO_NATIVE((mycrc32^0xffffffff));
-    fwrite(&tmp,4,1,fi);
+    U32 tmp = BE_32_TO_NATIVE((png->crc^0xffffffff));
+    fwrite(&tmp,4,1,png->fi);
 }
 
 
@@ -868,6 +925,7 @@ int handlelossless(TAG*tag)
     char name[80];
     char*filename = name;
     FILE*fi;
+    pngfile_t png;
     int width, height;
     int crc;
     int id;
@@ -944,7 +1002,7 @@ int handlelossless(TAG*tag)
     pos = 0;
     datalen2 = datalen+16;
     data2 = malloc(datalen2);
-    palette = (RGBA*)malloc(cols*sizeof(RGBA));
+    palette = (RGBA*)calloc(cols>256?cols:256, sizeof(RGBA)); // PLTE below is always 256 entries
 
     for(t=0;t<cols;t++) {
 	palette[t].r = data[pos++];
@@ -952,7 +1010,50 @@ int handlelossless(TAG*tag)
 	palette[t].b = data[pos++];
 	if(alpha) {
 	    palette[t].a = data[pos++];
+	} else {
+	    palette[t].a = 255;
+	}
+    }
+
+    if(losslessformat == LOSSLESS_RGBA) {
+	/* plain rgba, 4 bytes per pixel, no header */
+	U8*rgba = (U8*)malloc(width*height*4+1);
+	int srcwidth = width * (bpp/8);
+	int x,y,pos2 = 0;
+	for(y=0;y<height;y++) {
+	    if(bpp==32) {
+		for(x=0;x<width;x++) {
+		    rgba[pos2++]=data[pos+1];
+		    rgba[pos2++]=data[pos+2];
+		    rgba[pos2++]=data[pos+3];
+		    rgba[pos2++]=alpha?data[pos+0]:255;
+		    pos+=4;
+		}
+	    } else {
+		for(x=0;x<width;x++) {
+		    RGBA*c = &palette[data[pos++]];
+		    rgba[pos2++]=c->r;
+		    rgba[pos2++]=c->g;
+		    rgba[pos2++]=c->b;
+		    rgba[pos2++]=c->a;
+		}
+	    }
+	    pos+=((srcwidth+3)&~3)-srcwidth; //align
 	}
+	prepare_name(name, sizeof(name), "pic", "rgba", id);
+	if(numextracts==1) {
+	    filename = destfilename;
+	    if(!strcmp(filename,"output.swf"))
+		filename = "output.rgba";
+	}
+	fi = save_fopen(filename, "wb");
+	fwrite(rgba, width*height*4, 1, fi);
+	fclose(fi);
+	free(rgba);
+	free(palette);
+	free(data);
+	free(data2);
+	return 1;
     }
 
     prepare_name(name, sizeof(name), "pic", "png", id);
@@ -962,42 +1063,43 @@ int handlelossless(TAG*tag)
 	    filename = "output.png";
     }
     fi = save_fopen(filename, "wb");
+    png.fi = fi;
     fwrite(head,sizeof(head),1,fi);     
 
-    png_start_chunk(fi, "IHDR", 13);
-     png_write_dword(fi,width);
-     png_write_dword(fi,height);
-     png_write_byte(fi,8);
+    png_start_chunk(&png, "IHDR", 13);
+     png_write_dword(&png,width);
+     png_write_dword(&png,height);
+     png_write_byte(&png,8);
      if(format == 3)
-     png_write_byte(fi,3); //indexed
+     png_write_byte(&png,3); //indexed
      else if(format == 5 && alpha==0)
-     png_write_byte(fi,2); //rgb
+     png_write_byte(&png,2); //rgb
      else if(format == 5 && alpha==1)
-     png_write_byte(fi,6); //rgba
+     png_write_byte(&png,6); //rgba
      else return 0;
 
-     png_write_byte(fi,0); //compression mode
-     png_write_byte(fi,0); //filter mode
-     png_write_byte(fi,0); //interlace mode
-    png_end_chunk(fi);
+     png_write_byte(&png,0); //compression mode
+     png_write_byte(&png,0); //filter mode
+     png_write_byte(&png,0); //interlace mode
+    png_end_chunk(&png);
    
     if(format == 3) {
-	png_start_chunk(fi, "PLTE", 768);
+	png_start_chunk(&png, "PLTE", 768);
 	 
 	 for(t=0;t<256;t++) {
-	     png_write_byte(fi,palette[t].r);
-	     png_write_byte(fi,palette[t].g);
-	     png_write_byte(fi,palette[t].b);
+	     png_write_byte(&png,palette[t].r);
+	     png_write_byte(&png,palette[t].g);
+	     png_write_byte(&png,palette[t].b);
 	 }
-	png_end_chunk(fi);
+	png_end_chunk(&png);
 
 	if(alpha) {
 	    /* write alpha palette */
-	    png_start_chunk(fi, "tRNS", 256);
+	    png_start_chunk(&png, "tRNS", 256);
 	    for(t=0;t<256;t++) {
-		png_write_byte(fi,palette[t].a);
+		png_write_byte(&png,palette[t].a);
 	    }
-	    png_end_chunk(fi);
+	    png_end_chunk(&png);
 	}
     }
     {
@@ -1038,20 +1140,23 @@ int handlelossless(TAG*tag)
 	datalen3=pos2;
     }
 
-    if(compress (data2, &datalen2, data3, datalen3) != Z_OK) {
+    if(compress2(data2, &datalen2, data3, datalen3,
+		 losslessformat==LOSSLESS_FASTPNG?Z_BEST_SPEED:Z_DEFAULT_COMPRESSION) != Z_OK) {
 	fprintf(stderr, "zlib error in pic %d\n", id);
 	return 0;
     }
     msg("<verbose> Compressed data is %d bytes", datalen2);
-    png_start_chunk(fi, "IDAT", datalen2);
-    png_write_bytes(fi,data2,datalen2);
-    png_end_chunk(fi);
-    png_start_chunk(fi, "IEND", 0);
-    png_end_chunk(fi);
+    png_start_chunk(&png, "IDAT", datalen2);
+    png_write_bytes(&png,data2,datalen2);
+    png_end_chunk(&png);
+    png_start_chunk(&png, "IEND", 0);
+    png_end_chunk(&png);
+    fclose(fi);
 
     free(data);
     free(data2);
     free(data3);
+    free(palette);
     return 1;
 }
 #endif
@@ -1200,6 +1305,121 @@ int handleembeddedmp3(TAG*tag) {
     return 1;
 }
 
+int handleany(TAG*tag)
+{
+    if (handlejpeg(tag)) {
+	// pass
+    } else if (handlebinary(tag)) {
+	// pass
+#ifdef _ZLIB_INCLUDED_
+    } else if (handlelossless(tag)) {
+	// pass
+#endif
+    } else if (handledefinesound(tag)) {
+	// Not sure if sound code checks carefully for type.
+	// pass
+    } else if (handleembeddedmp3(tag)) {
+	// pass
+    } else {
+	printf("#%d not processed\n", GET16(tag->data));
+	return 0;
+    }
+    return 1;
+}
+
+/* With -J, pictures, sounds and binaries are collected while walking the
+   tag list and then decoded and written by a pool of threads. Fonts and
+   sprites are always handled right away, as they need (and change) more
+   than their own tag. */
+typedef struct _extractjob {
+    int (*handler)(TAG*tag);
+    TAG*tag;
+} extractjob_t;
+
+static extractjob_t*extractjobs = 0;
+static int numextractjobs = 0;
+static int extractjobssize = 0;
+static int nextextractjob = 0;
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t extractmutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+void extract(int (*handler)(TAG*tag), TAG*tag)
+{
+    if(!jobs) {
+	handler(tag);
+	return;
+    }
+    if(numextractjobs == extractjobssize) {
+	extractjobssize = extractjobssize?extractjobssize*2:64;
+	extractjobs = (extractjob_t*)rfx_realloc(extractjobs, extractjobssize*sizeof(extractjob_t));
+    }
+    extractjobs[numextractjobs].handler = handler;
+    extractjobs[numextractjobs].tag = tag;
+    numextractjobs++;
+}
+
+static void* extract_thread(void*data)
+{
+    while(1) {
+	int nr;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&extractmutex);
+#endif
+	nr = nextextractjob++;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&extractmutex);
+#endif
+	if(nr >= numextractjobs)
+	    break;
+	extractjobs[nr].handler(extractjobs[nr].tag);
+    }
+    return 0;
+}
+
+static void run_extractthreads()
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_t*threads = (pthread_t*)rfx_alloc(jobs*sizeof(pthread_t));
+    int t, num;
+    for(t=0;t<jobs && t<numextractjobs;t++) {
+	if(pthread_create(&threads[t], 0, extract_thread, 0))
+	    break;
+    }
+    num = t;
+    if(!num) {
+	/* couldn't start any threads- do it ourselves */
+	extract_thread(0);
+    }
+    for(t=0;t<num;t++)
+	pthread_join(threads[t], 0);
+    rfx_free(threads);
+#else
+    extract_thread(0);
+#endif
+}
+
+void run_extractjobs()
+{
+    if(!numextractjobs)
+	return;
+#ifdef _ZLIB_INCLUDED_
+    make_crc32_table();
+#endif
+    if(numextracts==1 || (outputformat && !strchr(outputformat, '%'))) {
+	/* everything goes to the same file- write it in order, so that
+	   the result is the same as without -J */
+	extract_thread(0);
+    } else {
+	if(outputformat)
+	    numextracts = -1; // as prepare_name() would, but before the threads start
+	run_extractthreads();
+    }
+    rfx_free(extractjobs);
+    extractjobs = 0;
+    numextractjobs = extractjobssize = nextextractjob = 0;
+}
+
 int main (int argc,char ** argv)
 { 
     TAG*tag;
@@ -1236,7 +1456,7 @@ int main (int argc,char ** argv)
         perror("Couldn't open file: ");
         exit(1);
     }
-    if (swf_ReadSWF(f,&swf) < 0)
+    if (swf_ReadSWFShared(f,&swf) < 0)
     { 
         fprintf(stderr, "%s is not a valid SWF file or contains errors.\n",filename);
         close(f);
@@ -1250,6 +1470,8 @@ int main (int argc,char ** argv)
 	return 0;
     }
 
+    swf_IndexSWF(&swf);
+
     tag = swf.firstTag;
     tagnum = 0;
     while(tag) {
@@ -1305,7 +1527,6 @@ int main (int argc,char ** argv)
 
 	if(swf_isDefiningTag(tag)) {
 	    int id = swf_GetDefineID(tag);
-	    tags[id] = tag;
 	    if(extractids && is_in_range(id, extractids)) {
 		used[id] = 5;
 		found = 1;
@@ -1314,40 +1535,30 @@ int main (int argc,char ** argv)
 		handlefont(&swf, tag);
 	    }
 	    if(extractjpegids && is_in_range(id, extractjpegids)) {
-		handlejpeg(tag);
+		extract(handlejpeg, tag);
 	    }
 	    if(extractsoundids && is_in_range(id, extractsoundids)) {
-		handledefinesound(tag);
+		extract(handledefinesound, tag);
 	    }
 	    if(extractmp3ids && is_in_range(id, extractmp3ids)) {
 		handleembeddedmp3(tag);
 	    }
 	    if(extractbinaryids && is_in_range(id, extractbinaryids)) {
-		handlebinary(tag);
+		extract(handlebinary, tag);
 	    }
 #ifdef _ZLIB_INCLUDED_
 	    if(extractpngids && is_in_range(id, extractpngids)) {
-		handlelossless(tag);
+		extract(handlelossless, tag);
 	    }
 #endif
 	    if(extractanyids && is_in_range(id, extractanyids)) {
 	        if (handlefont(&swf,tag)) {
 		    // pass
-		} else if (handlejpeg(tag)) {
-		    // pass
-		} else if (handlebinary(tag)) {
-		    // pass
-#ifdef _ZLIB_INCLUDED_
-		} else if (handlelossless(tag)) {
-		    // pass
-#endif
-		} else if (handledefinesound(tag)) {
-		    // Not sure if sound code checks carefully for type.
-		    // pass
-		} else if (handleembeddedmp3(tag)) {
-		    // pass
+		} else if (tag->id == ST_DEFINESPRITE) {
+		    // might write to the main mp3 stream
+		    handleany(tag);
 		} else {
-		    printf("#%d not processed\n", id);
+		    extract(handleany, tag);
 		}
 	    }
 	}
@@ -1386,6 +1597,8 @@ int main (int argc,char ** argv)
 	tag = tag->next;
 	tagnum ++;
     }
+    run_extractjobs();
+
     if (found)
 	extractTag(&swf, destfilename);
 
@@ -149,7 +149,7 @@ int main(int argn, char*argv[])
             perror(filename);
             exit(1);
         }
-        if(swf_ReadSWF(fi,&swf)<0) { 
+        if(swf_ReadSWFShared(fi,&swf)<0) { 
             fprintf(stderr,"%s is not a valid SWF file or contains errors.\n",argv[1]);
             close(fi);
         }
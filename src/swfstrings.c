@@ -28,6 +28,7 @@
 static char * filename = 0;
 static char showfonts = 0;
 static int x=0,y=0,w=0,h=0;
+static int jobs=1;
 
 static struct options_t options[] = {
 {"f", "fonts"},
@@ -35,6 +36,7 @@ static struct options_t options[] = {
 {"y", "ypos"},
 {"W", "width"},
 {"H", "height"},
+{"j", "jobs"},
 {"V", "version"},
 {0,0}
 };
@@ -56,6 +58,13 @@ int args_callback_option(char*name,char*val)
     } else if(!strcmp(name, "H")) {
 	h = atoi(val);
 	return 1;
+    } else if(!strcmp(name, "j")) {
+	jobs = atoi(val);
+	if(jobs<1) {
+	    fprintf(stderr, "Error: -j needs a number of threads (at least 1).\n");
+	    exit(1);
+	}
+	return 1;
     } else if(!strcmp(name, "f")) {
 	showfonts = 1;
 	return 0;
@@ -82,6 +91,7 @@ void args_callback_usage(char *name)
     printf("-y , --ypos <y>                Set bounding box y coordinate\n");
     printf("-W , --width <width>           Set bounding box width\n");
     printf("-H , --height <height>         Set bounding box height\n");
+    printf("-j , --jobs <threads>          Extract fonts and parse texts using <threads> threads\n");
     printf("-V , --version                 Print version information and exit\n");
     printf("\n");
 }
@@ -96,44 +106,23 @@ int args_callback_command(char*name,char*val)
 }
 
 static SWF swf;
-static int fontnum = 0;
-static SWFFONT**fonts = 0;
-
-void fontcallback1(void*self, U16 id,U8 * name)
-{ fontnum++;
-}
 
-void fontcallback2(void*self, U16 id,U8 * name)
-{ 
-  swf_FontExtract(&swf,id,&fonts[fontnum]);
-  fontnum++;
-}
-
-
-void textcallback(void*self, int*glyphs, int*advance, int nr, int fontid, int fontsize, int startx, int starty, RGBA*color) 
+void printrun(SWFTEXTRUN*run, MATRIX*m)
 {
-    SWFFONT*font = 0;
+    SWFFONT*font = run->font;
     int t;
-    for(t=0;t<fontnum;t++)
-    {
-	if(fonts[t]->id == fontid) {
-	    font = fonts[t];
-	    break;
-	}
-    }
 
     if(showfonts) {
 	if(font)
-	    printf("#<font %d \"%s\"%s%s>\n", fontid, font->name, swf_FontIsBold(font)?" bold":"",swf_FontIsItalic(font)?" italic":"");
-	printf("#<color #%02x%02x%02x%02x>\n", color->r, color->g, color->b, color->a);
-	printf("#<size %d>\n", fontsize);
+	    printf("#<font %d \"%s\"%s%s>\n", run->fontid, font->name, swf_FontIsBold(font)?" bold":"",swf_FontIsItalic(font)?" italic":"");
+	printf("#<color #%02x%02x%02x%02x>\n", run->color.r, run->color.g, run->color.b, run->color.a);
+	printf("#<size %d>\n", run->fontsize);
     }
 
-    for(t=0;t<nr;t++)
+    for(t=0;t<run->num;t++)
     {
-	int xx = startx + advance[t];
-	int yy = starty;
-	MATRIX*m = (MATRIX*)self;
+	int xx = run->x + run->xpos[t];
+	int yy = run->y;
 	
 	SPOINT p = {xx,yy};
 	p = swf_TurnPoint(p, m);
@@ -143,28 +132,12 @@ void textcallback(void*self, int*glyphs, int*advance, int nr, int fontid, int fo
 	if(x|y|w|h) {
 	    if(xx < x || yy < y || xx > x+w || yy > y+h) {
 		/* outside of bounding box */
-		///printf("(%d+%d,%d) -> (%d,%d)\n", startx, advance[t]/20, starty, xx, yy);
-		if(t==nr-1) return;
+		if(t==run->num-1) return;
 		else continue;
 	    }
 	}
 
-	unsigned int a;
-	int advance = 0;
-	if(font) {
-	    if(glyphs[t]<0 || glyphs[t] >= font->numchars  /*glyph is not in range*/
-		    || !font->glyph2ascii /* font has ascii<->glyph mapping */
-	      ) a = glyphs[t];
-	    else {
-		if(font->glyph2ascii[glyphs[t]])
-		    a = font->glyph2ascii[glyphs[t]];
-		else
-		    a = glyphs[t];
-	    }
-	} else {
-	    a = glyphs[t];
-	}
-
+	unsigned int a = run->unicode[t];
 	if(a>=32) {
 	    char* utf8 = getUTF8(a);
 	    printf("%s", utf8);
@@ -175,19 +148,6 @@ void textcallback(void*self, int*glyphs, int*advance, int nr, int fontid, int fo
     printf("\n");
 }
 
-void fontcallback(void*self,U16 id,U8 * name)
-{ SWFFONT* font;
-  TAG* t;
-  
-  swf_FontExtract(&swf,id,&font);
-
-  t = swf.firstTag;
-
-  swf_FontFree(font);
-}
-
-TAG**id2tag = 0;
-
 int main (int argc,char ** argv)
 { 
     int f;
@@ -196,7 +156,7 @@ int main (int argc,char ** argv)
 	exit(0);
 
     f = open(filename,O_RDONLY|O_BINARY);
-    if (f<0 || swf_ReadSWF(f,&swf)<0) {
+    if (f<0 || swf_ReadSWFMapped(f,&swf)<0) {
 	fprintf(stderr,"%s is not a valid SWF file or contains errors.\n",filename);
 	if(f>=0) close(f);
 	exit(-1);
@@ -208,38 +168,29 @@ int main (int argc,char ** argv)
 	if(!h) h = (swf.movieSize.ymax - swf.movieSize.ymin) / 20;
     }
 
-    id2tag = rfx_calloc(sizeof(TAG)*65536);
-
-    fontnum = 0;
-    swf_FontEnumerate(&swf,&fontcallback1, 0);
-    fonts = (SWFFONT**)malloc(fontnum*sizeof(SWFFONT*));
-    fontnum = 0;
-    swf_FontEnumerate(&swf,&fontcallback2, 0);
+    SWFTEXTINDEX*index = swf_TextIndexSWF(&swf, jobs);
  
     TAG*tag = swf.firstTag;
     while (tag)
     { 
-	if(swf_isTextTag(tag)) {
-	    id2tag[swf_GetDefineID(tag)] = tag;
-	} else if(swf_isPlaceTag(tag)) {
+	if(swf_isPlaceTag(tag)) {
 	    SWFPLACEOBJECT po;
 	    swf_SetTagPos(tag, 0);
 	    swf_GetPlaceObject(tag, &po);
-	    if(!po.move && id2tag[po.id]) {
-		TAG*text = id2tag[po.id];
-		swf_SetTagPos(text, 0);
-		swf_GetU16(text);
-		swf_GetRect(text, NULL);
-		swf_ResetReadBits(text);
-		MATRIX m,tm;
-		swf_GetMatrix(text, &tm);
-		swf_MatrixJoin(&m, &po.matrix, &tm);
-		swf_ParseDefineText(text, textcallback, &m);
+	    SWFTEXT*text = po.move?0:swf_TextIndexGetText(index, po.id);
+	    if(text) {
+		MATRIX m;
+		int t;
+		swf_MatrixJoin(&m, &po.matrix, &text->matrix);
+		for(t=0;t<text->numruns;t++)
+		    printrun(&text->runs[t], &m);
 	    }
+	    swf_PlaceObjectFree(&po);
 	}
 	tag = tag->next;
     }
   
+    swf_TextIndexFree(index);
     swf_FreeTags(&swf);
     return 0;
 }